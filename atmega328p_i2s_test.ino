@@ -1,5 +1,6 @@
 #include <avr/io.h>
 #include "delay_in_cycles.hpp"
+#include "frame_scheduler.hpp"
 #include "i2s_driver.hpp"
 #include "wave_generators.hpp"
 
@@ -35,6 +36,13 @@ int main() {
   >();
   SquareWaveGenerator<MyDriver::FRAME_PERIOD> generator(440, 16);
   int16_t sample = generator.getFirstSample();
+  /*
+   * This is the loop disassembler-output.txt was generated from. The same
+   * loop, built by runFrameLoop() (see frame_scheduler.hpp), is in
+   * extras/examples/frame_scheduler_example.cpp, until its disassembly has
+   * been checked. GET_NEXT_SAMPLE_DURATION doesn't include the jump back to
+   * the start of the loop, which is why it's subtracted separately.
+   */
   for (;;) {
     driver.sendSample(sample);
     delayInCyclesWithLoop<driver.SAMPLE_PERIOD - driver.SEND_SAMPLE_DURATION>();
@@ -43,6 +51,7 @@ int main() {
       driver.SAMPLE_PERIOD
       - driver.SEND_SAMPLE_DURATION
       - generator.GET_NEXT_SAMPLE_DURATION
+      - FrameScheduler<MyDriver>::LOOP_JUMP_DURATION
     >();
     sample = generator.getNextSample();
   }
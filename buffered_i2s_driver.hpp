@@ -0,0 +1,303 @@
+#pragma once
+
+#include <avr/io.h>
+#include <util/atomic.h>
+#include "delay_in_cycles.hpp"
+#include "i2s_driver.hpp"
+#include "ring_buffer.hpp"
+
+
+/**
+ * A single audio frame (one sample per channel)
+ */
+struct StereoFrame {
+  int16_t left;
+  int16_t right;
+};
+
+
+/**
+ * Alternative version of I2SDriver, which doesn't need the caller to send
+ * samples on an exact CPU cycle. Instead, frames are pushed into a ring buffer
+ * living in SRAM, and the USART module is fed one byte at a time, whenever
+ * its buffer is empty (either by the USART_UDRE_vect interrupt handler or by
+ * polling UDRE0).
+ *
+ * Template parameters:
+ * - HALF_BIT_PERIOD, same as I2SDriver;
+ * - BUFFER_SIZE, the number of slots in the ring buffer (a power of 2, up to
+ *   256; each slot takes 4 bytes of SRAM);
+ * - INTERRUPT_DRIVEN, whether the USART_UDRE_vect interrupt is enabled; when
+ *   true, the sketch must define the interrupt handler, which simply calls
+ *   onBufferEmpty():
+ *     ISR(USART_UDRE_vect) {
+ *       MyDriver::onBufferEmpty();
+ *     }
+ *   when false, the caller must invoke poll() at least once every 8 *
+ *   FULL_BIT_PERIOD cycles instead (counting the time spent inside poll()
+ *   itself, which pops a frame after every fourth byte);
+ * - BUSY_EXTERNAL_CYCLES_BEFORE_FIRST_BUFFER_WRITE, same as I2SDriver, except
+ *   the first buffer write happens inside this class' constructor; it only
+ *   needs to be changed if the compiler places other instructions between
+ *   I2SDriver's constructor and the first write (check the disassembly);
+ * - WORD_SELECT_TIMER, same as I2SDriver.
+ *
+ * Producers push frames with pushFrame() (or pushBlock()), and can render them
+ * in blocks with a variable per-sample cost, as long as the buffer never runs
+ * empty on average. When it does, a silent frame is sent instead (so that the
+ * left and right channels never get swapped) and an underrun is counted. The
+ * lowest number of frames left in the buffer (the headroom) is tracked as
+ * well, which makes it easy to measure how much CPU time is still available.
+ *
+ * Some technical considerations.
+ *
+ * The word select timer is configured exactly like in I2SDriver, and the
+ * first sample (silence on the left channel) is written with the same timing
+ * rules. From then on, the USART module always finds its next byte in the
+ * buffer before the current one is shifted out, so the bitstream never pauses
+ * and word select stays phase-locked to the bit clock. The byte only needs to
+ * be written within the 8 * FULL_BIT_PERIOD cycles it takes to send the
+ * current one (80 cycles when HALF_BIT_PERIOD is 5), rather than on a
+ * specific cycle.
+ *
+ * The samples' bytes are sent MSB first: left high, left low, right high,
+ * right low. onBufferEmpty() always writes UDR0 first, and only then pops and
+ * unpacks the next frame (after the right low byte has been written), so the
+ * pop is never between UDRE0 being set and the write.
+ *
+ * The interrupt handler's overhead (entry, register saving, reti) is not
+ * negligible compared to the 8 * FULL_BIT_PERIOD cycles between two
+ * interrupts: a handler which ends late delays the next one, so the delays
+ * add up over a frame. In interrupt-driven mode, the class checks at compile
+ * time that every write still happens in time, using the upper bounds listed
+ * next to MAX_HANDLER_START; with these, HALF_BIT_PERIOD must be at least
+ * MIN_INTERRUPT_DRIVEN_HALF_BIT_PERIOD (7). Larger values of HALF_BIT_PERIOD
+ * leave proportionally more time to the producers.
+ */
+template<
+  uint8_t HALF_BIT_PERIOD,
+  uint16_t BUFFER_SIZE = 64,
+  bool INTERRUPT_DRIVEN = true,
+  uint8_t BUSY_EXTERNAL_CYCLES_BEFORE_FIRST_BUFFER_WRITE = 0,
+  WordSelectTimer WORD_SELECT_TIMER = WordSelectTimer::TIMER_0
+>
+class BufferedI2SDriver :
+  private I2SDriver<
+    HALF_BIT_PERIOD,
+    BUSY_EXTERNAL_CYCLES_BEFORE_FIRST_BUFFER_WRITE,
+    WORD_SELECT_TIMER
+  >
+{
+private:
+  using Base = I2SDriver<
+    HALF_BIT_PERIOD,
+    BUSY_EXTERNAL_CYCLES_BEFORE_FIRST_BUFFER_WRITE,
+    WORD_SELECT_TIMER
+  >;
+
+  static inline RingBuffer<StereoFrame, BUFFER_SIZE> frames;
+  /**
+   * The bytes of the frame being sent, in transmission order
+   */
+  static inline uint8_t currentFrame[4];
+  static inline uint8_t nextByteIndex;
+  static inline volatile uint16_t underrunCount;
+  static inline volatile uint8_t minimumHeadroom;
+
+  /*
+   * Upper bounds (in CPU cycles) of the interrupt handler's parts, derived
+   * from the instructions avr-gcc can generate for it rather than measured:
+   * - MAX_HANDLER_START, from UDRE0 being set to the handler's first
+   *   instruction: the instruction being executed (4), the section with
+   *   interrupts disabled in getUnderrunCount() (7), the interrupt response
+   *   (4) and the vector's jmp (3); the sketch's own sections with
+   *   interrupts disabled come on top of it;
+   * - MAX_PROLOGUE and MAX_EPILOGUE, saving and restoring r0, r1, SREG and
+   *   all 12 call-clobbered registers (reti included);
+   * - WRITE_DURATION, loading the index and the byte, and writing UDR0;
+   * - INDEX_UPDATE_DURATION, storing the next index and testing for the end
+   *   of the frame;
+   * - MAX_FRAME_POP_DURATION, popping the next frame, updating the headroom
+   *   (or the underrun count) and unpacking the frame into currentFrame.
+   */
+  static constexpr uint8_t MAX_HANDLER_START = 18;
+  static constexpr uint8_t MAX_PROLOGUE = 32;
+  static constexpr uint8_t MAX_EPILOGUE = 35;
+  static constexpr uint8_t WRITE_DURATION = 10;
+  static constexpr uint8_t INDEX_UPDATE_DURATION = 7;
+  static constexpr uint8_t MAX_FRAME_POP_DURATION = 50;
+
+  /**
+   * Tells whether, with the upper bounds above, every handler writes UDR0
+   * before the USART module runs out of bytes, given the half bit period.
+   * Byte k's UDRE0 is set when byte k - 1 starts shifting out (k * 8 *
+   * FULL_BIT_PERIOD cycles after the first one), and its handler can't start
+   * before the previous one has returned; three frames are enough for the
+   * delays to either settle or keep growing.
+   */
+  static constexpr bool IS_HANDLER_FAST_ENOUGH(const uint8_t halfBitPeriod) {
+    const uint32_t bytePeriod = 16 * uint32_t(halfBitPeriod);
+    uint32_t previousEnd = 0;
+    for (uint32_t k = 0; k < 12; k++) {
+      const uint32_t ready = k * bytePeriod;
+      const uint32_t write =
+        (previousEnd > ready ? previousEnd : ready)
+        + MAX_HANDLER_START + MAX_PROLOGUE + WRITE_DURATION;
+      if (write > ready + bytePeriod) {
+        return false;
+      }
+      previousEnd =
+        write + INDEX_UPDATE_DURATION
+        + (k % 4 == 3 ? MAX_FRAME_POP_DURATION : 0) + MAX_EPILOGUE;
+    }
+    return true;
+  }
+
+  static constexpr uint8_t GET_MIN_INTERRUPT_DRIVEN_HALF_BIT_PERIOD() {
+    uint8_t halfBitPeriod = 1;
+    while (!IS_HANDLER_FAST_ENOUGH(halfBitPeriod)) {
+      halfBitPeriod++;
+    }
+    return halfBitPeriod;
+  }
+
+public:
+  using Base::FULL_BIT_PERIOD;
+  using Base::SAMPLE_PERIOD;
+  using Base::FRAME_PERIOD;
+
+  /**
+   * The maximum number of frames the ring buffer can hold
+   */
+  static constexpr uint8_t CAPACITY =
+    RingBuffer<StereoFrame, BUFFER_SIZE>::CAPACITY;
+  /**
+   * The lowest HALF_BIT_PERIOD the interrupt handler is guaranteed to keep up
+   * with (see above)
+   */
+  static constexpr uint8_t MIN_INTERRUPT_DRIVEN_HALF_BIT_PERIOD =
+    GET_MIN_INTERRUPT_DRIVEN_HALF_BIT_PERIOD();
+  static_assert(
+    !INTERRUPT_DRIVEN
+      || HALF_BIT_PERIOD >= MIN_INTERRUPT_DRIVEN_HALF_BIT_PERIOD,
+    "The interrupt handler can't keep up with this HALF_BIT_PERIOD, use a"
+    " larger one or poll()!"
+  );
+
+  /**
+   * Frames can (and should) be pushed before creating the driver, so that the
+   * buffer doesn't run empty right away.
+   */
+  BufferedI2SDriver() {
+    delayInCyclesWithNOP<
+      Base::OTHER_EXTERNAL_DELAY_CYCLES_BEFORE_FIRST_BUFFER_WRITE
+    >();
+    Base::sendSample(0);
+    // The left channel of the first frame has just been sent
+    currentFrame[2] = currentFrame[3] = 0;
+    nextByteIndex = 2;
+    underrunCount = 0;
+    minimumHeadroom = CAPACITY;
+    if (INTERRUPT_DRIVEN) {
+      bitSet(UCSR0B, UDRIE0);
+      interrupts();
+    }
+  }
+
+  /**
+   * Producer side: appends a frame to the ring buffer, unless it's full (in
+   * which case false is returned)
+   */
+  static bool pushFrame(const int16_t left, const int16_t right) {
+    return frames.push({left, right});
+  }
+
+  /**
+   * Producer side: appends count frames at once, taking the samples from the
+   * left and right arrays (which can be the same array, for mono signals),
+   * unless there's not enough space (in which case nothing is pushed and
+   * false is returned). This pairs with the generators' renderBlock():
+   *   int16_t block[BLOCK_SIZE];
+   *   if (MyDriver::getFreeFrames() >= BLOCK_SIZE) {
+   *     generator.renderBlock(block, BLOCK_SIZE);
+   *     MyDriver::pushBlock(block, block, BLOCK_SIZE);
+   *   }
+   */
+  static bool pushBlock(
+    const int16_t* left,
+    const int16_t* right,
+    const uint8_t count
+  ) {
+    return frames.pushBlock(count, [&](const uint8_t i) {
+      return StereoFrame{left[i], right[i]};
+    });
+  }
+
+  static uint8_t getFreeFrames() {
+    return frames.getFreeSpace();
+  }
+
+  /**
+   * The number of silent frames sent because the ring buffer was empty
+   */
+  static uint16_t getUnderrunCount() {
+    uint16_t count;
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+      count = underrunCount;
+    }
+    return count;
+  }
+
+  /**
+   * The lowest number of frames found in the ring buffer right after a frame
+   * was popped
+   */
+  static uint8_t getMinimumHeadroom() {
+    return minimumHeadroom;
+  }
+
+  static void resetStatistics() {
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+      underrunCount = 0;
+      minimumHeadroom = CAPACITY;
+    }
+  }
+
+  /**
+   * Consumer side: writes the next byte into the USART buffer. It must only
+   * be called when UDRE0 is set (e.g. from the USART_UDRE_vect interrupt
+   * handler).
+   */
+  static void onBufferEmpty() {
+    const uint8_t index = nextByteIndex;
+    UDR0 = currentFrame[index];
+    nextByteIndex = (index + 1) & 3;
+    if (index == 3) {
+      StereoFrame frame;
+      if (frames.pop(frame)) {
+        uint8_t headroom = frames.getUsedSpace();
+        if (headroom < minimumHeadroom) {
+          minimumHeadroom = headroom;
+        }
+      } else {
+        frame = {0, 0};
+        underrunCount = underrunCount + 1;
+        minimumHeadroom = 0;
+      }
+      currentFrame[0] = uint8_t(frame.left >> 8);
+      currentFrame[1] = uint8_t(frame.left & 0xff);
+      currentFrame[2] = uint8_t(frame.right >> 8);
+      currentFrame[3] = uint8_t(frame.right & 0xff);
+    }
+  }
+
+  /**
+   * Polling alternative to the interrupt handler; cheap enough to be
+   * sprinkled inside rendering loops
+   */
+  static void poll() {
+    if (bit_is_set(UCSR0A, UDRE0)) {
+      onBufferEmpty();
+    }
+  }
+};
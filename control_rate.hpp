@@ -0,0 +1,391 @@
+#pragma once
+
+/*
+ * Slowly changing parameters (a voice's amplitude, a vibrato's depth) don't
+ * need to be updated at audio rate: this header provides envelopes and LFOs
+ * which are updated once every few frames, and a work item which spreads
+ * their updates over consecutive frames, so that each frame only pays for one
+ * of them.
+ *
+ * The update durations were counted from the instructions they need, not
+ * measured on a listing yet.
+ */
+
+#include <avr/pgmspace.h>
+#include "delay_in_cycles.hpp"
+#include "frame_scheduler.hpp"
+#include "type_traits_clone.hpp"
+#include "wavetables.hpp"
+
+
+/**
+ * Returns the number of control-rate updates which last (approximately) the
+ * given time, at least 1
+ */
+constexpr uint32_t GET_CONTROL_RATE_UPDATES(
+  const uint16_t frameCycles,
+  const uint8_t updatePeriodFrames,
+  const uint16_t milliseconds
+) {
+  const uint32_t updateCycles = uint32_t(frameCycles) * updatePeriodFrames;
+  const uint32_t updates =
+    (uint64_t(F_CPU) * milliseconds / 1000 + updateCycles / 2) / updateCycles;
+  return updates ? updates : 1;
+}
+
+
+/**
+ * Linear ADSR (attack, decay, sustain, release) envelope, updated at control
+ * rate.
+ *
+ * Template parameters:
+ * - FRAME_PERIOD_IN_CYCLES, same as SquareWaveGenerator;
+ * - UPDATE_PERIOD_FRAMES, the number of frames between two update()
+ *   invocations (see controlRateWorkItem()).
+ *
+ * The constructor takes the attack, decay and release times (in milliseconds,
+ * each one covering the whole range, so shorter segments take proportionally
+ * less time) and the sustain level (between 0 and 255). noteOn() starts the
+ * attack, and noteOff() the release, both from the current level, so
+ * retriggering a note which is still sounding doesn't click. update() returns
+ * the new level, between 0 and 255, which is meant to be fed into a
+ * generator's amplitude.
+ *
+ * Some technical considerations.
+ *
+ * Each stage is a segment with a step (added to the level on every update)
+ * and a target; once the target is reached (or passed), the level is clamped
+ * to it and the next stage starts. Sustain and idle are segments with no
+ * step, whose next stage is themselves. The level uses 14 bits, so that
+ * adding or subtracting a step never overflows an int16_t, and whether the
+ * target has been passed is the sign of the distance from it, flipped for
+ * descending segments; the sign of the step is used as a mask, so there's no
+ * branch for that. The only branch, which handles the end of a segment, is
+ * balanced with a forced delay like the branches inside
+ * SquareWaveGenerator::getNextSample().
+ *
+ * UPDATE_DURATION adds up these steps; the envelope lives in SRAM, so every
+ * member is loaded (lds or ldd) and stored (sts) again:
+ * - stage load and current segment's address, i.e. stage * 5 added to the
+ *   segments' address (10 cycles);
+ * - step and target (4 ldd, 8 cycles);
+ * - level (2 lds, 4 cycles);
+ * - new level and distance from the target, including the mask (8 cycles);
+ * - sign test, including the branch (2 cycles);
+ * - end of segment (next stage's load and store, and level clamping) or
+ *   forced delay (6 cycles);
+ * - storing the level (2 sts, 4 cycles) and returning its high bits (5
+ *   cycles).
+ */
+template<
+  uint16_t FRAME_PERIOD_IN_CYCLES,
+  uint8_t UPDATE_PERIOD_FRAMES,
+  enable_if_t<FRAME_PERIOD_IN_CYCLES && UPDATE_PERIOD_FRAMES, int> = 0
+>
+class ADSREnvelope {
+private:
+  /**
+   * The level corresponding to an output of 255
+   */
+  static constexpr int16_t MAX_LEVEL = 0x3fff;
+  static constexpr uint8_t LEVEL_SHIFT = 6;
+
+  enum Stage : uint8_t {
+    ATTACK,
+    DECAY,
+    SUSTAIN,
+    RELEASE,
+    IDLE,
+    STAGES_COUNT
+  };
+
+  struct Segment {
+    int16_t step;
+    int16_t target;
+    uint8_t next;
+  };
+
+  Segment segments[STAGES_COUNT];
+  uint8_t stage;
+  int16_t level;
+
+  static constexpr int16_t GET_STEP(const uint16_t milliseconds) {
+    return
+      (
+        MAX_LEVEL
+        + GET_CONTROL_RATE_UPDATES(
+          FRAME_PERIOD_IN_CYCLES,
+          UPDATE_PERIOD_FRAMES,
+          milliseconds
+        )
+        - 1
+      )
+      / GET_CONTROL_RATE_UPDATES(
+        FRAME_PERIOD_IN_CYCLES,
+        UPDATE_PERIOD_FRAMES,
+        milliseconds
+      );
+  }
+
+public:
+  /**
+   * The number of CPU cycles required to run update()
+   */
+  static constexpr uint8_t UPDATE_DURATION = 47;
+
+  constexpr ADSREnvelope(
+    uint16_t attackMilliseconds,
+    uint16_t decayMilliseconds,
+    uint8_t sustainLevel,
+    uint16_t releaseMilliseconds
+  ) :
+    segments{
+      {GET_STEP(attackMilliseconds), MAX_LEVEL, DECAY},
+      {
+        int16_t(-GET_STEP(decayMilliseconds)),
+        int16_t(sustainLevel << LEVEL_SHIFT),
+        SUSTAIN
+      },
+      {0, int16_t(sustainLevel << LEVEL_SHIFT), SUSTAIN},
+      {int16_t(-GET_STEP(releaseMilliseconds)), 0, IDLE},
+      {0, 0, IDLE}
+    },
+    stage(IDLE),
+    level(0)
+  {}
+
+  void noteOn() {
+    stage = ATTACK;
+  }
+
+  void noteOff() {
+    stage = RELEASE;
+  }
+
+  bool isIdle() const {
+    return stage == IDLE;
+  }
+
+  uint8_t getLevel() const {
+    return level >> LEVEL_SHIFT;
+  }
+
+  uint8_t update() {
+    const Segment& segment = segments[stage];
+    const int16_t next = level + segment.step;
+    // Non-negative once the target has been reached, in either direction
+    const int16_t passed = (next - segment.target) ^ (segment.step >> 15);
+    if (passed >= 0) {
+      level = segment.target;
+      stage = segment.next;
+    } else {
+      delayInCyclesWithNOP<2>();
+      level = next;
+    }
+    return level >> LEVEL_SHIFT;
+  }
+};
+
+
+/**
+ * Low-frequency oscillator, updated at control rate, which reads a
+ * single-cycle waveform from flash (see wavetables.hpp).
+ *
+ * Template parameters: same as ADSREnvelope.
+ *
+ * The phase is a 16-bit DDS accumulator, like WavetableGenerator's one but
+ * smaller: at control rate, 16 bits still give a resolution of about 0.05 Hz
+ * with a 3125 Hz update rate (50 kHz, updated every 16 frames). update()
+ * returns the table sample (between -127 and 127) without any scaling, and
+ * has no branches.
+ */
+template<
+  uint16_t FRAME_PERIOD_IN_CYCLES,
+  uint8_t UPDATE_PERIOD_FRAMES,
+  enable_if_t<FRAME_PERIOD_IN_CYCLES && UPDATE_PERIOD_FRAMES, int> = 0
+>
+class LFO {
+private:
+  const int8_t* table;
+  uint16_t phase;
+  uint16_t phaseIncrement;
+  int8_t value;
+
+public:
+  /**
+   * The number of CPU cycles required to run update(), with every member
+   * loaded from SRAM and stored back:
+   * - phase and phaseIncrement loads (4 lds, 8 cycles);
+   * - phase increment (2 cycles) and store (2 sts, 4 cycles);
+   * - table load (2 lds, 4 cycles);
+   * - table address computation and read (add, adc and lpm, 5 cycles);
+   * - value store (sts, 2 cycles).
+   */
+  static constexpr uint8_t UPDATE_DURATION = 25;
+
+  /**
+   * Computes phaseIncrement for the given frequency (in hundredths of Hz)
+   */
+  static constexpr uint16_t GET_PHASE_INCREMENT(
+    const uint32_t centihertz
+  ) {
+    return
+      (
+        (uint64_t(FRAME_PERIOD_IN_CYCLES) * UPDATE_PERIOD_FRAMES * centihertz
+          << 16)
+        + uint32_t(F_CPU) * 50
+      )
+      / (uint64_t(F_CPU) * 100);
+  }
+
+  /**
+   * table must point to a table stored in flash (PROGMEM)
+   */
+  constexpr LFO(const int8_t* table, uint32_t centihertz) :
+    table(table),
+    phase(0),
+    phaseIncrement(GET_PHASE_INCREMENT(centihertz)),
+    value(0)
+  {}
+
+  /**
+   * Changes the frequency (see GET_PHASE_INCREMENT(), which is best computed
+   * in advance) without resetting the phase
+   */
+  void setPhaseIncrement(uint16_t increment) {
+    phaseIncrement = increment;
+  }
+
+  int8_t getValue() const {
+    return value;
+  }
+
+  int8_t update() {
+    phase += phaseIncrement;
+    value = pgm_read_byte(table + (phase >> 8));
+    return value;
+  }
+};
+
+
+/**
+ * The number of CPU cycles required to skip a chunk in
+ * runControlRateChunk() (cpi, then a taken brne)
+ */
+constexpr uint8_t CONTROL_RATE_CHUNK_SKIP_DURATION = 3;
+/**
+ * The number of CPU cycles required to select a chunk in
+ * runControlRateChunk() (cpi, then a brne which isn't taken) and leave it
+ * afterwards (rjmp)
+ */
+constexpr uint8_t CONTROL_RATE_CHUNK_RUN_OVERHEAD = 4;
+
+
+/**
+ * The number of CPU cycles required to update the frame counter in
+ * controlRateWorkItem() (lds, subi, andi and sts)
+ */
+constexpr uint8_t CONTROL_RATE_COUNTER_DURATION = 6;
+
+
+/**
+ * Returns the number of CPU cycles taken by each frame's chunk in
+ * controlRateWorkItem(), excluding the counter's update: the longest chunk,
+ * including the skips before it, or the time needed to skip all of them
+ */
+template<typename... Tasks>
+constexpr uint16_t GET_CONTROL_RATE_CHUNK_DURATION() {
+  constexpr uint16_t DURATIONS[] = {Tasks::DURATION..., 0};
+  uint16_t duration = sizeof...(Tasks) * CONTROL_RATE_CHUNK_SKIP_DURATION;
+  for (uint8_t i = 0; i < sizeof...(Tasks); i++) {
+    const uint16_t chunkDuration =
+      i * CONTROL_RATE_CHUNK_SKIP_DURATION
+      + CONTROL_RATE_CHUNK_RUN_OVERHEAD
+      + DURATIONS[i];
+    if (chunkDuration > duration) {
+      duration = chunkDuration;
+    }
+  }
+  return duration;
+}
+
+
+template<uint16_t CHUNK_DURATION, uint8_t INDEX>
+inline void runControlRateChunk(const uint8_t) {
+  // No task for this frame
+  delayInCyclesWithAsmLoop<
+    CHUNK_DURATION - INDEX * CONTROL_RATE_CHUNK_SKIP_DURATION
+  >();
+}
+
+
+template<
+  uint16_t CHUNK_DURATION,
+  uint8_t INDEX,
+  typename First,
+  typename... Rest
+>
+inline void runControlRateChunk(
+  const uint8_t chunk,
+  First& first,
+  Rest&... rest
+) {
+  if (chunk == INDEX) {
+    first.run();
+    delayInCyclesWithAsmLoop<
+      CHUNK_DURATION
+      - INDEX * CONTROL_RATE_CHUNK_SKIP_DURATION
+      - CONTROL_RATE_CHUNK_RUN_OVERHEAD
+      - First::DURATION
+    >();
+  } else {
+    runControlRateChunk<CHUNK_DURATION, INDEX + 1>(chunk, rest...);
+  }
+}
+
+
+/**
+ * Returns a work item (see FrameScheduler) which runs the given tasks (work
+ * items themselves, e.g. workItem<envelope.UPDATE_DURATION>(...)) at control
+ * rate: every UPDATE_PERIOD_FRAMES frames, each task runs exactly once, in
+ * the given order, one per frame; in the remaining frames (if any), nothing
+ * runs. UPDATE_PERIOD_FRAMES must be a power of 2, and at least the number
+ * of tasks.
+ *
+ * Every frame costs the same number of cycles (the work item's DURATION): the
+ * longest task, plus the cost of selecting it, plus a few cycles for the
+ * frame counter; shorter tasks are padded with exact delays. Tasks usually
+ * update an envelope or LFO, and pass its new value to a generator (e.g. with
+ * setAmplitude()); splitting a long computation into several tasks keeps
+ * every frame's cost down.
+ *
+ * Some technical considerations.
+ *
+ * The task is selected by comparing the frame counter with each task's
+ * index, in order, so the later tasks take a few more cycles to reach; the
+ * padding of each task accounts for that (see
+ * CONTROL_RATE_CHUNK_SKIP_DURATION and CONTROL_RATE_CHUNK_RUN_OVERHEAD),
+ * assuming the compiler lays the comparisons out as a chain. The frame
+ * counter wraps around with a mask, hence the power of 2 (see
+ * CONTROL_RATE_COUNTER_DURATION).
+ */
+template<uint8_t UPDATE_PERIOD_FRAMES, typename... Tasks>
+inline auto controlRateWorkItem(Tasks... tasks) {
+  static_assert(
+    UPDATE_PERIOD_FRAMES
+      && !(UPDATE_PERIOD_FRAMES & (UPDATE_PERIOD_FRAMES - 1)),
+    "UPDATE_PERIOD_FRAMES must be a power of 2!"
+  );
+  static_assert(
+    sizeof...(Tasks) && sizeof...(Tasks) <= UPDATE_PERIOD_FRAMES,
+    "There must be at least one task, and at most one per frame!"
+  );
+  constexpr uint16_t CHUNK_DURATION =
+    GET_CONTROL_RATE_CHUNK_DURATION<Tasks...>();
+  return workItem<CHUNK_DURATION + CONTROL_RATE_COUNTER_DURATION>(
+    [chunk = uint8_t(0), tasks...]() mutable {
+      runControlRateChunk<CHUNK_DURATION, 0>(chunk, tasks...);
+      chunk = (chunk + 1) & (UPDATE_PERIOD_FRAMES - 1);
+    }
+  );
+}
@@ -2,8 +2,9 @@
 
 /*
  * When writing programs which require perfectly timed operations, we usually
- * need to generate clock-accurate delays. This header provides a template
- * function which does just that, delayInCycles().
+ * need to generate clock-accurate delays. This header provides a few
+ * template functions which do just that, trading flash space, registers and
+ * predictability in different ways.
  */
 
 #include <util/delay_basic.h>
@@ -136,7 +137,8 @@ inline void delayInCyclesWithNOP() {
  * - for n strictly positive, running _delay_loop_2(n) takes exactly 4 * n
  *   cycles.
  * So far, when enabling optimization for space (-Os) and speed (-O3), all these
- * requirements have been met.
+ * requirements have been met; extras/delay_verifier checks them on the
+ * simulator, for every T up to 2000.
  * 
  * Usually there's no need to generate the same exact delay in multiple pieces
  * of code, which means there will hardly be a generated function "shared"
@@ -187,3 +189,154 @@ inline void delayInCyclesWithLoop() {
     delayInCyclesWithNOP<T % 4>();
   }
 }
+
+
+/**
+ * Template function which does nothing for exactly T CPU cycles, like
+ * delayInCyclesWithNOP(), while taking about half the flash space.
+ *
+ * Only template parameter: T, the number of cycles needed for the generated
+ * function to complete.
+ *
+ * Generated functions have no arguments.
+ *
+ * Some technical considerations.
+ *
+ * "rjmp .+0" jumps to the following instruction: it takes 2 cycles and a
+ * single word, and it doesn't touch any register or flag. The delay is made of
+ * T / 2 of these jumps, plus a nop when T is odd, all inside a single volatile
+ * assembly statement, so no delay takes more than T / 2 + 1 words. As with nop
+ * instructions, no registers are needed, so this is a drop-in replacement for
+ * delayInCyclesWithNOP() wherever flash space matters.
+ */
+template<uint16_t T>
+inline void delayInCyclesWithRJMP() {
+#ifdef __AVR__
+  if (T / 2) {
+    asm volatile(
+      ".rept %[jumps]\n\t"
+      "rjmp .+0\n\t"
+      ".endr"
+      :
+      : [jumps] "n" (T / 2)
+    );
+  }
+#endif
+  delayInCyclesWithNOP<T % 2>();
+}
+
+
+/**
+ * Template function which does nothing for exactly T CPU cycles, taking about
+ * a third of the flash space of delayInCyclesWithNOP().
+ *
+ * Only template parameter: T, the number of cycles needed for the generated
+ * function to complete.
+ *
+ * Generated functions have no arguments.
+ *
+ * Some technical considerations.
+ *
+ * The delay is made of T / 3 lpm instructions (in their implied form, which
+ * loads the program memory byte pointed by Z into r0), followed by
+ * delayInCyclesWithRJMP<T % 3>(). Each lpm takes 3 cycles and a single word.
+ * Its only side effect is overwriting r0, which avr-gcc reserves as a scratch
+ * register (__tmp_reg__) that any assembly statement can freely clobber, so
+ * the compiler never needs to save anything around it; Z is only read, and its
+ * value doesn't affect the duration. Interrupt handlers save r0 as well, so
+ * this delay can be interrupted like any other.
+ */
+template<uint16_t T>
+inline void delayInCyclesWithLPM() {
+#ifdef __AVR__
+  if (T / 3) {
+    asm volatile(
+      ".rept %[loads]\n\t"
+      "lpm\n\t"
+      ".endr"
+      :
+      : [loads] "n" (T / 3)
+      : "r0"
+    );
+  }
+#endif
+  delayInCyclesWithRJMP<T % 3>();
+}
+
+
+/**
+ * Template function which does nothing for exactly T CPU cycles, using a loop
+ * which is entirely written in assembly.
+ *
+ * Only template parameter: T, the number of cycles needed for the generated
+ * function to complete.
+ *
+ * Generated functions have no arguments.
+ *
+ * Like delayInCyclesWithLoop(), generated functions take a few words of flash
+ * no matter how long the delay is (at most 5). The difference is that the
+ * loop's counter is loaded by the assembly statement itself, right before the
+ * loop, rather than by the compiler: the placement and the duration of the load
+ * are always the same, so none of the "usually"s explained for
+ * delayInCyclesWithLoop() apply.
+ *
+ * Some technical considerations.
+ *
+ * For T < 9, the delay is generated by delayInCyclesWithLPM<T>(), which never
+ * takes more than 3 words in this range, and needs no counter.
+ *
+ * Up to T = 3 * 256 + 2, the loop runs ldi, dec and brne, spending:
+ * - 1 cycle for loading the counter n (ldi);
+ * - 3 * (n - 1) cycles on the first n - 1 loop runs (dec and a taken brne);
+ * - 2 cycles on the last loop run (dec and a brne which is not taken).
+ * The total number of cycles is 3 * n, with n between 3 and 256 (256 is loaded
+ * as 0, which underflows on the first dec, like in _delay_loop_1()).
+ *
+ * Beyond that, the loop runs ldi, ldi, sbiw and brne, spending:
+ * - 2 cycles for loading the counter n (two ldi);
+ * - 4 * (n - 1) cycles on the first n - 1 loop runs (sbiw and a taken brne);
+ * - 3 cycles on the last loop run (sbiw and a brne which is not taken).
+ * The total number of cycles is 4 * n + 1.
+ *
+ * In both cases, the remaining cycles (at most 3) are generated by
+ * delayInCyclesWithLPM(), which takes a single word for them.
+ *
+ * The counter needs an upper register (r16-r31, for ldi), or an upper register
+ * pair which also supports sbiw (r24-r31) for the longer delays. The compiler
+ * picks a free one; if none is available, it has to save one around the
+ * delay, which costs extra cycles (the disassembly, or extras/delay_verifier,
+ * shows whether this happens).
+ */
+template<uint16_t T>
+inline void delayInCyclesWithAsmLoop() {
+  if constexpr (T < 9) {
+    delayInCyclesWithLPM<T>();
+  } else if constexpr (T < 3 * 256 + 3) {
+#ifdef __AVR__
+    uint8_t counter;
+    asm volatile(
+      "ldi %[counter], %[iterations]\n"
+      "1:\n\t"
+      "dec %[counter]\n\t"
+      "brne 1b"
+      : [counter] "=d" (counter)
+      : [iterations] "M" (T / 3 % 256)
+    );
+#endif
+    delayInCyclesWithLPM<T % 3>();
+  } else {
+#ifdef __AVR__
+    uint16_t counter;
+    asm volatile(
+      "ldi %A[counter], lo8(%[iterations])\n\t"
+      "ldi %B[counter], hi8(%[iterations])\n"
+      "1:\n\t"
+      "sbiw %[counter], 1\n\t"
+      "brne 1b"
+      : [counter] "=w" (counter)
+      : [iterations] "n" ((T - 1) / 4)
+    );
+#endif
+    delayInCyclesWithLPM<(T - 1) % 4>();
+  }
+}
@@ -0,0 +1,288 @@
+#pragma once
+
+/*
+ * A 16-bit delay line doesn't get far with 2 KB of SRAM (1024 samples, about
+ * 20 ms at 50 kHz). This header provides an echo/chorus stage which stores its
+ * history as 8-bit companded samples (and, optionally, at a fraction of the
+ * sample rate), so each byte of SRAM holds more delay time.
+ *
+ * EFFECT_DURATION was counted from the instructions the effect needs, not
+ * measured on a listing yet.
+ */
+
+#include <avr/pgmspace.h>
+#include <stdint.h>
+#include "delay_in_cycles.hpp"
+
+
+/**
+ * The 8-bit format used by DelayLineEffect, which works like A-law or μ-law:
+ * the sign (bit 7), a 3-bit segment (bits 6-4) and a 4-bit mantissa (bits 3-0).
+ * Segment 0 covers magnitudes 0-255 in steps of 16, and segment 1 covers
+ * 256-511 with the same step; from there on, each segment covers twice the
+ * range of the previous one, with twice the step (segment 2 covers 512-1023
+ * in steps of 32, and segment 7 covers 16384-32767 in steps of 1024). The
+ * quantization error thus stays proportional to the signal's level (about 30
+ * dB below it), rather than fixed like with a plain 8-bit sample.
+ *
+ * Negative samples are stored as the one's complement of their magnitude
+ * (i.e. -1 is stored like 0, and -32768 like 32767), so encoding never
+ * overflows and decoding is a single eor.
+ *
+ * Both directions use tables (generated at compile time, and stored in
+ * flash), so their duration doesn't depend on the sample:
+ * - magnitudes up to 2047 are encoded by lowEncode, indexed by the magnitude
+ *   divided by 8 (the smallest step in that range is 16);
+ * - larger ones by highEncode, indexed by the magnitude divided by 128 (the
+ *   smallest step in that range is 128);
+ * - codes are decoded by decode, which holds the middle of each step (but
+ *   the bottom of segment 0's ones).
+ */
+struct CompandingTables {
+  uint8_t lowEncode[256];
+  uint8_t highEncode[256];
+  int16_t decode[128];
+};
+
+
+constexpr uint8_t GET_COMPANDED_CODE(const uint16_t magnitude) {
+  uint8_t segment = 0;
+  while (segment < 7 && magnitude >= uint16_t(256) << segment) {
+    segment++;
+  }
+  const uint8_t shift = segment ? segment + 3 : 4;
+  return segment << 4 | ((magnitude >> shift) & 0x0f);
+}
+
+
+constexpr CompandingTables GET_COMPANDING_TABLES() {
+  CompandingTables tables{};
+  for (uint16_t i = 0; i < 256; i++) {
+    tables.lowEncode[i] = GET_COMPANDED_CODE(i << 3);
+    tables.highEncode[i] = GET_COMPANDED_CODE(i << 7);
+  }
+  for (uint8_t code = 0; code < 128; code++) {
+    const uint8_t segment = code >> 4;
+    const uint8_t shift = segment ? segment + 3 : 4;
+    // Segment 0 isn't rounded up, so that silence decodes to 0 (or -1)
+    const uint16_t base = segment ? uint16_t(128) << segment : 0;
+    const uint16_t rounding = segment ? uint16_t(1) << (shift - 1) : 0;
+    tables.decode[code] = base + ((code & 0x0f) << shift) + rounding;
+  }
+  return tables;
+}
+
+
+const CompandingTables COMPANDING_TABLES PROGMEM = GET_COMPANDING_TABLES();
+
+
+/**
+ * Echo/chorus stage: the source's samples go through a delay line, and the
+ * delayed signal is mixed back into the output and (for echoes) into the
+ * delay line itself.
+ *
+ * Template parameters:
+ * - Source, the wrapped generator (see below);
+ * - SIZE, the number of bytes of the delay line, a power of 2 up to 1024;
+ * - DECIMATION, 1 (the default), 2 or 4: the delay line only stores one
+ *   sample every DECIMATION frames (the average of those frames), which
+ *   multiplies the delay time by DECIMATION, at the price of the bandwidth of
+ *   the delayed signal (which is also held, rather than interpolated, between
+ *   two stored samples; it's meant for echoes rather than choruses).
+ *
+ * With a frame period of 320 cycles (50 kHz), 1024 bytes hold about 20 ms of
+ * delay, or 82 ms with DECIMATION = 4.
+ *
+ * The delay (setDelay()) is given in stored samples, between 1 and SIZE - 1,
+ * so it's multiplied by DECIMATION frames. Sweeping it slowly (e.g. from an
+ * LFO, see control_rate.hpp) gives a chorus or flanger effect; since it moves
+ * by whole samples, short delays (flanging) are smoother without decimation.
+ *
+ * Levels are fractions of 256:
+ * - the delay line is fed with x / 2 + delayed * feedback / 256, where
+ *   feedback is 0 for a single echo or a chorus, and up to MAX_FEEDBACK (each
+ *   repetition 6 dB quieter than the previous one) for repeated echoes;
+ * - the output is x / 2 + delayed * mix / 256, i.e. the dry signal is halved
+ *   to leave room for the wet one.
+ * setLevels() lowers them if needed, so that feedback doesn't exceed
+ * MAX_FEEDBACK and mix + feedback doesn't exceed MAX_LEVELS; within those
+ * limits, neither sum can overflow, even with the quantization error of the
+ * stored samples.
+ *
+ * Source must provide getNextSample() and GET_NEXT_SAMPLE_DURATION, like the
+ * filters' one (see filters.hpp), and the effect can be used wherever the
+ * source could:
+ *   DelayLineEffect<decltype(square), 1024, 4> echo(square, 1000, 96, 128);
+ *   workItem<echo.GET_NEXT_SAMPLE_DURATION>([&] {
+ *     sample = echo.getNextSample();
+ *   })
+ * Since the buffer takes SIZE bytes of SRAM, the effect is best declared as a
+ * global (so its size shows up in the compiler's memory report).
+ *
+ * Some technical considerations.
+ *
+ * The buffer is indexed with a 16-bit index masked with SIZE - 1, so the read
+ * and write positions wrap around without branches. The samples are encoded
+ * and decoded with the tables described in CompandingTables; the choice
+ * between the encoding tables is a branch, balanced with a forced delay like
+ * the ones in SquareWaveGenerator::getNextSample(). With decimation, the
+ * encoding (and the write) only happens once every DECIMATION frames, and
+ * the other frames spend the same time in a forced delay. The multiplications
+ * are split between the bytes of the delayed sample, like
+ * WavetableGenerator's multiplyAndShift().
+ *
+ * EFFECT_DURATION adds up these steps:
+ * - read position and buffer read (8 cycles);
+ * - decoding (14 cycles);
+ * - output and feedback (two multiplications, halving x and the sums, 24
+ *   cycles);
+ * - encoding, including the balanced branch (19 cycles);
+ * - buffer write and write position update (6 cycles);
+ * - with decimation, accumulating the average, updating the frame counter
+ *   and the balanced branch around the encoding and the write (10 cycles),
+ *   plus clearing the accumulator after the write (2 cycles, balanced in the
+ *   other branch too).
+ */
+template<typename Source, uint16_t SIZE, uint8_t DECIMATION = 1>
+class DelayLineEffect {
+private:
+  static_assert(
+    SIZE >= 2 && SIZE <= 1024 && !(SIZE & (SIZE - 1)),
+    "SIZE must be a power of 2, between 2 and 1024!"
+  );
+  static_assert(
+    DECIMATION == 1 || DECIMATION == 2 || DECIMATION == 4,
+    "DECIMATION must be 1, 2 or 4!"
+  );
+
+  static constexpr uint16_t MASK = SIZE - 1;
+  static constexpr uint8_t DECIMATION_SHIFT = DECIMATION / 2;
+  /**
+   * The number of CPU cycles required to encode a sample, write it and clear
+   * the accumulator, i.e. the forced delay used on the frames which don't
+   * store anything (minus the additional cycle taken by the branch which
+   * skips them)
+   */
+  static constexpr uint8_t ENCODE_AND_WRITE_DURATION = 26;
+  /**
+   * The magnitudes above this value are encoded by highEncode (see
+   * CompandingTables)
+   */
+  static constexpr uint16_t LOW_ENCODE_LIMIT = 2047;
+
+  Source& source;
+  uint8_t buffer[SIZE];
+  uint16_t writeIndex;
+  uint16_t delay;
+  int16_t accumulator;
+  uint8_t frame;
+  uint8_t mix;
+  uint8_t feedback;
+
+  /**
+   * Computes value * factor / 256 (rounded towards negative infinity) with
+   * two 8-bit multiplications
+   */
+  static int16_t multiplyAndShift(const int16_t value, const uint8_t factor) {
+    const int16_t high = int8_t(value >> 8) * factor;
+    const uint8_t low = (uint8_t(value) * factor) >> 8;
+    return high + low;
+  }
+
+  static int16_t decode(const uint8_t code) {
+    const int16_t magnitude =
+      pgm_read_word(&COMPANDING_TABLES.decode[code & 0x7f]);
+    // 0 for positive samples, -1 for negative ones
+    const int16_t sign = int8_t(code) >> 7;
+    return magnitude ^ sign;
+  }
+
+  static uint8_t encode(const int16_t sample) {
+    const int16_t sign = sample >> 15;
+    const uint16_t magnitude = sample ^ sign;
+    uint8_t code;
+    if (magnitude > LOW_ENCODE_LIMIT) {
+      code = pgm_read_byte(&COMPANDING_TABLES.highEncode[magnitude >> 7]);
+    } else {
+      delayInCyclesWithNOP<3>();
+      code = pgm_read_byte(&COMPANDING_TABLES.lowEncode[magnitude >> 3]);
+    }
+    return code | (uint8_t(sign) & 0x80);
+  }
+
+public:
+  /**
+   * The number of CPU cycles required by the effect itself
+   */
+  static constexpr uint8_t EFFECT_DURATION = 71 + (DECIMATION > 1 ? 12 : 0);
+  /**
+   * The number of CPU cycles required to run getNextSample()
+   */
+  static constexpr uint16_t GET_NEXT_SAMPLE_DURATION =
+    Source::GET_NEXT_SAMPLE_DURATION + EFFECT_DURATION;
+  /**
+   * The highest levels allowed by setLevels() (see above)
+   */
+  static constexpr uint8_t MAX_FEEDBACK = 127;
+  static constexpr uint8_t MAX_LEVELS = 240;
+  /**
+   * The longest delay, in frames
+   */
+  static constexpr uint32_t MAX_DELAY_FRAMES = uint32_t(SIZE - 1) * DECIMATION;
+
+  DelayLineEffect(
+    Source& source,
+    uint16_t delay,
+    uint8_t feedback,
+    uint8_t mix
+  ) :
+    source(source),
+    buffer{},
+    writeIndex(0),
+    delay(delay),
+    accumulator(0),
+    frame(0)
+  {
+    setLevels(feedback, mix);
+  }
+
+  /**
+   * Changes the delay (in stored samples, between 1 and SIZE - 1)
+   */
+  void setDelay(uint16_t value) {
+    delay = value;
+  }
+
+  /**
+   * Changes the levels (see above), lowering them if needed
+   */
+  void setLevels(uint8_t feedbackLevel, uint8_t mixLevel) {
+    feedback = feedbackLevel > MAX_FEEDBACK ? MAX_FEEDBACK : feedbackLevel;
+    mix = mixLevel > MAX_LEVELS - feedback ? MAX_LEVELS - feedback : mixLevel;
+  }
+
+  int16_t getFirstSample() {
+    return 0;
+  }
+
+  int16_t getNextSample() {
+    const int16_t x = source.getNextSample() >> 1;
+    const int16_t delayed = decode(buffer[(writeIndex - delay) & MASK]);
+    const int16_t input = x + multiplyAndShift(delayed, feedback);
+    if constexpr (DECIMATION == 1) {
+      buffer[writeIndex] = encode(input);
+      writeIndex = (writeIndex + 1) & MASK;
+    } else {
+      accumulator += input >> DECIMATION_SHIFT;
+      frame = (frame + 1) & (DECIMATION - 1);
+      if (frame == 0) {
+        buffer[writeIndex] = encode(accumulator);
+        writeIndex = (writeIndex + 1) & MASK;
+        accumulator = 0;
+      } else {
+        delayInCyclesWithNOP<ENCODE_AND_WRITE_DURATION>();
+      }
+    }
+    return x + multiplyAndShift(delayed, mix);
+  }
+};
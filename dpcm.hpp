@@ -0,0 +1,53 @@
+#pragma once
+
+/*
+ * 4-bit DPCM (differential pulse-code modulation) format used by
+ * DPCMSampleGenerator. This header has no dependencies on the AVR toolchain,
+ * so that the host encoder in extras/dpcm_encoder can share it.
+ *
+ * Each 16-bit sample is stored as a 4-bit index into DPCM_DELTAS: decoding a
+ * sample means adding the respective delta to the previous sample (the first
+ * one is added to 0). Two samples are packed in each byte, the first one in
+ * the most significant nibble. This takes a quarter of the flash needed by raw
+ * 16-bit samples; the price is a coarse resolution on fast-changing signals
+ * (the biggest delta is limited) and some granular noise on slow ones (the
+ * smallest non-zero delta is not 1).
+ *
+ * The decoder doesn't check for overflows: the encoder only picks deltas which
+ * keep the decoded signal within 16 bits.
+ */
+
+#include <stdint.h>
+
+
+/**
+ * The deltas indexed by each nibble; roughly exponential, so that both quiet
+ * details and loud transients can be followed
+ */
+constexpr int16_t DPCM_DELTAS[16] = {
+  -16384, -8192, -4096, -2048, -1024, -512, -192, -48,
+  0, 48, 192, 512, 1024, 2048, 4096, 8192
+};
+
+
+/**
+ * A sound encoded by the host encoder, and the information needed to play and
+ * loop it. The data itself lives in flash (PROGMEM), while this structure is
+ * usually a plain constant.
+ *
+ * Once the sample at index length - 1 has been played, playback continues
+ * from loopStart, after restoring the decoder's state (loopStartValue, i.e.
+ * the decoded value right before the sample at index loopStart). Sounds which
+ * shouldn't loop end with a short fade towards 0, followed by a single 0 delta,
+ * which is then looped forever (producing silence).
+ */
+struct DPCMSample {
+  const uint8_t* data;
+  uint16_t length;
+  uint16_t loopStart;
+  int16_t loopStartValue;
+  /**
+   * The sample rate the sound was encoded with (in Hz)
+   */
+  uint32_t sampleRate;
+};
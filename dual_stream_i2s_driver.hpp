@@ -0,0 +1,152 @@
+#pragma once
+
+#include <avr/io.h>
+#include "i2s_driver.hpp"
+#include "type_traits_clone.hpp"
+
+
+/**
+ * Alternative version of I2SDriver, which sends two synchronized I2S data
+ * lines (four channels per frame, e.g. for two stereo DACs) without raising
+ * the bit rate. The primary line is generated by the USART module, exactly
+ * like I2SDriver does; the secondary line is generated by the hardware SPI,
+ * configured as a slave and clocked by the USART's own bit clock, so both
+ * lines share the same bit clock and word select signals.
+ *
+ * This requires two external connections on the board:
+ * - D4 / PD4 (XCK, the bit clock) to D13 / PB5 (SCK), so the SPI is clocked
+ *   by the bit clock;
+ * - D10 / PB2 (SS) to ground, so the SPI is always selected.
+ * The secondary data line comes out of D12 / PB4 (MISO); the primary one still
+ * comes out of D1 / PD1 (TXD).
+ *
+ * Template parameters:
+ * - HALF_BIT_PERIOD, same as I2SDriver, but it must be at least 3 (see below);
+ * - BUSY_EXTERNAL_CYCLES_BEFORE_FIRST_BUFFER_WRITE, same as I2SDriver (the SPI
+ *   configuration is already taken into account);
+ * - WORD_SELECT_TIMER, same as I2SDriver.
+ *
+ * Samples are sent with sendSample(primary, secondary), which takes
+ * SEND_SAMPLE_DURATION cycles and must be invoked with the same timing as
+ * I2SDriver::sendSample(). Moreover, sendSecondaryLowByte() must be invoked
+ * exactly SECONDARY_LOW_BYTE_WRITE_OFFSET cycles after each sendSample()
+ * invocation starts. FrameScheduler takes care of both (see
+ * runDualStreamFrameLoop()).
+ *
+ * Some technical considerations.
+ *
+ * Unlike the USART module, the SPI has no transmit buffer: a byte can only be
+ * written into SPDR between two transfers, i.e. after the previous byte's LSB
+ * has been sampled and before the next byte's MSB is (otherwise the write is
+ * ignored and WCOL is set). With the bit clock shared with the USART module,
+ * this window is one bit long, and it's centered on the bit clock's falling
+ * edge which starts each byte. This is why the two bytes of a secondary
+ * sample are written in two steps, 8 bits apart:
+ * - sendSample() writes the high byte right after the primary sample's bytes
+ *   are written into the USART buffer, which happens right when the primary
+ *   sample's MSB starts (see I2SDriver);
+ * - sendSecondaryLowByte() writes the low byte half a sample period later,
+ *   at the same phase of the bit clock.
+ * The low byte is latched into GPIOR1 by sendSample(), so work items can
+ * update the secondary sample in the meantime without tearing it; the
+ * latch fits in the 1-cycle delay between the two writes to UDR0, which
+ * I2SDriver spends in a nop. GPIOR1 must not be used for anything else.
+ *
+ * In slave mode, the SPI samples SCK through a synchronizer, and the datasheet
+ * requires its high and low phases to last longer than 2 CPU cycles. This is
+ * the reason for the lower limit on HALF_BIT_PERIOD; the synchronizer also
+ * delays each bit on MISO by about 2 cycles after the bit clock's falling edge,
+ * which is harmless as long as the receiver samples on the rising edge.
+ *
+ * Both this delay and the SPI's behaviour with SS held low for good (no byte
+ * boundary is ever signalled by SS, so the SPI relies on counting SCK edges
+ * from the start) come from the datasheet, and have only been checked on the
+ * simulator in extras/simulator; they are still unverified on hardware.
+ *
+ * With CPOL and CPHA cleared, the SPI samples on the rising edge and sets up
+ * the next bit on the falling one, exactly like the USART module in MSPIM
+ * mode, and the MSB is sent first. As for the receiver, the secondary line is
+ * just another I2S data line.
+ */
+template<
+  uint8_t HALF_BIT_PERIOD,
+  uint8_t BUSY_EXTERNAL_CYCLES_BEFORE_FIRST_BUFFER_WRITE,
+  WordSelectTimer WORD_SELECT_TIMER = WordSelectTimer::TIMER_0,
+  enable_if_t<HALF_BIT_PERIOD >= 3, int> = 0
+>
+class DualStreamI2SDriver :
+  private I2SDriver<
+    HALF_BIT_PERIOD,
+    // See SPI_SETUP_DURATION
+    BUSY_EXTERNAL_CYCLES_BEFORE_FIRST_BUFFER_WRITE + 4,
+    WORD_SELECT_TIMER
+  >
+{
+private:
+  /**
+   * The number of CPU cycles required to configure the SPI after I2SDriver's
+   * constructor (sbi on DDRB, then ldi and out on SPCR)
+   */
+  static constexpr uint8_t SPI_SETUP_DURATION = 4;
+
+  using Base = I2SDriver<
+    HALF_BIT_PERIOD,
+    BUSY_EXTERNAL_CYCLES_BEFORE_FIRST_BUFFER_WRITE + SPI_SETUP_DURATION,
+    WORD_SELECT_TIMER
+  >;
+
+  /**
+   * The number of CPU cycles from the start of sendSample() to the write of
+   * the secondary sample's high byte into SPDR
+   */
+  static constexpr uint8_t SECONDARY_HIGH_BYTE_WRITE_DELAY = 5;
+  /**
+   * The number of CPU cycles from the start of sendSecondaryLowByte() to the
+   * write of the secondary sample's low byte into SPDR
+   */
+  static constexpr uint8_t SECONDARY_LOW_BYTE_WRITE_DELAY = 1;
+
+public:
+  using Base::Sample;
+  using Base::OTHER_EXTERNAL_DELAY_CYCLES_BEFORE_FIRST_BUFFER_WRITE;
+  using Base::FULL_BIT_PERIOD;
+  using Base::SAMPLE_PERIOD;
+  using Base::CHANNELS;
+  using Base::FRAME_PERIOD;
+
+  /**
+   * The number of CPU cycles required by sendSample()
+   */
+  static constexpr uint8_t SEND_SAMPLE_DURATION = 6;
+  /**
+   * The number of CPU cycles required by sendSecondaryLowByte()
+   */
+  static constexpr uint8_t SEND_SECONDARY_LOW_BYTE_DURATION = 2;
+  /**
+   * The number of CPU cycles between the start of sendSample() and the start
+   * of the following sendSecondaryLowByte() (8 bits later)
+   */
+  static constexpr uint16_t SECONDARY_LOW_BYTE_WRITE_OFFSET =
+    SAMPLE_PERIOD / 2
+    + SECONDARY_HIGH_BYTE_WRITE_DELAY
+    - SECONDARY_LOW_BYTE_WRITE_DELAY;
+
+  DualStreamI2SDriver() {
+    // D12 / PB4 (MISO) as output; it's up to the user in slave mode
+    bitSet(DDRB, DDB4);
+    // SPI enabled in slave mode, MSB first, CPOL = CPHA = 0, no interrupts
+    SPCR = bit(SPE);
+  }
+
+  void sendSample(const int16_t primary, const int16_t secondary) {
+    UDR0 = int8_t(primary >> 8);
+    // Replaces I2SDriver's 1-cycle delay between the two UDR0 writes
+    GPIOR1 = uint8_t(secondary & 0xff);
+    UDR0 = uint8_t(primary & 0xff);
+    SPDR = int8_t(secondary >> 8);
+  }
+
+  void sendSecondaryLowByte() {
+    SPDR = GPIOR1;
+  }
+};
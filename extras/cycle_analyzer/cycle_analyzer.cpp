@@ -0,0 +1,973 @@
+/*
+ * Static cycle analyzer for the sketch's main loop. It reads the output of
+ * avr-objdump -dSz (such as disassembler-output.txt), finds the for (;;) loop
+ * inside main(), enumerates every path through one iteration, and reports:
+ * - the cycles taken by each path, compared with I2SDriver::FRAME_PERIOD;
+ * - when each sample is sent (sts to UDR0), how long sendSample() takes and
+ *   how far apart two samples are, compared with SEND_SAMPLE_DURATION and
+ *   SAMPLE_PERIOD;
+ * - the busy and idle cycles between two samples (idle cycles are the ones
+ *   spent in delays, like in extras/simulator);
+ * - the work cycles, i.e. the frame's cycles outside sendSample() and outside
+ *   the scheduler's delays, which must match exactly the work items' durations
+ *   (e.g. SquareWaveGenerator::GET_NEXT_SAMPLE_DURATION) plus the loop's jump;
+ *   the delays balancing branches inside a work item are part of its
+ *   duration, so a scheduler's delay is told apart as a run of idle
+ *   instructions which contains a delay loop (delays shorter than 9 cycles
+ *   have no loop, see delayInCyclesWithAsmLoop(), and are counted as work);
+ * - every branch (or skip) whose arms take a different number of cycles to
+ *   reach the end of the frame.
+ * The expected values are read from the headers themselves, so they're always
+ * the ones the sketch was compiled against. See the README for build
+ * instructions.
+ *
+ * Only the default driver configuration is supported: word select generated
+ * by timer 0 (HALF_BIT_PERIOD between 1 and 8), stereo 16-bit samples, no
+ * second data line (DualStreamI2SDriver) and no timing checks. Listings which
+ * use anything else (found through the registers written or read by main())
+ * are rejected; extras/simulator handles all of them.
+ */
+
+#include <algorithm>
+#include <array>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <regex>
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <Arduino.h>
+#include "../../frame_scheduler.hpp"
+#include "../../i2s_driver.hpp"
+#include "../../wave_generators.hpp"
+#include "../simulator/firmware.hpp"
+
+
+namespace {
+
+constexpr size_t FLASH_WORDS = 16384;
+constexpr uint16_t UDR0_ADDRESS = 0xc6;
+constexpr uint16_t UCSR0A_ADDRESS = 0xc0;
+constexpr uint16_t TCCR1A_ADDRESS = 0x80, TCCR1B_ADDRESS = 0x81;
+constexpr uint16_t TCNT1L_ADDRESS = 0x84, OCR1AH_ADDRESS = 0x89;
+/**
+ * I/O addresses (as used by in and out)
+ */
+constexpr uint8_t TCNT0_IO_ADDRESS = 0x26;
+constexpr uint8_t GPIOR1_IO_ADDRESS = 0x2a, GPIOR2_IO_ADDRESS = 0x2b;
+constexpr uint8_t SPCR_IO_ADDRESS = 0x2c, SPDR_IO_ADDRESS = 0x2e;
+/**
+ * Paths are enumerated one by one, so their number grows exponentially with
+ * the number of branches; real frame loops stay far below this limit.
+ */
+constexpr size_t MAX_PATHS = 100000;
+
+
+/**
+ * The values the analysis is compared with, read from the headers
+ */
+struct Expectations {
+  uint16_t framePeriod;
+  uint16_t samplePeriod;
+  uint8_t sendSampleDuration;
+  uint8_t loopJumpDuration;
+  /**
+   * The total duration of the work items, or -1 if unknown
+   */
+  long workDuration;
+};
+
+
+template<uint8_t HALF_BIT_PERIOD>
+Expectations getExpectations(long workDuration) {
+  using Driver = I2SDriver<HALF_BIT_PERIOD, 0>;
+  using Scheduler = FrameScheduler<Driver>;
+  return {
+    Driver::FRAME_PERIOD,
+    Driver::SAMPLE_PERIOD,
+    Driver::SEND_SAMPLE_DURATION,
+    Scheduler::LOOP_JUMP_DURATION,
+    workDuration
+  };
+}
+
+
+Expectations getExpectations(uint8_t halfBitPeriod, long workDuration) {
+  switch (halfBitPeriod) {
+  case 1: return getExpectations<1>(workDuration);
+  case 2: return getExpectations<2>(workDuration);
+  case 3: return getExpectations<3>(workDuration);
+  case 4: return getExpectations<4>(workDuration);
+  case 5: return getExpectations<5>(workDuration);
+  case 6: return getExpectations<6>(workDuration);
+  case 7: return getExpectations<7>(workDuration);
+  case 8: return getExpectations<8>(workDuration);
+  default:
+    throw std::runtime_error(
+      "HALF_BIT_PERIOD must be between 1 and 8 (timer 0); use extras/simulator"
+      " for the other configurations"
+    );
+  }
+}
+
+
+/**
+ * Returns GET_NEXT_SAMPLE_DURATION of the generator with the given name (the
+ * same names used by extras/host/generator_benchmark, where they apply), or
+ * -1 if the name is unknown
+ */
+template<uint16_t FRAME>
+long getGeneratorDuration(const std::string& name) {
+  if (name == "square") {
+    return SquareWaveGenerator<FRAME>::GET_NEXT_SAMPLE_DURATION;
+  } else if (name == "square-24") {
+    return SquareWaveGenerator<FRAME, 24>::GET_NEXT_SAMPLE_DURATION;
+  } else if (name == "square-16") {
+    return SquareWaveGenerator<FRAME, 16>::GET_NEXT_SAMPLE_DURATION;
+  } else if (name == "wavetable") {
+    return WavetableGenerator<FRAME>::GET_NEXT_SAMPLE_DURATION;
+  } else if (name == "wavetable-interpolated") {
+    return WavetableGenerator<FRAME, true>::GET_NEXT_SAMPLE_DURATION;
+  } else if (name == "square-polyblep") {
+    return BandLimitedGenerator<FRAME>::GET_NEXT_SAMPLE_DURATION;
+  } else if (name == "sawtooth-polyblep") {
+    return BandLimitedGenerator<FRAME, BandLimitedWaveform::SAWTOOTH>
+      ::GET_NEXT_SAMPLE_DURATION;
+  } else if (name == "dpcm") {
+    return DPCMSampleGenerator<FRAME>::GET_NEXT_SAMPLE_DURATION;
+  }
+  return -1;
+}
+
+
+long getGeneratorDuration(uint8_t halfBitPeriod, const std::string& name) {
+  // Generators only depend on the frame period, i.e. 64 * HALF_BIT_PERIOD
+  switch (halfBitPeriod) {
+  case 1: return getGeneratorDuration<64>(name);
+  case 2: return getGeneratorDuration<128>(name);
+  case 3: return getGeneratorDuration<192>(name);
+  case 4: return getGeneratorDuration<256>(name);
+  case 5: return getGeneratorDuration<320>(name);
+  case 6: return getGeneratorDuration<384>(name);
+  case 7: return getGeneratorDuration<448>(name);
+  default: return getGeneratorDuration<512>(name);
+  }
+}
+
+
+/*
+ * Instruction decoding. Only what matters for timing and control flow is
+ * decoded: length, duration, jump targets, and which registers are written
+ * (for tracking the constants loaded into delay loop counters).
+ */
+
+bool isTwoWords(uint16_t opcode) {
+  return (opcode & 0xfc0f) == 0x9000   // lds, sts
+    || (opcode & 0xfe0c) == 0x940c;    // jmp, call
+}
+
+
+bool isDelayLoopCounterUpdate(uint16_t opcode) {
+  return (opcode & 0xfe0f) == 0x940a   // dec
+    || (opcode & 0xff00) == 0x9700;    // sbiw
+}
+
+
+constexpr uint16_t BRNE_BACK_2 = 0xf7f1;
+constexpr uint16_t NOP = 0x0000, RJMP_NEXT = 0xc000, LPM = 0x95c8;
+
+
+enum class Flow : uint8_t {
+  NEXT,
+  BRANCH,
+  SKIP,
+  JUMP,
+  RETURN,
+  CALL,
+  INDIRECT
+};
+
+
+struct Instruction {
+  uint16_t address;
+  uint16_t opcode;
+  uint16_t operand;
+  uint8_t words;
+  Flow flow;
+  /**
+   * Cycles taken when not branching/skipping (or for unconditional flow)
+   */
+  uint8_t cycles;
+  uint16_t target;
+};
+
+
+Instruction decode(const std::vector<uint16_t>& flash, uint16_t address) {
+  const uint16_t opcode = flash[address % FLASH_WORDS];
+  Instruction instruction{
+    address, opcode, flash[(address + 1) % FLASH_WORDS],
+    uint8_t(isTwoWords(opcode) ? 2 : 1), Flow::NEXT, 1, 0
+  };
+  const uint16_t next = address + instruction.words;
+  auto setFlow = [&](Flow flow, uint8_t cycles, uint16_t target = 0) {
+    instruction.flow = flow;
+    instruction.cycles = cycles;
+    instruction.target = target;
+  };
+  if ((opcode & 0xf000) == 0xc000) {
+    setFlow(Flow::JUMP, 2, next + (int16_t(opcode << 4) >> 4));
+  } else if ((opcode & 0xf000) == 0xd000) {
+    setFlow(Flow::CALL, 3, next + (int16_t(opcode << 4) >> 4));
+  } else if ((opcode & 0xf800) == 0xf000 || (opcode & 0xf800) == 0xf400) {
+    setFlow(Flow::BRANCH, 1, next + (int8_t(opcode >> 2 & 0xfe) >> 1));
+  } else if ((opcode & 0xfc00) == 0x1000 || (opcode & 0xfc08) == 0xfc00
+             || (opcode & 0xfd00) == 0x9900) {
+    setFlow(Flow::SKIP, 1);  // cpse, sbrc/sbrs, sbic/sbis
+  } else if ((opcode & 0xfe0e) == 0x940c) {
+    setFlow(Flow::JUMP, 3, (opcode & 0x01f0) << 13 | (opcode & 1) << 16
+      | instruction.operand);
+  } else if ((opcode & 0xfe0e) == 0x940e) {
+    setFlow(Flow::CALL, 4);
+  } else if (opcode == 0x9508 || opcode == 0x9518) {
+    setFlow(Flow::RETURN, 4);
+  } else if (opcode == 0x9409 || opcode == 0x9509
+             || opcode == 0x9419 || opcode == 0x9519) {
+    setFlow(Flow::INDIRECT, 3);
+  } else if ((opcode & 0xfe00) == 0x9600 || (opcode & 0xff00) == 0x0200
+             || (opcode & 0xff00) == 0x0300 || (opcode & 0xfc00) == 0x9c00
+             || (opcode & 0xfd00) == 0x9800 || (opcode & 0xd000) == 0x8000
+             || ((opcode & 0xfc00) == 0x9000 && (opcode & 0x000e) != 0x0004)) {
+    // adiw/sbiw, mul*, cbi/sbi, ld/ldd/st/std, lds/sts, push/pop
+    instruction.cycles = 2;
+  } else if ((opcode & 0xfe0c) == 0x9004 || opcode == LPM) {
+    instruction.cycles = 3;  // lpm (and elpm)
+  }
+  return instruction;
+}
+
+
+/**
+ * The constant value of each register, or -1 when it's unknown
+ */
+using Registers = std::array<int16_t, 32>;
+
+
+void forgetPair(Registers& registers, uint8_t low) {
+  registers[low] = registers[low + 1] = -1;
+}
+
+
+/**
+ * Updates the known register values after running the instruction. Values are
+ * only tracked for the instructions used to load constants (ldi, mov, movw and
+ * clearing eor); every other instruction which writes a register makes it
+ * unknown.
+ */
+void applyWrites(const Instruction& instruction, Registers& registers) {
+  const uint16_t opcode = instruction.opcode;
+  const uint8_t d5 = opcode >> 4 & 0x1f;
+  const uint8_t r5 = (opcode & 0x0200) >> 5 | (opcode & 0x000f);
+  const uint8_t d4 = 16 + (opcode >> 4 & 0x0f);
+  if ((opcode & 0xf000) == 0xe000) {  // ldi
+    registers[d4] = (opcode & 0x0f00) >> 4 | (opcode & 0x000f);
+  } else if ((opcode & 0xfc00) == 0x2c00) {  // mov
+    registers[d5] = registers[r5];
+  } else if ((opcode & 0xff00) == 0x0100) {  // movw
+    const uint8_t d = (opcode >> 4 & 0x0f) * 2, r = (opcode & 0x0f) * 2;
+    registers[d] = registers[r];
+    registers[d + 1] = registers[r + 1];
+  } else if ((opcode & 0xfc00) == 0x2400 && d5 == r5) {  // eor (clr)
+    registers[d5] = 0;
+  } else if ((opcode & 0xec00) == 0x0800 || (opcode & 0xec00) == 0x0c00
+             || (opcode & 0xf000) == 0x2000) {
+    registers[d5] = -1;  // sbc, sub, add, adc, and, eor, or
+  } else if ((opcode & 0xc000) == 0x4000) {
+    registers[d4] = -1;  // sbci, subi, ori, andi
+  } else if ((opcode & 0xfe00) == 0x9400) {
+    switch (opcode & 0x000f) {
+    case 0x0: case 0x1: case 0x2: case 0x3:  // com, neg, swap, inc
+    case 0x5: case 0x6: case 0x7: case 0xa:  // asr, lsr, ror, dec
+      registers[d5] = -1;
+      break;
+    case 0x8: case 0x9: case 0xb: case 0xc: case 0xd: case 0xe: case 0xf:
+      break;  // sreg, ret, jumps, calls, des
+    default:
+      registers = Registers();
+      registers.fill(-1);
+    }
+  } else if ((opcode & 0xfe00) == 0x9600) {  // adiw, sbiw
+    forgetPair(registers, 24 + 2 * (opcode >> 4 & 3));
+  } else if ((opcode & 0xff00) == 0x0200 || (opcode & 0xff00) == 0x0300
+             || (opcode & 0xfc00) == 0x9c00 || opcode == LPM) {
+    registers[0] = -1;  // mul*, lpm
+    if (opcode != LPM) {
+      registers[1] = -1;
+    }
+  } else if ((opcode & 0xfc00) == 0x9000 || (opcode & 0xd000) == 0x8000) {
+    // Loads and stores: loads write Rd, post-increment/pre-decrement modes
+    // update the pointer
+    const bool load = !(opcode & 0x0200);
+    if (load) {
+      registers[d5] = -1;
+    }
+    if ((opcode & 0xfc00) == 0x9000) {
+      switch (opcode & 0x000f) {
+      case 0x1: case 0x2: case 0x5: case 0x7:
+        forgetPair(registers, 30);
+        break;
+      case 0x9: case 0xa:
+        forgetPair(registers, 28);
+        break;
+      case 0xd: case 0xe:
+        forgetPair(registers, 26);
+        break;
+      }
+    }
+  } else if ((opcode & 0xf800) == 0xb000 || (opcode & 0xfe08) == 0xf800) {
+    registers[d5] = -1;  // in, bld
+  }
+}
+
+
+struct Step {
+  uint16_t address;
+  uint32_t start;
+  uint32_t cycles;
+  bool idle;
+  /**
+   * Whether the step is a whole delay loop
+   */
+  bool loop;
+};
+
+
+struct Branch {
+  const char* name;
+  /**
+   * The cycles from the branch to the end of the frame, for each arm (0 when
+   * not taken/skipping, 1 when taken/skipping)
+   */
+  std::set<uint32_t> remaining[2];
+};
+
+
+struct Path {
+  std::vector<Step> steps;
+  uint32_t cycles;
+  std::vector<uint32_t> sampleWrites;
+};
+
+
+class LoopAnalyzer {
+public:
+  std::vector<Path> paths;
+  std::map<uint16_t, Branch> branches;
+  std::vector<std::string> errors;
+  Registers exitRegisters;
+
+  LoopAnalyzer(const std::vector<uint16_t>& flash, uint16_t header) :
+    flash(flash), header(header), onPath(FLASH_WORDS) {}
+
+  void run(const Registers& registers) {
+    paths.clear();
+    branches.clear();
+    errors.clear();
+    exitRegisters.fill(-2);
+    steps.clear();
+    armStack.clear();
+    visit(header, 0, registers);
+  }
+
+private:
+  struct Arm {
+    uint16_t address;
+    uint32_t start;
+    bool taken;
+  };
+
+  const std::vector<uint16_t>& flash;
+  const uint16_t header;
+  std::vector<bool> onPath;
+  std::vector<Step> steps;
+  std::vector<Arm> armStack;
+
+  void fail(const std::string& message, uint16_t address) {
+    char buffer[16];
+    std::snprintf(buffer, sizeof buffer, "0x%04x: ", address * 2);
+    if (errors.size() < 20) {
+      errors.push_back(buffer + message);
+    }
+  }
+
+  void finishPath(uint32_t cycles, const Registers& registers) {
+    Path path{steps, cycles, {}};
+    for (const Step& step : steps) {
+      const uint16_t opcode = flash[step.address];
+      if ((opcode & 0xfe0f) == 0x9200
+          && flash[step.address + 1] == UDR0_ADDRESS) {
+        path.sampleWrites.push_back(step.start);
+      }
+    }
+    paths.push_back(path);
+    if (paths.size() == MAX_PATHS) {
+      fail("too many paths, giving up", header);
+    }
+    for (const Arm& arm : armStack) {
+      branches[arm.address].remaining[arm.taken].insert(cycles - arm.start);
+    }
+    for (uint8_t r = 0; r < 32; r++) {
+      if (exitRegisters[r] == -2) {
+        exitRegisters[r] = registers[r];
+      } else if (exitRegisters[r] != registers[r]) {
+        exitRegisters[r] = -1;
+      }
+    }
+  }
+
+  /**
+   * Marks the instructions right before a delay loop which load its counter
+   * as idle (they're part of the delay, like in delay_in_cycles.hpp)
+   */
+  void markCounterLoadsAsIdle(uint16_t loopAddress, uint8_t low, bool pair) {
+    uint16_t expected = loopAddress;
+    for (size_t i = steps.size(); i-- > 0;) {
+      const uint16_t opcode = flash[steps[i].address];
+      const uint8_t d4 = 16 + (opcode >> 4 & 0x0f), d5 = opcode >> 4 & 0x1f;
+      const bool loadsCounter =
+        ((opcode & 0xf000) == 0xe000
+          && (d4 == low || (pair && d4 == low + 1)))
+        || ((opcode & 0xfc00) == 0x2c00
+          && (d5 == low || (pair && d5 == low + 1)))
+        || ((opcode & 0xff00) == 0x0100 && pair
+          && (opcode >> 4 & 0x0f) * 2 == low);
+      if (steps[i].address + 1 != expected || !loadsCounter) {
+        break;
+      }
+      steps[i].idle = true;
+      expected = steps[i].address;
+    }
+  }
+
+  void visit(uint16_t address, uint32_t cycle, Registers registers) {
+    if (paths.size() >= MAX_PATHS) {
+      return;
+    }
+    if (address == header && !steps.empty()) {
+      finishPath(cycle, registers);
+      return;
+    }
+    if (address >= FLASH_WORDS) {
+      fail("jump out of program memory", address);
+      return;
+    }
+    if (onPath[address]) {
+      fail("loop which doesn't go through the main loop's start", address);
+      return;
+    }
+    const Instruction instruction = decode(flash, address);
+    const size_t depth = steps.size();
+    onPath[address] = true;
+
+    const uint16_t opcode = instruction.opcode;
+    if (
+      isDelayLoopCounterUpdate(opcode)
+      && instruction.operand == BRNE_BACK_2
+    ) {
+      // Delay loop: dec/sbiw + brne back to the counter update
+      const bool pair = (opcode & 0xff00) == 0x9700;
+      const uint8_t low =
+        pair ? 24 + 2 * (opcode >> 4 & 3) : opcode >> 4 & 0x1f;
+      const int32_t counter = pair
+        ? (registers[low] < 0 || registers[low + 1] < 0
+          ? -1 : registers[low + 1] << 8 | registers[low])
+        : registers[low];
+      if (counter < 0) {
+        fail("can't determine the delay loop's counter", address);
+      } else {
+        const uint32_t iterations = counter ? counter : pair ? 65536 : 256;
+        const uint32_t cycles = (pair ? 4 : 3) * iterations - 1;
+        markCounterLoadsAsIdle(address, low, pair);
+        steps.push_back({address, cycle, cycles, true, true});
+        registers[low] = 0;
+        if (pair) {
+          registers[low + 1] = 0;
+        }
+        onPath[address + 1] = true;
+        visit(address + 2, cycle + cycles, registers);
+        onPath[address + 1] = false;
+      }
+    } else {
+      const bool idle = opcode == NOP || opcode == RJMP_NEXT || opcode == LPM;
+      const uint16_t next = address + instruction.words;
+      steps.push_back({address, cycle, instruction.cycles, idle, false});
+      applyWrites(instruction, registers);
+      switch (instruction.flow) {
+      case Flow::NEXT:
+        visit(next, cycle + instruction.cycles, registers);
+        break;
+      case Flow::JUMP:
+        visit(instruction.target, cycle + instruction.cycles, registers);
+        break;
+      case Flow::BRANCH:
+      case Flow::SKIP: {
+        const bool skip = instruction.flow == Flow::SKIP;
+        branches[address].name = skip ? "skip" : "branch";
+        const uint8_t skippedWords = decode(flash, next).words;
+        armStack.push_back({address, cycle, false});
+        visit(next, cycle + 1, registers);
+        armStack.back().taken = true;
+        steps.back().cycles = skip ? 1 + skippedWords : 2;
+        visit(
+          skip ? next + skippedWords : instruction.target,
+          cycle + steps.back().cycles,
+          registers
+        );
+        armStack.pop_back();
+        break;
+      }
+      case Flow::CALL:
+        fail(
+          "call inside the main loop (everything should be inlined)",
+          address
+        );
+        break;
+      case Flow::RETURN:
+        fail("return inside the main loop", address);
+        break;
+      case Flow::INDIRECT:
+        fail("indirect jump or call inside the main loop", address);
+        break;
+      }
+    }
+    steps.resize(depth);
+    onPath[address] = false;
+  }
+};
+
+
+/**
+ * Computes the register values at the start of the main loop, by following
+ * every path from the start of main() (calls are skipped, assuming they
+ * clobber the call-used registers)
+ */
+class PrologueAnalyzer {
+public:
+  Registers registers;
+
+  PrologueAnalyzer(const std::vector<uint16_t>& flash, uint16_t header) :
+    flash(flash), header(header), onPath(FLASH_WORDS) {
+    registers.fill(-2);
+  }
+
+  void run(uint16_t start) {
+    Registers initial;
+    initial.fill(-1);
+    initial[1] = 0;  // __zero_reg__
+    visit(start, initial);
+    for (int16_t& value : registers) {
+      value = value == -2 ? -1 : value;
+    }
+  }
+
+private:
+  const std::vector<uint16_t>& flash;
+  const uint16_t header;
+  std::vector<bool> onPath;
+  size_t visits = 0;
+
+  void visit(uint16_t address, Registers state) {
+    if (address == header) {
+      for (uint8_t r = 0; r < 32; r++) {
+        registers[r] = registers[r] == -2 || registers[r] == state[r]
+          ? state[r] : -1;
+      }
+      return;
+    }
+    if (address >= FLASH_WORDS || onPath[address] || ++visits > MAX_PATHS) {
+      return;
+    }
+    onPath[address] = true;
+    const Instruction instruction = decode(flash, address);
+    const uint16_t next = address + instruction.words;
+    applyWrites(instruction, state);
+    switch (instruction.flow) {
+    case Flow::NEXT:
+      visit(next, state);
+      break;
+    case Flow::JUMP:
+      visit(instruction.target, state);
+      break;
+    case Flow::BRANCH:
+      visit(next, state);
+      visit(instruction.target, state);
+      break;
+    case Flow::SKIP:
+      visit(next, state);
+      visit(next + decode(flash, next).words, state);
+      break;
+    case Flow::CALL:
+      for (uint8_t r : {0, 18, 19, 20, 21, 22, 23, 24, 25, 26, 27, 30, 31}) {
+        state[r] = -1;
+      }
+      visit(next, state);
+      break;
+    default:
+      break;
+    }
+    onPath[address] = false;
+  }
+};
+
+
+struct Listing {
+  std::vector<uint16_t> flash = std::vector<uint16_t>(FLASH_WORDS);
+  std::map<std::string, uint16_t> symbols;
+  std::vector<uint16_t> symbolAddresses;
+};
+
+
+Listing loadListing(const std::string& path) {
+  Listing listing;
+  loadFirmware(path, listing.flash);
+  std::ifstream input(path);
+  static const std::regex SYMBOL_LINE(R"(^([0-9a-f]+) <([^>]+)>:)");
+  std::string line;
+  std::smatch match;
+  while (std::getline(input, line)) {
+    if (std::regex_search(line, match, SYMBOL_LINE)) {
+      const uint16_t address = std::stoul(match[1].str(), nullptr, 16) / 2;
+      listing.symbols[match[2].str()] = address;
+      listing.symbolAddresses.push_back(address);
+    }
+  }
+  std::sort(listing.symbolAddresses.begin(), listing.symbolAddresses.end());
+  return listing;
+}
+
+
+/**
+ * Returns the first word of main() and the first word after it (i.e. the
+ * next symbol's), or -1 twice if main() isn't listed
+ */
+std::pair<long, long> getMainRange(const Listing& listing) {
+  auto main = listing.symbols.find("main");
+  if (main == listing.symbols.end()) {
+    return {-1, -1};
+  }
+  auto nextSymbol = std::upper_bound(
+    listing.symbolAddresses.begin(), listing.symbolAddresses.end(), main->second
+  );
+  return {
+    main->second,
+    nextSymbol == listing.symbolAddresses.end() ? FLASH_WORDS : *nextSymbol
+  };
+}
+
+
+/**
+ * The main loop's start is the lowest address inside main() which is the
+ * target of a backward jump or branch (delay loops excluded)
+ */
+long findMainLoop(const Listing& listing) {
+  const auto [start, end] = getMainRange(listing);
+  if (start < 0) {
+    return -1;
+  }
+  long header = -1;
+  for (uint16_t address = start; address < end;) {
+    const Instruction instruction = decode(listing.flash, address);
+    const bool jumps = instruction.flow == Flow::JUMP
+      || instruction.flow == Flow::BRANCH;
+    const bool delayLoop = instruction.opcode == BRNE_BACK_2 && address
+      && isDelayLoopCounterUpdate(listing.flash[address - 1]);
+    if (jumps && !delayLoop && instruction.target <= address
+        && instruction.target >= start
+        && (header < 0 || instruction.target < header)) {
+      header = instruction.target;
+    }
+    address += instruction.words;
+  }
+  return header;
+}
+
+
+/**
+ * Returns the driver features used by main() which the analysis doesn't
+ * support (see above), found through the registers main() accesses; the
+ * timing checks are only looked for from the main loop's start onwards.
+ */
+std::vector<std::string> findUnsupportedFeatures(
+  const Listing& listing,
+  uint16_t header
+) {
+  bool timer1 = false, spi = false, latches = false, timingChecks = false;
+  const auto [start, end] = getMainRange(listing);
+  for (long address = start; address >= 0 && address < end;) {
+    const Instruction instruction = decode(listing.flash, address);
+    const uint16_t opcode = instruction.opcode;
+    const bool inLoop = address >= header;
+    if ((opcode & 0xfc0f) == 0x9000) {  // lds, sts
+      const uint16_t data = instruction.operand;
+      timer1 |= data == TCCR1A_ADDRESS || data == TCCR1B_ADDRESS
+        || (data >= TCNT1L_ADDRESS && data <= OCR1AH_ADDRESS);
+      timingChecks |= inLoop && data == UCSR0A_ADDRESS;
+    } else if ((opcode & 0xf000) == 0xb000) {  // in, out
+      const uint8_t io = (opcode & 0x0600) >> 5 | (opcode & 0x000f);
+      if (opcode & 0x0800) {
+        spi |= io == SPCR_IO_ADDRESS || io == SPDR_IO_ADDRESS;
+        latches |= io == GPIOR1_IO_ADDRESS || io == GPIOR2_IO_ADDRESS;
+      } else {
+        timingChecks |= inLoop && io == TCNT0_IO_ADDRESS;
+      }
+    }
+    address += instruction.words;
+  }
+  std::vector<std::string> features;
+  if (timer1) {
+    features.push_back("word select generated by timer 1 (or TDM mode)");
+  }
+  if (spi) {
+    features.push_back("second data line (DualStreamI2SDriver)");
+  } else if (latches) {
+    // DualStreamI2SDriver latches its low byte into GPIOR1 too
+    features.push_back("24 or 32-bit samples (bytes latched into GPIOR1/2)");
+  }
+  if (timingChecks) {
+    features.push_back("timing checks (checkTiming())");
+  }
+  return features;
+}
+
+
+int usage(const char* program) {
+  std::fprintf(
+    stderr,
+    "Usage: %s [--half-bit-period N] [--generator NAME | --work CYCLES]\n"
+    "       [--loop ADDRESS] [--paths] LISTING\n"
+    "  LISTING            avr-objdump -dSz output (e.g."
+    " disassembler-output.txt)\n"
+    "  --half-bit-period  the driver's HALF_BIT_PERIOD (default 5)\n"
+    "  --generator        the generator whose getNextSample() is the only"
+    " work item:\n"
+    "                     square, square-24, square-16, wavetable,\n"
+    "                     wavetable-interpolated, square-polyblep,"
+    " sawtooth-polyblep,\n"
+    "                     dpcm\n"
+    "  --work             the total duration of the work items, in cycles\n"
+    "  --loop             the main loop's start (byte address), if it"
+    " can't be found\n"
+    "  --paths            print every path, rather than only the distinct"
+    " ones\n",
+    program
+  );
+  return 2;
+}
+
+}
+
+
+int main(int argc, char** argv) {
+  long halfBitPeriod = 5, workDuration = -1, loopAddress = -1;
+  bool printAllPaths = false;
+  std::string listingPath;
+  for (int i = 1; i < argc; i++) {
+    if (!std::strcmp(argv[i], "--half-bit-period") && i + 1 < argc) {
+      halfBitPeriod = std::strtol(argv[++i], nullptr, 0);
+    } else if (!std::strcmp(argv[i], "--generator") && i + 1 < argc) {
+      workDuration = getGeneratorDuration(halfBitPeriod, argv[++i]);
+      if (workDuration < 0) {
+        std::fprintf(stderr, "Unknown generator %s\n", argv[i]);
+        return 2;
+      }
+    } else if (!std::strcmp(argv[i], "--work") && i + 1 < argc) {
+      workDuration = std::strtol(argv[++i], nullptr, 0);
+    } else if (!std::strcmp(argv[i], "--loop") && i + 1 < argc) {
+      loopAddress = std::strtol(argv[++i], nullptr, 0) / 2;
+    } else if (!std::strcmp(argv[i], "--paths")) {
+      printAllPaths = true;
+    } else if (argv[i][0] == '-' || !listingPath.empty()) {
+      return usage(argv[0]);
+    } else {
+      listingPath = argv[i];
+    }
+  }
+  if (listingPath.empty()) {
+    return usage(argv[0]);
+  }
+
+  Expectations expected;
+  Listing listing;
+  try {
+    expected = getExpectations(halfBitPeriod, workDuration);
+    listing = loadListing(listingPath);
+  } catch (const std::exception& e) {
+    std::fprintf(stderr, "%s\n", e.what());
+    return 2;
+  }
+  const long header = loopAddress >= 0 ? loopAddress : findMainLoop(listing);
+  if (header < 0) {
+    std::fprintf(stderr, "Can't find the main loop (is main() listed?)\n");
+    return 2;
+  }
+  const std::vector<std::string> unsupported =
+    findUnsupportedFeatures(listing, header);
+  if (!unsupported.empty()) {
+    for (const std::string& feature : unsupported) {
+      std::fprintf(stderr, "Unsupported: %s\n", feature.c_str());
+    }
+    std::fprintf(
+      stderr,
+      "Only timer 0, stereo 16-bit samples and a single data line are"
+      " supported, without timing checks; use extras/simulator instead\n"
+    );
+    return 2;
+  }
+
+  /*
+   * The registers' values at the start of the loop depend on the previous
+   * iteration as well, so the analysis is repeated until they're stable
+   */
+  PrologueAnalyzer prologue(listing.flash, header);
+  prologue.run(listing.symbols["main"]);
+  Registers registers = prologue.registers;
+  LoopAnalyzer loop(listing.flash, header);
+  for (;;) {
+    loop.run(registers);
+    Registers merged = registers;
+    for (uint8_t r = 0; r < 32; r++) {
+      if (loop.exitRegisters[r] != -2 && loop.exitRegisters[r] != merged[r]) {
+        merged[r] = -1;
+      }
+    }
+    if (merged == registers || !loop.errors.empty()) {
+      break;
+    }
+    registers = merged;
+  }
+  std::printf("main loop at 0x%04lx, %zu paths\n", header * 2,
+              loop.paths.size());
+  if (!loop.errors.empty()) {
+    for (const std::string& error : loop.errors) {
+      std::printf("error: %s\n", error.c_str());
+    }
+    return 1;
+  }
+
+  uint32_t mismatches = 0;
+  auto check = [&](uint32_t value, uint32_t expectedValue) {
+    if (value == expectedValue) {
+      return "";
+    }
+    mismatches++;
+    return "  MISMATCH";
+  };
+
+  std::set<std::string> printed;
+  for (size_t p = 0; p < loop.paths.size(); p++) {
+    const Path& path = loop.paths[p];
+    char line[256];
+    std::string report;
+    std::snprintf(line, sizeof line, "  frame: %u cycles (expected %u)%s\n",
+                  path.cycles, expected.framePeriod,
+                  check(path.cycles, expected.framePeriod));
+    report += line;
+    const std::vector<uint32_t>& writes = path.sampleWrites;
+    if (writes.size() != 4) {
+      std::snprintf(line, sizeof line,
+                    "  %zu writes to UDR0 (expected 4)  MISMATCH\n",
+                    writes.size());
+      report += line;
+      mismatches++;
+    } else {
+      uint32_t work = 0;
+      for (uint8_t sample = 0; sample < 2; sample++) {
+        const uint32_t start = writes[2 * sample];
+        const uint32_t end = writes[2 * sample + 1] + 2;
+        const uint32_t nextStart = sample ? writes[0] + path.cycles : writes[2];
+        std::snprintf(
+          line, sizeof line,
+          "  sample %u sent at +%u: sendSample() %u cycles (expected %u)%s,"
+          " next sample after %u (expected %u)%s\n",
+          sample, start,
+          end - start, expected.sendSampleDuration,
+          check(end - start, expected.sendSampleDuration),
+          nextStart - start, expected.samplePeriod,
+          check(nextStart - start, expected.samplePeriod)
+        );
+        report += line;
+        // The slot's steps in time order (the ones before the first sample
+        // belong to the end of the last slot)
+        std::vector<std::pair<uint32_t, const Step*>> slotSteps;
+        for (const Step& step : path.steps) {
+          uint32_t at = step.start < writes[0] ? step.start + path.cycles
+            : step.start;
+          if (at >= end && at < nextStart) {
+            slotSteps.emplace_back(at, &step);
+          }
+        }
+        std::sort(slotSteps.begin(), slotSteps.end());
+        uint32_t slotBusy = 0, slotIdle = 0, slotDelay = 0;
+        // The current run of idle steps, and whether it has a delay loop
+        uint32_t idleRun = 0;
+        bool idleRunHasLoop = false;
+        for (const auto& [at, step] : slotSteps) {
+          (step->idle ? slotIdle : slotBusy) += step->cycles;
+          if (step->idle) {
+            idleRun += step->cycles;
+            idleRunHasLoop |= step->loop;
+          } else {
+            slotDelay += idleRunHasLoop ? idleRun : 0;
+            idleRun = 0;
+            idleRunHasLoop = false;
+          }
+        }
+        slotDelay += idleRunHasLoop ? idleRun : 0;
+        const uint32_t slotWork = nextStart - end - slotDelay;
+        work += slotWork;
+        std::snprintf(line, sizeof line,
+                      "    then %u busy cycles and %u idle cycles"
+                      " (%u work cycles, %u in the scheduler's delays)\n",
+                      slotBusy, slotIdle, slotWork, slotDelay);
+        report += line;
+      }
+      if (expected.workDuration >= 0) {
+        const uint32_t expectedWork =
+          expected.workDuration + expected.loopJumpDuration;
+        std::snprintf(
+          line, sizeof line,
+          "  work cycles: %u (expected %u, work items and loop jump)%s\n",
+          work, expectedWork, check(work, expectedWork)
+        );
+        report += line;
+      }
+    }
+    if (printAllPaths || printed.insert(report).second) {
+      std::printf("path %zu:\n%s", p + 1, report.c_str());
+    }
+  }
+
+  for (const auto& [address, branch] : loop.branches) {
+    const std::set<uint32_t>& notTaken = branch.remaining[0];
+    const std::set<uint32_t>& taken = branch.remaining[1];
+    if (notTaken.empty() || taken.empty()) {
+      continue;
+    }
+    const bool balanced = notTaken == taken && notTaken.size() == 1;
+    std::printf(
+      "%s at 0x%04x: %u..%u cycles to the end of the frame when %s,"
+      " %u..%u otherwise%s\n",
+      branch.name, address * 2,
+      *taken.begin(), *taken.rbegin(),
+      std::strcmp(branch.name, "skip") ? "taken" : "skipping",
+      *notTaken.begin(), *notTaken.rbegin(),
+      balanced ? "" : "  UNBALANCED"
+    );
+    mismatches += !balanced;
+  }
+  std::printf("%u mismatches\n", mismatches);
+  return mismatches ? 1 : 0;
+}
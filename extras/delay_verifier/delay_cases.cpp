@@ -0,0 +1,120 @@
+/*
+ * AVR program used by the delay verifier: it instantiates DELAY_FUNCTION<T>()
+ * (any of the functions in delay_in_cycles.hpp) for every T between
+ * FIRST_DELAY and LAST_DELAY (included), each one inside its own function, and
+ * calls them in order. The verifier runs the program on the simulator and
+ * measures the time spent inside each function.
+ *
+ * All three macros must be defined on the command line; verify_delays.sh takes
+ * care of that (and of splitting the range of T, so that each program fits in
+ * flash).
+ *
+ * When IN_CONTEXT is defined too (as the number of loop runs), each delay runs
+ * inside a loop instead, next to code which keeps registers live, like the
+ * sketch's main loop: a sendSample()-like store of a sample into UDR0, and a
+ * SquareWaveGenerator computing the next one. There, the compiler is free to
+ * keep the delay's counter in a register across loop runs, or to run out of
+ * registers for it, which a delay measured on its own can't show. Since the
+ * function no longer only contains the delay, every delay is marked instead:
+ * bit 7 of GPIOR0 is set right before it and cleared right after it (sbi and
+ * cbi need no register), and the verifier measures the time between the two
+ * writes (see delay_verifier.cpp).
+ */
+
+#include <avr/cpufunc.h>
+#include <avr/interrupt.h>
+#include <avr/io.h>
+#include "../../delay_in_cycles.hpp"
+#ifdef IN_CONTEXT
+#include "../../wave_generators.hpp"
+#endif
+
+
+#ifndef IN_CONTEXT
+/**
+ * The function's body only contains the delay (the empty asm statement keeps
+ * the compiler from removing calls to empty functions, and generates no
+ * code), so the time between its first instruction and its ret is exactly the
+ * delay's duration.
+ */
+template<uint16_t T>
+__attribute__((noinline)) void delayCase() {
+  asm volatile("");
+  DELAY_FUNCTION<T>();
+}
+#else
+/**
+ * The number of loop runs of each case, read from SRAM so that the compiler
+ * can't unroll the loop
+ */
+volatile uint8_t contextRuns = IN_CONTEXT;
+
+
+/**
+ * Sets (START) or clears bit 7 of GPIOR0. sample is passed as an operand, so
+ * the generator's computation stays on the same side of the markers as in the
+ * source (the compiler could still move other instructions between them,
+ * which would show up as a longer delay).
+ */
+template<bool START>
+inline void markDelay(int16_t& sample) {
+  if constexpr (START) {
+    asm volatile(
+      "sbi %[gpior0], 7"
+      : [sample] "+r" (sample)
+      : [gpior0] "I" (_SFR_IO_ADDR(GPIOR0))
+    );
+  } else {
+    asm volatile(
+      "cbi %[gpior0], 7"
+      : [sample] "+r" (sample)
+      : [gpior0] "I" (_SFR_IO_ADDR(GPIOR0))
+    );
+  }
+}
+
+
+/**
+ * Runs the delay contextRuns times, inside a loop shaped like the sketch's
+ * main loop (a store of the previous sample, the generator, and the delay)
+ */
+template<uint16_t T>
+__attribute__((noinline)) void delayCase() {
+  SquareWaveGenerator<320> generator(440, 16);
+  int16_t sample = generator.getFirstSample();
+  for (uint8_t runs = contextRuns; runs; runs--) {
+    UDR0 = sample >> 8;
+    UDR0 = sample;
+    sample = generator.getNextSample();
+    markDelay<true>(sample);
+    DELAY_FUNCTION<T>();
+    markDelay<false>(sample);
+  }
+}
+#endif
+
+
+/**
+ * Calls delayCase<FIRST>() ... delayCase<LAST>() in order; the range is split
+ * in halves, so the recursion depth stays logarithmic.
+ */
+template<uint16_t FIRST, uint16_t LAST>
+inline void runDelayCases() {
+  if constexpr (FIRST == LAST) {
+    delayCase<FIRST>();
+  } else {
+    constexpr uint16_t MIDDLE = FIRST + (LAST - FIRST) / 2;
+    runDelayCases<FIRST, MIDDLE>();
+    runDelayCases<MIDDLE + 1, LAST>();
+  }
+}
+
+
+int main() {
+  // Tells the verifier that the following calls are the delay cases
+  GPIOR0 = 1;
+  runDelayCases<FIRST_DELAY, LAST_DELAY>();
+  GPIOR0 = 2;
+  cli();
+  for (;;) {}
+}
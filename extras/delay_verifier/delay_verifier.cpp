@@ -0,0 +1,163 @@
+/*
+ * Runs a program built from delay_cases.cpp on the simulated ATmega328P (see
+ * extras/simulator), measures how many cycles each delay case takes and
+ * compares them with the requested delays. See the README for build
+ * instructions, and verify_delays.sh for the complete verification.
+ *
+ * With --context N, the program must have been built with IN_CONTEXT = N: each
+ * delay case then runs its delay N times inside a loop, and every run is
+ * measured from the write which sets bit 7 of GPIOR0 to the one which clears
+ * it (minus the 2 cycles of the cbi which clears it).
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include "../simulator/atmega328p.hpp"
+#include "../simulator/firmware.hpp"
+
+
+namespace {
+
+bool isCall(uint16_t opcode) {
+  return (opcode & 0xf000) == 0xd000      // rcall
+    || (opcode & 0xfe0e) == 0x940e        // call
+    || opcode == 0x9509 || opcode == 0x9519;  // icall, eicall
+}
+
+
+bool isReturn(uint16_t opcode) {
+  return opcode == 0x9508 || opcode == 0x9518;  // ret, reti
+}
+
+
+int usage(const char* program) {
+  std::fprintf(
+    stderr,
+    "Usage: %s --first T --last T [--context N] [--cycles N] FIRMWARE\n"
+    "  FIRMWARE  Intel HEX file or avr-objdump -dSz output of a program"
+    " built\n"
+    "            from delay_cases.cpp\n"
+    "  --first   FIRST_DELAY used to build the program\n"
+    "  --last    LAST_DELAY used to build the program\n"
+    "  --context IN_CONTEXT used to build the program, if any\n"
+    "  --cycles  maximum number of CPU cycles to simulate"
+    " (default 100000000)\n",
+    program
+  );
+  return 2;
+}
+
+}
+
+
+int main(int argc, char** argv) {
+  long first = -1, last = -1;
+  long contextRuns = 0;
+  uint64_t maximumCycles = 100000000;
+  std::string firmwarePath;
+  for (int i = 1; i < argc; i++) {
+    if (!std::strcmp(argv[i], "--first") && i + 1 < argc) {
+      first = std::strtol(argv[++i], nullptr, 0);
+    } else if (!std::strcmp(argv[i], "--last") && i + 1 < argc) {
+      last = std::strtol(argv[++i], nullptr, 0);
+    } else if (!std::strcmp(argv[i], "--context") && i + 1 < argc) {
+      contextRuns = std::strtol(argv[++i], nullptr, 0);
+    } else if (!std::strcmp(argv[i], "--cycles") && i + 1 < argc) {
+      maximumCycles = std::strtoull(argv[++i], nullptr, 0);
+    } else if (argv[i][0] == '-' || !firmwarePath.empty()) {
+      return usage(argv[0]);
+    } else {
+      firmwarePath = argv[i];
+    }
+  }
+  if (firmwarePath.empty() || first < 0 || last < first || contextRuns < 0) {
+    return usage(argv[0]);
+  }
+
+  ATmega328P mcu;
+  try {
+    loadFirmware(firmwarePath, mcu.cpu.flash);
+  } catch (const std::exception& e) {
+    std::fprintf(stderr, "%s\n", e.what());
+    return 2;
+  }
+
+  /*
+   * Once the first marker has been written, every call made at the same depth
+   * is a delay case: its duration goes from the first instruction of the
+   * called function to the start of the matching ret.
+   */
+  std::vector<uint64_t> durations;
+  bool started = false;
+  int32_t depth = 0;
+  uint64_t entryCycle = 0;
+  while (mcu.cpu.cycle < maximumCycles && !mcu.cpu.halted) {
+    uint64_t start = mcu.cpu.cycle;
+    ExecutedInstruction executed = mcu.cpu.step();
+    if (!started) {
+      started = !mcu.markers.empty();
+      continue;
+    }
+    if (mcu.markers.back().second == 2) {
+      break;
+    }
+    if (contextRuns) {
+      continue;
+    }
+    if (isCall(executed.opcode) || executed.interrupt) {
+      if (!depth++) {
+        entryCycle = mcu.cpu.cycle;
+      }
+    } else if (isReturn(executed.opcode)) {
+      if (!--depth) {
+        durations.push_back(start - entryCycle);
+      }
+    }
+  }
+
+  /*
+   * In context, every delay runs between a write which sets bit 7 of GPIOR0
+   * (its sbi ends right when the delay starts) and one which clears it (its
+   * cbi starts right when the delay ends, and takes 2 cycles).
+   */
+  if (contextRuns) {
+    uint64_t delayStart = 0;
+    bool inDelay = false;
+    for (size_t i = 1; i < mcu.markers.size(); i++) {
+      const bool set = mcu.markers[i].second & 0x80;
+      if (set && !inDelay) {
+        delayStart = mcu.markers[i].first;
+      } else if (!set && inDelay) {
+        durations.push_back(mcu.markers[i].first - delayStart - 2);
+      }
+      inDelay = set;
+    }
+  }
+
+  const size_t runsPerCase = contextRuns ? contextRuns : 1;
+  const size_t expectedCases = (last - first + 1) * runsPerCase;
+  uint32_t mismatches = 0;
+  for (size_t i = 0; i < durations.size() && i < expectedCases; i++) {
+    const size_t delay = first + i / runsPerCase;
+    if (durations[i] != delay) {
+      if (contextRuns) {
+        std::printf("T = %4zu, run %zu: %llu cycles\n", delay,
+                    i % runsPerCase + 1, (unsigned long long) durations[i]);
+      } else {
+        std::printf("T = %4zu: %llu cycles\n", delay,
+                    (unsigned long long) durations[i]);
+      }
+      mismatches++;
+    }
+  }
+  if (durations.size() != expectedCases) {
+    std::printf("expected %zu delay cases, found %zu\n",
+                expectedCases, durations.size());
+    return 1;
+  }
+  std::printf("T = %ld..%ld: %u mismatches\n", first, last, mismatches);
+  return mismatches ? 1 : 0;
+}
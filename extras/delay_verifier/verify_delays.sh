@@ -0,0 +1,108 @@
+#!/bin/sh
+#
+# Checks that every delay function in delay_in_cycles.hpp takes exactly T
+# cycles, for every T between 0 and 2000 (or the given range), with both -Os
+# and -O3. Each range of T is built into a program (delay_cases.cpp), which is
+# then run by delay_verifier on the simulated ATmega328P. The functions which
+# use loops are also checked in context, i.e. inside a loop which keeps
+# registers live (see IN_CONTEXT in delay_cases.cpp). Requires avr-g++ and
+# avr-objcopy in PATH; see the README.
+#
+# Usage: extras/delay_verifier/verify_delays.sh [FIRST LAST]
+
+set -u
+
+FIRST=${1:-0}
+LAST=${2:-2000}
+DIRECTORY=$(cd "$(dirname "$0")" && pwd)
+VERIFIER="$DIRECTORY/delay_verifier"
+WORK=$(mktemp -d)
+trap 'rm -rf "$WORK"' EXIT
+
+if [ ! -x "$VERIFIER" ]; then
+  c++ -std=c++17 -O2 -o "$VERIFIER" "$DIRECTORY/delay_verifier.cpp" || exit 2
+fi
+
+# Largest sum of T per program, in cycles, for the functions which generate
+# straight code: delayInCyclesWithNOP<T>() takes T words of flash, so its
+# ranges must be split to fit in 32 KB (and the denser ones can be split less)
+STRAIGHT_BUDGET=12000
+# Largest number of cases per program for the functions which use loops, which
+# are only a few words long (this keeps compilation times reasonable)
+LOOP_CASES=250
+# Same, for the cases in context, which also contain a generator, and the
+# number of times each one runs its delay
+CONTEXT_CASES=100
+CONTEXT_RUNS=4
+
+FAILED=0
+
+verify() {
+  # $1 = optimization flag, $2 = delay function, $3 = first T, $4 = last T,
+  # $5 = number of runs in context (optional)
+  NAME="$WORK/delays"
+  CONTEXT_FLAGS=""
+  LABEL="$1 $2"
+  if [ -n "${5:-}" ]; then
+    CONTEXT_FLAGS="-DIN_CONTEXT=$5"
+    LABEL="$LABEL (in context)"
+  fi
+  # $CONTEXT_FLAGS is either empty or a single word, so it's left unquoted
+  if ! avr-g++ -mmcu=atmega328p -DF_CPU=16000000UL -std=gnu++17 "$1" \
+      -ffunction-sections -fdata-sections -Wl,--gc-sections \
+      -DDELAY_FUNCTION="$2" -DFIRST_DELAY="$3" -DLAST_DELAY="$4" \
+      $CONTEXT_FLAGS -o "$NAME.elf" "$DIRECTORY/delay_cases.cpp"; then
+    echo "$LABEL T = $3..$4: build failed"
+    FAILED=1
+    return
+  fi
+  avr-objcopy -O ihex -R .eeprom "$NAME.elf" "$NAME.hex"
+  printf '%s ' "$LABEL"
+  if [ -n "${5:-}" ]; then
+    "$VERIFIER" --first "$3" --last "$4" --context "$5" "$NAME.hex" || FAILED=1
+  else
+    "$VERIFIER" --first "$3" --last "$4" "$NAME.hex" || FAILED=1
+  fi
+}
+
+for OPTIMIZATION in -Os -O3; do
+  for FUNCTION in delayInCyclesWithLoop delayInCyclesWithAsmLoop; do
+    T=$FIRST
+    while [ "$T" -le "$LAST" ]; do
+      END=$((T + LOOP_CASES - 1))
+      [ "$END" -gt "$LAST" ] && END=$LAST
+      verify "$OPTIMIZATION" "$FUNCTION" "$T" "$END"
+      T=$((END + 1))
+    done
+    T=$FIRST
+    while [ "$T" -le "$LAST" ]; do
+      END=$((T + CONTEXT_CASES - 1))
+      [ "$END" -gt "$LAST" ] && END=$LAST
+      verify "$OPTIMIZATION" "$FUNCTION" "$T" "$END" "$CONTEXT_RUNS"
+      T=$((END + 1))
+    done
+  done
+
+  # Function name and cycles per word
+  for ENTRY in delayInCyclesWithNOP:1 delayInCyclesWithRJMP:2 \
+      delayInCyclesWithLPM:3; do
+    FUNCTION=${ENTRY%:*}
+    BUDGET=$((STRAIGHT_BUDGET * ${ENTRY#*:}))
+    T=$FIRST
+    while [ "$T" -le "$LAST" ]; do
+      END=$T
+      SUM=$T
+      while [ "$END" -lt "$LAST" ] && [ $((SUM + END + 1)) -le "$BUDGET" ]; do
+        END=$((END + 1))
+        SUM=$((SUM + END))
+      done
+      verify "$OPTIMIZATION" "$FUNCTION" "$T" "$END"
+      T=$((END + 1))
+    done
+  done
+done
+
+if [ "$FAILED" -ne 0 ]; then
+  echo "Some delays don't match"
+fi
+exit $FAILED
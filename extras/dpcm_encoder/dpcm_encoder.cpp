@@ -0,0 +1,251 @@
+/*
+ * Encodes a WAV file (PCM, 8 or 16 bits, any number of channels, which get
+ * mixed down to mono) into the 4-bit DPCM format played by
+ * DPCMSampleGenerator, and prints a header which can be included by the
+ * sketch. See dpcm.hpp for the format, and the README for build instructions.
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "../../dpcm.hpp"
+
+
+namespace {
+
+struct Sound {
+  std::vector<int16_t> samples;
+  uint32_t sampleRate = 0;
+};
+
+
+uint32_t readLittleEndian(const uint8_t* bytes, uint8_t count) {
+  uint32_t value = 0;
+  for (uint8_t i = count; i > 0; i--) {
+    value = value << 8 | bytes[i - 1];
+  }
+  return value;
+}
+
+
+Sound loadWAV(const std::string& path) {
+  std::ifstream input(path, std::ios::binary);
+  if (!input) {
+    throw std::runtime_error("Can't open " + path);
+  }
+  std::vector<uint8_t> file(
+    (std::istreambuf_iterator<char>(input)),
+    std::istreambuf_iterator<char>()
+  );
+  if (file.size() < 12 || std::memcmp(file.data(), "RIFF", 4)
+      || std::memcmp(file.data() + 8, "WAVE", 4)) {
+    throw std::runtime_error(path + " is not a WAV file");
+  }
+  Sound sound;
+  uint16_t channels = 0, bitsPerSample = 0;
+  const uint8_t* frames = nullptr;
+  size_t framesSize = 0;
+  for (size_t offset = 12; offset + 8 <= file.size();) {
+    const uint8_t* chunk = file.data() + offset;
+    size_t size = readLittleEndian(chunk + 4, 4);
+    size = std::min(size, file.size() - offset - 8);
+    if (!std::memcmp(chunk, "fmt ", 4) && size >= 16) {
+      if (readLittleEndian(chunk + 8, 2) != 1) {
+        throw std::runtime_error(path + " is not in PCM format");
+      }
+      channels = readLittleEndian(chunk + 10, 2);
+      sound.sampleRate = readLittleEndian(chunk + 12, 4);
+      bitsPerSample = readLittleEndian(chunk + 22, 2);
+    } else if (!std::memcmp(chunk, "data", 4)) {
+      frames = chunk + 8;
+      framesSize = size;
+    }
+    offset += 8 + size + (size & 1);
+  }
+  if (!channels || !frames || (bitsPerSample != 8 && bitsPerSample != 16)) {
+    throw std::runtime_error(path + " must contain 8 or 16-bit PCM samples");
+  }
+  const size_t frameSize = channels * bitsPerSample / 8;
+  for (size_t f = 0; f + frameSize <= framesSize; f += frameSize) {
+    int32_t sum = 0;
+    for (uint16_t c = 0; c < channels; c++) {
+      sum += bitsPerSample == 8
+        ? (int32_t(frames[f + c]) - 128) * 256
+        : int16_t(readLittleEndian(frames + f + 2 * c, 2));
+    }
+    sound.samples.push_back(sum / channels);
+  }
+  return sound;
+}
+
+
+/**
+ * Encodes samples one at a time, always picking the delta which brings the
+ * decoded value closest to the target, without overflowing
+ */
+class Encoder {
+public:
+  std::vector<uint8_t> nibbles;
+  int16_t value = 0;
+
+  void encode(int32_t target) {
+    uint8_t best = 8;
+    int32_t bestError = INT32_MAX;
+    for (uint8_t nibble = 0; nibble < 16; nibble++) {
+      int32_t decoded = value + DPCM_DELTAS[nibble];
+      if (decoded < INT16_MIN || decoded > INT16_MAX) {
+        continue;
+      }
+      int32_t error = std::abs(decoded - target);
+      if (error < bestError) {
+        best = nibble;
+        bestError = error;
+      }
+    }
+    nibbles.push_back(best);
+    value += DPCM_DELTAS[best];
+  }
+};
+
+
+int usage(const char* program) {
+  std::fprintf(
+    stderr,
+    "Usage: %s [--name NAME] [--loop START [--loop-end END]] INPUT.wav\n"
+    "  INPUT.wav   PCM WAV file (8 or 16 bits, mixed down to mono)\n"
+    "  --name      name of the generated DPCMSample constant"
+    " (default SAMPLE)\n"
+    "  --loop      loop the sound from sample START (by default the sound"
+    " is played once)\n"
+    "  --loop-end  end the loop before sample END (default: the sound's"
+    " length)\n"
+    "The header is printed on the standard output.\n",
+    program
+  );
+  return 2;
+}
+
+}
+
+
+int main(int argc, char** argv) {
+  std::string name = "SAMPLE", inputPath;
+  long loopStart = -1, loopEnd = -1;
+  for (int i = 1; i < argc; i++) {
+    if (!std::strcmp(argv[i], "--name") && i + 1 < argc) {
+      name = argv[++i];
+    } else if (!std::strcmp(argv[i], "--loop") && i + 1 < argc) {
+      loopStart = std::strtol(argv[++i], nullptr, 0);
+    } else if (!std::strcmp(argv[i], "--loop-end") && i + 1 < argc) {
+      loopEnd = std::strtol(argv[++i], nullptr, 0);
+    } else if (argv[i][0] == '-' || !inputPath.empty()) {
+      return usage(argv[0]);
+    } else {
+      inputPath = argv[i];
+    }
+  }
+  if (inputPath.empty() || (loopEnd >= 0 && loopStart < 0)) {
+    return usage(argv[0]);
+  }
+
+  Sound sound;
+  try {
+    sound = loadWAV(inputPath);
+  } catch (const std::exception& e) {
+    std::fprintf(stderr, "%s\n", e.what());
+    return 2;
+  }
+  long length = sound.samples.size();
+  if (loopEnd >= 0) {
+    length = std::min(length, loopEnd);
+  }
+  if (!length || loopStart >= length) {
+    std::fprintf(stderr, "The loop must start within the sound\n");
+    return 2;
+  }
+
+  Encoder encoder;
+  double signalPower = 0, noisePower = 0;
+  int16_t loopStartValue = 0;
+  for (long i = 0; i < length; i++) {
+    if (i == loopStart) {
+      loopStartValue = encoder.value;
+    }
+    encoder.encode(sound.samples[i]);
+    double error = double(encoder.value) - sound.samples[i];
+    signalPower += double(sound.samples[i]) * sound.samples[i];
+    noisePower += error * error;
+  }
+  if (loopStart < 0) {
+    // Fade out, then loop a single 0 delta forever
+    while (std::abs(encoder.value) >= DPCM_DELTAS[9]) {
+      encoder.encode(0);
+    }
+    loopStartValue = encoder.value;
+    loopStart = encoder.nibbles.size();
+    encoder.nibbles.push_back(8);
+  }
+  if (encoder.nibbles.size() > 0xffff) {
+    std::fprintf(stderr, "The sound is too long\n");
+    return 2;
+  }
+
+  std::printf(
+    "#pragma once\n"
+    "\n"
+    "/*\n"
+    " * Generated by extras/dpcm_encoder from %s\n"
+    " * (%zu samples at %u Hz, %zu bytes)\n"
+    " */\n"
+    "\n"
+    "#include <avr/pgmspace.h>\n"
+    "#include \"dpcm.hpp\"\n"
+    "\n"
+    "\n"
+    "const uint8_t %s_DATA[] PROGMEM = {",
+    inputPath.c_str(),
+    encoder.nibbles.size(),
+    sound.sampleRate,
+    (encoder.nibbles.size() + 1) / 2,
+    name.c_str()
+  );
+  for (size_t i = 0; i < encoder.nibbles.size(); i += 2) {
+    uint8_t byte = encoder.nibbles[i] << 4;
+    if (i + 1 < encoder.nibbles.size()) {
+      byte |= encoder.nibbles[i + 1];
+    }
+    std::printf("%s0x%02x", i % 24 ? ", " : i ? ",\n  " : "\n  ", byte);
+  }
+  std::printf(
+    "\n};\n"
+    "\n"
+    "const DPCMSample %s = {\n"
+    "  %s_DATA,\n"
+    "  %zu,\n"
+    "  %ld,\n"
+    "  %d,\n"
+    "  %u\n"
+    "};\n",
+    name.c_str(),
+    name.c_str(),
+    encoder.nibbles.size(),
+    loopStart,
+    loopStartValue,
+    sound.sampleRate
+  );
+  std::fprintf(
+    stderr,
+    "%zu samples, %zu bytes, SNR %.1f dB\n",
+    encoder.nibbles.size(),
+    (encoder.nibbles.size() + 1) / 2,
+    noisePower ? 10 * std::log10(signalPower / noisePower) : INFINITY
+  );
+  return 0;
+}
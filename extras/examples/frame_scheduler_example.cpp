@@ -0,0 +1,52 @@
+/*
+ * The sketch's program, with the main loop built by runFrameLoop() (see
+ * frame_scheduler.hpp) rather than placed by hand. It's kept apart from the
+ * sketch until its disassembly has been checked with the cycle analyzer and
+ * the simulator: disassembler-output.txt comes from the hand-placed loop.
+ *
+ * It's built with avr-g++ directly (the one bundled with Arduino IDE), with
+ * the same flags as the sketch and the Arduino core's headers (the sketch's
+ * headers use its macros); see the README.
+ */
+
+#include <Arduino.h>
+#include <avr/io.h>
+#include "../../delay_in_cycles.hpp"
+#include "../../frame_scheduler.hpp"
+#include "../../i2s_driver.hpp"
+#include "../../wave_generators.hpp"
+
+
+int main() {
+  /*
+   * Same driver as the sketch, including
+   * BUSY_EXTERNAL_CYCLES_BEFORE_FIRST_BUFFER_WRITE, which was measured on the
+   * sketch's listing (where it includes two delay constants loaded before the
+   * first buffer write). The delays inside runFrameLoop() load their counters
+   * inside the loop (see delayInCyclesWithAsmLoop()), so this program may
+   * need 2 cycles less; that has to be read off its own listing (the
+   * instructions between the driver's constructor and the first write to
+   * UDR0) before changing it.
+   */
+  using MyDriver = I2SDriver<5, 7>;
+
+  MyDriver driver;
+  delayInCyclesWithNOP<
+    driver.OTHER_EXTERNAL_DELAY_CYCLES_BEFORE_FIRST_BUFFER_WRITE
+  >();
+  SquareWaveGenerator<MyDriver::FRAME_PERIOD> generator(440, 16);
+  int16_t sample = generator.getFirstSample();
+  /*
+   * The same sample is sent to both channels, so it must be computed before
+   * the left one is sent (i.e. in the frame's first slot).
+   */
+  runFrameLoop(
+    driver,
+    sample,
+    sample,
+    workItem<generator.GET_NEXT_SAMPLE_DURATION>([&] {
+      sample = generator.getNextSample();
+    })
+  );
+  return 0;
+}
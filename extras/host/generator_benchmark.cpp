@@ -0,0 +1,417 @@
+/*
+ * Builds the generators for the host, renders a few seconds of each one at
+ * the driver's sample rate (F_CPU / FRAME_PERIOD) and reports:
+ * - the measured frequency, and its error compared to the requested one
+ *   (the measurement tolerates errors up to 50 Hz);
+ * - the total harmonic distortion (harmonics of the measured fundamental,
+ *   relative to the fundamental), which is only meaningful for sine waves;
+ * - the energy which doesn't belong to any harmonic (aliasing and noise),
+ *   relative to the whole signal;
+ * - the host's rendering time per sample.
+ * The "-block" entries render the same generators with renderBlock() instead
+ * of getNextSample(), so the two rendering times can be compared.
+ * Optionally, each rendering is saved as a WAV file.
+ *
+ * The AVR-specific headers are replaced by the ones in the shims folder; see
+ * the README for build instructions.
+ */
+
+#include <Arduino.h>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+#include "../../i2s_driver.hpp"
+#include "../../mixer.hpp"
+#include "../../wave_generators.hpp"
+#include "../../wavetables.hpp"
+
+
+namespace {
+
+using Driver = I2SDriver<5, 0>;
+constexpr uint16_t FRAME_PERIOD = Driver::FRAME_PERIOD;
+constexpr double SAMPLE_RATE = double(F_CPU) / FRAME_PERIOD;
+
+
+struct Benchmark {
+  const char* name;
+  /**
+   * Creates a new instance of the generator, playing the given frequency, and
+   * returns a function which calls its getNextSample()
+   */
+  std::function<std::function<int16_t()>(uint32_t frequency)> create;
+};
+
+
+template<typename Generator, typename... Arguments>
+std::function<int16_t()> wrap(Arguments... arguments) {
+  auto generator = std::make_shared<Generator>(arguments...);
+  generator->getFirstSample();
+  return [generator] {
+    return generator->getNextSample();
+  };
+}
+
+
+/**
+ * Same as wrap(), but the samples are rendered BLOCK_SIZE at a time with
+ * renderBlock(), and then returned one by one
+ */
+template<typename Generator, uint8_t BLOCK_SIZE = 32, typename... Arguments>
+std::function<int16_t()> wrapBlock(Arguments... arguments) {
+  struct State {
+    Generator generator;
+    int16_t block[BLOCK_SIZE];
+    uint8_t index;
+  };
+  auto state = std::make_shared<State>(State{
+    Generator(arguments...),
+    {},
+    BLOCK_SIZE
+  });
+  state->generator.getFirstSample();
+  return [state] {
+    if (state->index == BLOCK_SIZE) {
+      state->generator.renderBlock(state->block, BLOCK_SIZE);
+      state->index = 0;
+    }
+    return state->block[state->index++];
+  };
+}
+
+
+/**
+ * Three square waves (the requested frequency, its octave and its twelfth),
+ * mixed with saturation; all of them are harmonics of the requested
+ * frequency, so the analysis still makes sense. They use 24-bit accumulators,
+ * since Mixer doesn't accept 32-bit ones
+ */
+std::function<int16_t()> wrapMixer(uint32_t frequency) {
+  using Voice = SquareWaveGenerator<FRAME_PERIOD, 24>;
+  using VoiceMixer = Mixer<MixingMode::SATURATION, Voice, Voice, Voice>;
+  auto voices = std::make_shared<std::vector<Voice>>(std::vector<Voice>{
+    Voice(frequency, 8000),
+    Voice(frequency * 2, 8000),
+    Voice(frequency * 3, 8000)
+  });
+  auto mixer = std::make_shared<VoiceMixer>(
+    (*voices)[0],
+    (*voices)[1],
+    (*voices)[2]
+  );
+  return [voices, mixer] {
+    return mixer->getNextSample();
+  };
+}
+
+
+const Benchmark BENCHMARKS[] = {
+  {"square", [](uint32_t f) {
+    return wrap<SquareWaveGenerator<FRAME_PERIOD>>(f, int16_t(16000));
+  }},
+  {"square-24", [](uint32_t f) {
+    return wrap<SquareWaveGenerator<FRAME_PERIOD, 24>>(f, int16_t(16000));
+  }},
+  {"square-16", [](uint32_t f) {
+    return wrap<SquareWaveGenerator<FRAME_PERIOD, 16>>(f, int16_t(16000));
+  }},
+  {"square-block", [](uint32_t f) {
+    return wrapBlock<SquareWaveGenerator<FRAME_PERIOD>>(f, int16_t(16000));
+  }},
+  {"square-24-block", [](uint32_t f) {
+    return wrapBlock<SquareWaveGenerator<FRAME_PERIOD, 24>>(
+      f, int16_t(16000)
+    );
+  }},
+  {"square-16-block", [](uint32_t f) {
+    return wrapBlock<SquareWaveGenerator<FRAME_PERIOD, 16>>(
+      f, int16_t(16000)
+    );
+  }},
+  {"sine", [](uint32_t f) {
+    return wrap<WavetableGenerator<FRAME_PERIOD>>(
+      SINE_WAVETABLE, f, uint8_t(255)
+    );
+  }},
+  {"sine-interpolated", [](uint32_t f) {
+    return wrap<WavetableGenerator<FRAME_PERIOD, true>>(
+      SINE_WAVETABLE, f, uint8_t(255)
+    );
+  }},
+  {"sawtooth-table", [](uint32_t f) {
+    return wrap<WavetableGenerator<FRAME_PERIOD, true>>(
+      SAWTOOTH_WAVETABLE, f, uint8_t(255)
+    );
+  }},
+  {"square-polyblep", [](uint32_t f) {
+    return wrap<BandLimitedGenerator<FRAME_PERIOD>>(f, uint8_t(125));
+  }},
+  {"sawtooth-polyblep", [](uint32_t f) {
+    return wrap<
+      BandLimitedGenerator<FRAME_PERIOD, BandLimitedWaveform::SAWTOOTH>
+    >(f, uint8_t(125));
+  }},
+  {"fm", [](uint32_t f) {
+    return wrap<FMGenerator<FRAME_PERIOD>>(f, f, uint8_t(64), uint8_t(255));
+  }},
+  {"fm-2-1", [](uint32_t f) {
+    return wrap<FMGenerator<FRAME_PERIOD>>(
+      f, f * 2, uint8_t(96), uint8_t(255)
+    );
+  }},
+  {"square-mixer", wrapMixer},
+};
+
+
+struct Analysis {
+  double measuredFrequency = 0;
+  double harmonicDistortion = 0;
+  double nonHarmonicEnergy = 0;
+};
+
+
+/**
+ * Returns the phase of the sinusoidal component at the given frequency,
+ * within length samples starting from start (Hann window)
+ */
+double measurePhase(
+  const std::vector<double>& signal,
+  size_t start,
+  size_t length,
+  double frequency
+) {
+  const double step = 2 * M_PI * frequency / SAMPLE_RATE;
+  double real = 0, imaginary = 0;
+  for (size_t i = 0; i < length; i++) {
+    const double window = 0.5 - 0.5 * std::cos(2 * M_PI * i / length);
+    real += signal[start + i] * window * std::cos(step * i);
+    imaginary -= signal[start + i] * window * std::sin(step * i);
+  }
+  return std::atan2(imaginary, real);
+}
+
+
+/**
+ * Measures the fundamental frequency, starting from an estimate, by comparing
+ * the phase of two consecutive blocks: the phase advances by
+ * 2 * pi * frequency * length / SAMPLE_RATE from one block to the next. Short
+ * blocks tolerate a big error in the estimate, long ones give a precise
+ * result, so the estimate is refined with longer and longer blocks.
+ */
+double measureFrequency(const std::vector<double>& signal, double estimate) {
+  const size_t lengths[] = {
+    size_t(SAMPLE_RATE / 100),
+    size_t(SAMPLE_RATE / 10),
+    signal.size() / 2
+  };
+  for (size_t length : lengths) {
+    if (length < 2 || 2 * length > signal.size()) {
+      continue;
+    }
+    const double expectedAdvance = 2 * M_PI * estimate * length / SAMPLE_RATE;
+    double advance =
+      measurePhase(signal, length, length, estimate)
+      - measurePhase(signal, 0, length, estimate)
+      - expectedAdvance;
+    advance = std::remainder(advance, 2 * M_PI);
+    estimate += advance * SAMPLE_RATE / (2 * M_PI * length);
+  }
+  return estimate;
+}
+
+
+/**
+ * Measures the power of the sinusoidal component at the given frequency,
+ * using a Hann window to limit the leakage from the other components
+ */
+double measurePower(
+  const std::vector<double>& signal,
+  const std::vector<double>& window,
+  double windowSum,
+  double frequency
+) {
+  const double step = 2 * M_PI * frequency / SAMPLE_RATE;
+  double real = 0, imaginary = 0;
+  for (size_t i = 0; i < signal.size(); i++) {
+    real += signal[i] * window[i] * std::cos(step * i);
+    imaginary += signal[i] * window[i] * std::sin(step * i);
+  }
+  const double amplitude =
+    2 * std::sqrt(real * real + imaginary * imaginary) / windowSum;
+  return amplitude * amplitude / 2;
+}
+
+
+Analysis analyze(const std::vector<int16_t>& samples, double frequency) {
+  Analysis analysis;
+  double mean = 0;
+  for (int16_t sample : samples) {
+    mean += sample;
+  }
+  mean /= samples.size();
+  std::vector<double> signal, window;
+  double windowSum = 0, totalPower = 0;
+  for (size_t i = 0; i < samples.size(); i++) {
+    signal.push_back(samples[i] - mean);
+    window.push_back(0.5 - 0.5 * std::cos(2 * M_PI * i / samples.size()));
+    windowSum += window[i];
+    totalPower += window[i] * signal[i] * signal[i];
+  }
+  totalPower /= windowSum;
+  analysis.measuredFrequency = measureFrequency(signal, frequency);
+  if (!analysis.measuredFrequency || !totalPower) {
+    return analysis;
+  }
+  double fundamentalPower = 0, harmonicsPower = 0;
+  for (
+    uint32_t k = 1;
+    k * analysis.measuredFrequency < SAMPLE_RATE / 2;
+    k++
+  ) {
+    double power = measurePower(
+      signal,
+      window,
+      windowSum,
+      k * analysis.measuredFrequency
+    );
+    (k == 1 ? fundamentalPower : harmonicsPower) += power;
+  }
+  analysis.harmonicDistortion = harmonicsPower / fundamentalPower;
+  analysis.nonHarmonicEnergy = std::max(
+    totalPower - fundamentalPower - harmonicsPower,
+    0.0
+  ) / totalPower;
+  return analysis;
+}
+
+
+void writeWAV(const std::string& path, const std::vector<int16_t>& samples) {
+  std::ofstream output(path, std::ios::binary);
+  auto write = [&](uint32_t value, uint8_t bytes) {
+    for (uint8_t i = 0; i < bytes; i++) {
+      output.put(char(value >> (8 * i)));
+    }
+  };
+  const uint32_t sampleRate = std::lround(SAMPLE_RATE);
+  const uint32_t dataSize = samples.size() * 2;
+  output.write("RIFF", 4);
+  write(36 + dataSize, 4);
+  output.write("WAVEfmt ", 8);
+  write(16, 4);
+  write(1, 2);
+  write(1, 2);
+  write(sampleRate, 4);
+  write(sampleRate * 2, 4);
+  write(2, 2);
+  write(16, 2);
+  output.write("data", 4);
+  write(dataSize, 4);
+  for (int16_t sample : samples) {
+    write(uint16_t(sample), 2);
+  }
+}
+
+
+double toDecibels(double ratio) {
+  return ratio > 0 ? 10 * std::log10(ratio) : -INFINITY;
+}
+
+
+int usage(const char* program) {
+  std::fprintf(
+    stderr,
+    "Usage: %s [--seconds S] [--frequency HZ] [--wav DIR] [--list]"
+    " [GENERATOR...]\n"
+    "  GENERATOR    generators to benchmark (default: all of them)\n"
+    "  --seconds    length of each rendering (default 1)\n"
+    "  --frequency  requested frequency (default 440)\n"
+    "  --wav        also save each rendering to DIR/GENERATOR.wav\n"
+    "  --list       list the available generators\n",
+    program
+  );
+  return 2;
+}
+
+}
+
+
+int main(int argc, char** argv) {
+  double seconds = 1;
+  uint32_t frequency = 440;
+  std::string wavDirectory;
+  std::vector<std::string> selected;
+  for (int i = 1; i < argc; i++) {
+    if (!std::strcmp(argv[i], "--seconds") && i + 1 < argc) {
+      seconds = std::strtod(argv[++i], nullptr);
+    } else if (!std::strcmp(argv[i], "--frequency") && i + 1 < argc) {
+      frequency = std::strtoul(argv[++i], nullptr, 0);
+    } else if (!std::strcmp(argv[i], "--wav") && i + 1 < argc) {
+      wavDirectory = argv[++i];
+    } else if (!std::strcmp(argv[i], "--list")) {
+      for (const Benchmark& benchmark : BENCHMARKS) {
+        std::printf("%s\n", benchmark.name);
+      }
+      return 0;
+    } else if (argv[i][0] == '-') {
+      return usage(argv[0]);
+    } else {
+      selected.push_back(argv[i]);
+    }
+  }
+  const size_t sampleCount = std::lround(seconds * SAMPLE_RATE);
+  if (sampleCount < 2) {
+    return usage(argv[0]);
+  }
+
+  std::printf("sample rate %.0f Hz, %zu samples, requested frequency %u Hz\n",
+              SAMPLE_RATE, sampleCount, frequency);
+  std::printf("%-20s %12s %10s %10s %14s %10s\n", "generator", "frequency",
+              "error", "THD", "non-harmonic", "host time");
+  bool found = selected.empty();
+  for (const Benchmark& benchmark : BENCHMARKS) {
+    bool enabled = selected.empty();
+    for (const std::string& name : selected) {
+      enabled = enabled || name == benchmark.name;
+    }
+    if (!enabled) {
+      continue;
+    }
+    found = true;
+    std::function<int16_t()> getNextSample = benchmark.create(frequency);
+    std::vector<int16_t> samples(sampleCount);
+    auto start = std::chrono::steady_clock::now();
+    for (int16_t& sample : samples) {
+      sample = getNextSample();
+    }
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    double nanoseconds =
+      std::chrono::duration<double, std::nano>(elapsed).count() / sampleCount;
+
+    Analysis analysis = analyze(samples, frequency);
+    std::printf(
+      "%-20s %9.3f Hz %7.3f Hz %7.1f dB %11.1f dB %7.1f ns\n",
+      benchmark.name,
+      analysis.measuredFrequency,
+      analysis.measuredFrequency - frequency,
+      toDecibels(analysis.harmonicDistortion),
+      toDecibels(analysis.nonHarmonicEnergy),
+      nanoseconds
+    );
+    if (!wavDirectory.empty()) {
+      writeWAV(wavDirectory + "/" + benchmark.name + ".wav", samples);
+    }
+  }
+  if (!found) {
+    std::fprintf(stderr, "No such generator (see --list)\n");
+    return 2;
+  }
+  return 0;
+}
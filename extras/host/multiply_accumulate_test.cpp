@@ -0,0 +1,304 @@
+/*
+ * Checks BiquadFilter's multiply-accumulate block (the AVR201-style inline
+ * assembly in filters.hpp) without an AVR toolchain: the block is read from
+ * the header, assembled with fixed registers, and run on the CPU of the
+ * simulator in extras/simulator, with random and extreme operands. For each
+ * run, it checks that:
+ * - the result matches the C++ version of multiplyAccumulate() (the one the
+ *   host build uses);
+ * - the block takes exactly MULTIPLY_ACCUMULATE_DURATION cycles;
+ * - the zero register is cleared again at the end.
+ * It also checks the timings documented next to BiquadFilter at compile time.
+ *
+ * The AVR-specific headers are replaced by the ones in the shims folder; see
+ * the README for build instructions. The exit status is 0 if every run
+ * passes, 1 otherwise.
+ */
+
+#include <Arduino.h>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "../simulator/avr_cpu.hpp"
+#include "../../filters.hpp"
+#include "../../frame_scheduler.hpp"
+#include "../../i2s_driver.hpp"
+#include "../../wave_generators.hpp"
+
+
+namespace {
+
+using DefaultDriver = I2SDriver<5, 0>;
+using BiquadDriver = I2SDriver<7, 5, WordSelectTimer::TIMER_1>;
+using Square = SquareWaveGenerator<DefaultDriver::FRAME_PERIOD>;
+using Filter = BiquadFilter<Square>;
+
+static_assert(
+  Filter::GET_NEXT_SAMPLE_DURATION
+    > FrameScheduler<DefaultDriver>::GET_SLOT_BUDGET(0),
+  "The biquad now fits with the default timings, update filters.hpp!"
+);
+static_assert(
+  BiquadFilter<SquareWaveGenerator<BiquadDriver::FRAME_PERIOD>>
+    ::GET_NEXT_SAMPLE_DURATION
+    <= FrameScheduler<BiquadDriver>::GET_SLOT_BUDGET(0),
+  "The biquad doesn't fit with the timings documented in filters.hpp!"
+);
+
+/**
+ * The registers given to the block's operands; a and b need r16-r23 (the
+ * "a" constraint), since muls and mulsu can't use other registers
+ */
+const std::map<std::string, uint8_t> OPERAND_REGISTERS = {
+  {"sum", 24},
+  {"zero", 22},
+  {"a", 16},
+  {"b", 18}
+};
+
+
+class NullBus : public DataBus {
+public:
+  uint8_t read(uint16_t, uint64_t) override {
+    return 0;
+  }
+
+  void write(uint16_t, uint8_t, uint64_t) override {}
+
+  uint8_t pendingInterrupt(uint64_t) override {
+    return 0;
+  }
+};
+
+
+int usage(const char* program) {
+  std::fprintf(
+    stderr,
+    "Usage: %s [--runs N] [--seed N] [FILTERS_HPP]\n"
+    "  FILTERS_HPP  path of filters.hpp (default: the one next to this"
+    " program's\n"
+    "               source)\n"
+    "  --runs       number of random runs (default 100000)\n"
+    "  --seed       random seed (default 1)\n",
+    program
+  );
+  return 2;
+}
+
+
+/**
+ * Returns the instructions of the asm statement inside multiplyAccumulate(),
+ * one per element, or nothing if it can't be found
+ */
+std::vector<std::string> readBlock(const std::string& path) {
+  std::ifstream file(path);
+  std::stringstream contents;
+  contents << file.rdbuf();
+  const std::string source = contents.str();
+  std::vector<std::string> instructions;
+  size_t position = source.find("static void multiplyAccumulate(");
+  if (position == std::string::npos) {
+    return instructions;
+  }
+  position = source.find("asm(", position);
+  const size_t end = source.find("\n      :", position);
+  if (position == std::string::npos || end == std::string::npos) {
+    return instructions;
+  }
+  while (true) {
+    const size_t open = source.find('"', position);
+    if (open >= end) {
+      break;
+    }
+    const size_t close = source.find('"', open + 1);
+    std::string instruction = source.substr(open + 1, close - open - 1);
+    const size_t escape = instruction.find('\\');
+    instructions.push_back(instruction.substr(0, escape));
+    position = close + 1;
+  }
+  return instructions;
+}
+
+
+/**
+ * Resolves an operand such as %C[sum], %[zero], r0 or __zero_reg__ to a
+ * register number, or returns -1
+ */
+int getRegister(const std::string& operand) {
+  if (operand == "__zero_reg__") {
+    return 1;
+  }
+  if (operand.size() > 1 && operand[0] == 'r') {
+    return std::atoi(operand.c_str() + 1);
+  }
+  if (operand.size() < 4 || operand[0] != '%') {
+    return -1;
+  }
+  const bool hasByte = operand[1] != '[';
+  const size_t nameStart = hasByte ? 3 : 2;
+  auto found = OPERAND_REGISTERS.find(
+    operand.substr(nameStart, operand.size() - nameStart - 1)
+  );
+  if (found == OPERAND_REGISTERS.end()) {
+    return -1;
+  }
+  return found->second + (hasByte ? operand[1] - 'A' : 0);
+}
+
+
+uint16_t encodeTwoRegisters(uint16_t opcode, uint8_t d, uint8_t r) {
+  return opcode | (r & 0x10) << 5 | d << 4 | (r & 0x0f);
+}
+
+
+/**
+ * Assembles the block (only the instructions it needs are supported), or
+ * returns false with an error message
+ */
+bool assemble(
+  const std::vector<std::string>& instructions,
+  std::vector<uint16_t>& words
+) {
+  for (const std::string& instruction : instructions) {
+    std::string mnemonic;
+    std::string first;
+    std::string second;
+    std::istringstream parser(instruction);
+    parser >> mnemonic >> first >> second;
+    if (!first.empty() && first.back() == ',') {
+      first.pop_back();
+    }
+    const int d = getRegister(first);
+    const int r = second.empty() ? d : getRegister(second);
+    if (d < 0 || r < 0) {
+      std::fprintf(stderr, "unknown operands: %s\n", instruction.c_str());
+      return false;
+    }
+    if (mnemonic == "clr") {
+      words.push_back(encodeTwoRegisters(0x2400, d, d));
+    } else if (mnemonic == "add") {
+      words.push_back(encodeTwoRegisters(0x0c00, d, r));
+    } else if (mnemonic == "adc") {
+      words.push_back(encodeTwoRegisters(0x1c00, d, r));
+    } else if (mnemonic == "sbc") {
+      words.push_back(encodeTwoRegisters(0x0800, d, r));
+    } else if (mnemonic == "mul") {
+      words.push_back(encodeTwoRegisters(0x9c00, d, r));
+    } else if (mnemonic == "muls" && d >= 16 && r >= 16) {
+      words.push_back(0x0200 | (d - 16) << 4 | (r - 16));
+    } else if (mnemonic == "mulsu" && d >= 16 && d < 24 && r >= 16 && r < 24) {
+      words.push_back(0x0300 | (d - 16) << 4 | (r - 16));
+    } else {
+      std::fprintf(stderr, "unsupported instruction: %s\n",
+                   instruction.c_str());
+      return false;
+    }
+  }
+  return true;
+}
+
+}
+
+
+int main(int argc, char** argv) {
+  std::string path = __FILE__;
+  path = path.substr(0, path.find_last_of('/') + 1) + "../../filters.hpp";
+  uint32_t runs = 100000;
+  uint32_t seed = 1;
+  for (int i = 1; i < argc; i++) {
+    if (!std::strcmp(argv[i], "--runs") && i + 1 < argc) {
+      runs = std::strtoul(argv[++i], nullptr, 0);
+    } else if (!std::strcmp(argv[i], "--seed") && i + 1 < argc) {
+      seed = std::strtoul(argv[++i], nullptr, 0);
+    } else if (argv[i][0] == '-') {
+      return usage(argv[0]);
+    } else {
+      path = argv[i];
+    }
+  }
+
+  const std::vector<std::string> instructions = readBlock(path);
+  std::vector<uint16_t> words;
+  if (instructions.empty()) {
+    std::fprintf(stderr, "multiplyAccumulate() not found in %s\n",
+                 path.c_str());
+    return 2;
+  }
+  if (!assemble(instructions, words)) {
+    return 2;
+  }
+
+  const int16_t extremes[] = {0, 1, -1, 127, 128, -128, -129, 32767, -32767,
+                              -32768};
+  std::mt19937 random(seed);
+  NullBus bus;
+  uint32_t failures = 0;
+  for (uint32_t run = 0; run < runs; run++) {
+    int16_t a = random();
+    int16_t b = random();
+    int32_t sum = random();
+    const uint32_t extremesCount = sizeof(extremes) / sizeof(extremes[0]);
+    if (run < extremesCount * extremesCount) {
+      a = extremes[run % extremesCount];
+      b = extremes[run / extremesCount];
+    }
+
+    AVRCPU cpu(bus);
+    std::copy(words.begin(), words.end(), cpu.flash.begin());
+    for (uint8_t i = 0; i < 32; i++) {
+      cpu.data[i] = random();
+    }
+    cpu.data[1] = 0;
+    for (uint8_t i = 0; i < 4; i++) {
+      cpu.data[OPERAND_REGISTERS.at("sum") + i] = uint32_t(sum) >> (8 * i);
+    }
+    for (uint8_t i = 0; i < 2; i++) {
+      cpu.data[OPERAND_REGISTERS.at("a") + i] = uint16_t(a) >> (8 * i);
+      cpu.data[OPERAND_REGISTERS.at("b") + i] = uint16_t(b) >> (8 * i);
+    }
+    while (cpu.pc < words.size()) {
+      cpu.step();
+    }
+
+    uint32_t result = 0;
+    for (uint8_t i = 0; i < 4; i++) {
+      result |= uint32_t(cpu.data[OPERAND_REGISTERS.at("sum") + i]) << (8 * i);
+    }
+    int32_t expected = sum;
+    Filter::multiplyAccumulate(expected, a, b);
+    if (
+      result != uint32_t(expected)
+      || cpu.cycle != Filter::MULTIPLY_ACCUMULATE_DURATION
+      || cpu.data[1]
+    ) {
+      if (failures < 10) {
+        std::printf(
+          "%ld + %d * %d: got %ld in %u cycles (r1 = %u), expected %ld in %u"
+          " cycles\n",
+          long(sum),
+          a,
+          b,
+          long(int32_t(result)),
+          unsigned(cpu.cycle),
+          cpu.data[1],
+          long(expected),
+          Filter::MULTIPLY_ACCUMULATE_DURATION
+        );
+      }
+      failures++;
+    }
+  }
+  std::printf(
+    "%zu instructions, %u runs, %u failures\n",
+    instructions.size(),
+    runs,
+    failures
+  );
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,16 @@
+#pragma once
+
+/*
+ * Host replacement for the parts of Arduino.h used by the sketch's headers
+ * (Arduino IDE includes Arduino.h automatically, so they never do it
+ * themselves).
+ */
+
+#include <avr/interrupt.h>
+#include <avr/io.h>
+
+#define bit(b) (1UL << (b))
+#define bitSet(value, b) ((value) |= (1UL << (b)))
+#define bitClear(value, b) ((value) &= ~(1UL << (b)))
+#define interrupts() sei()
+#define noInterrupts() cli()
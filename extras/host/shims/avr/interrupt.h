@@ -0,0 +1,10 @@
+#pragma once
+
+/*
+ * Host replacement for <avr/interrupt.h>: interrupt handlers become plain
+ * functions, which can be called directly.
+ */
+
+#define ISR(vector) extern "C" void vector()
+#define sei() do {} while (0)
+#define cli() do {} while (0)
@@ -0,0 +1,106 @@
+#pragma once
+
+/*
+ * Host replacement for <avr/io.h>: the I/O registers used by the sketch's
+ * headers become plain variables (so configuring the drivers has no effect),
+ * and the AVR-specific types and macros get portable equivalents.
+ */
+
+#include <stdint.h>
+
+#ifndef F_CPU
+#define F_CPU 16000000UL
+#endif
+
+#define _NOP() do {} while (0)
+#define _BV(b) (1 << (b))
+#define bit_is_set(sfr, b) ((sfr) & _BV(b))
+#define bit_is_clear(sfr, b) (!((sfr) & _BV(b)))
+
+inline volatile uint8_t DDRB, PORTB, PINB, DDRD, PORTD, PIND;
+inline volatile uint8_t GTCCR, GPIOR0, GPIOR1, GPIOR2, SREG;
+inline volatile uint8_t TCCR0A, TCCR0B, TCNT0, OCR0A, OCR0B, TIMSK0, TIFR0;
+inline volatile uint8_t TCCR1A, TCCR1B, TCCR1C, TIMSK1, TIFR1;
+inline volatile uint16_t TCNT1, OCR1A, OCR1B, ICR1;
+inline volatile uint8_t UCSR0A, UCSR0B, UCSR0C, UDR0;
+inline volatile uint16_t UBRR0;
+inline volatile uint8_t SPCR, SPSR, SPDR;
+
+enum { PB0, PB1, PB2, PB3, PB4, PB5, PB6, PB7 };
+enum { PD0, PD1, PD2, PD3, PD4, PD5, PD6, PD7 };
+enum { DDB0, DDB1, DDB2, DDB3, DDB4, DDB5, DDB6, DDB7 };
+enum { DDD0, DDD1, DDD2, DDD3, DDD4, DDD5, DDD6, DDD7 };
+enum { PSRSYNC = 0, PSRASY = 1, TSM = 7 };
+enum { WGM00 = 0, WGM01 = 1, COM0B0 = 4, COM0B1 = 5, COM0A0 = 6, COM0A1 = 7 };
+enum { CS00 = 0, CS01 = 1, CS02 = 2, WGM02 = 3 };
+enum { TOV0 = 0, OCF0A = 1, OCF0B = 2 };
+enum { WGM10 = 0, WGM11 = 1, COM1B0 = 4, COM1B1 = 5, COM1A0 = 6, COM1A1 = 7 };
+enum { CS10 = 0, CS11 = 1, CS12 = 2, WGM12 = 3, WGM13 = 4 };
+enum { TOV1 = 0, OCF1A = 1, OCF1B = 2 };
+enum { MPCM0, U2X0, UPE0, DOR0, FE0, UDRE0, TXC0, RXC0 };
+enum { TXB80, RXB80, UCSZ02, TXEN0, RXEN0, UDRIE0, TXCIE0, RXCIE0 };
+enum { UCPOL0 = 0, UCPHA0 = 1, UDORD0 = 2, UMSEL00 = 6, UMSEL01 = 7 };
+enum { SPR0, SPR1, CPHA, CPOL, MSTR, DORD, SPE, SPIE };
+enum { SPI2X = 0, WCOL = 6, SPIF = 7 };
+
+
+/**
+ * Replacement for avr-gcc's 24-bit unsigned integer: the value is stored in 32
+ * bits, but it wraps around like the real one.
+ */
+class HostUInt24 {
+private:
+  uint32_t value;
+
+public:
+  constexpr HostUInt24() : value(0) {}
+
+  template<typename T>
+  constexpr HostUInt24(T value) : value(uint32_t(uint64_t(value)) & 0xffffff) {}
+
+  constexpr operator uint32_t() const {
+    return value;
+  }
+
+  HostUInt24& operator+=(const uint32_t other) {
+    value = (value + other) & 0xffffff;
+    return *this;
+  }
+
+  HostUInt24& operator-=(const uint32_t other) {
+    value = (value - other) & 0xffffff;
+    return *this;
+  }
+};
+
+
+/**
+ * Replacement for avr-gcc's 24-bit signed integer (see HostUInt24)
+ */
+class HostInt24 {
+private:
+  int32_t value;
+
+public:
+  constexpr HostInt24() : value(0) {}
+
+  template<typename T>
+  constexpr HostInt24(T value) :
+    value(int32_t(uint32_t(int64_t(value)) << 8) >> 8)
+  {}
+
+  constexpr operator int32_t() const {
+    return value;
+  }
+
+  HostInt24& operator+=(const int32_t other) {
+    return *this = value + other;
+  }
+
+  HostInt24& operator-=(const int32_t other) {
+    return *this = value - other;
+  }
+};
+
+typedef HostUInt24 __uint24;
+typedef HostInt24 __int24;
@@ -0,0 +1,13 @@
+#pragma once
+
+/*
+ * Host replacement for <avr/pgmspace.h>: there's a single address space, so
+ * flash reads are plain memory reads.
+ */
+
+#include <stdint.h>
+
+#define PROGMEM
+#define pgm_read_byte(address) (*(const uint8_t*) (address))
+#define pgm_read_word(address) (*(const uint16_t*) (address))
+#define pgm_read_dword(address) (*(const uint32_t*) (address))
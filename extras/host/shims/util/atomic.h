@@ -0,0 +1,11 @@
+#pragma once
+
+/*
+ * Host replacement for <util/atomic.h>: there are no interrupts, so atomic
+ * blocks simply run once.
+ */
+
+#define ATOMIC_RESTORESTATE 0
+#define ATOMIC_FORCEON 1
+#define ATOMIC_BLOCK(type) for (bool atomicBlockDone = false; \
+  !atomicBlockDone; atomicBlockDone = true)
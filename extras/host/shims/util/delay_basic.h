@@ -0,0 +1,11 @@
+#pragma once
+
+/*
+ * Host replacement for <util/delay_basic.h>: delays are meaningless on the
+ * host, so the delay loops do nothing.
+ */
+
+#include <stdint.h>
+
+inline void _delay_loop_1(uint8_t) {}
+inline void _delay_loop_2(uint16_t) {}
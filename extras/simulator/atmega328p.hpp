@@ -0,0 +1,591 @@
+#pragma once
+
+/*
+ * Peripheral models for the parts of the ATmega328P used by the sketch: ports
+ * B and D, timers 0 and 1, the USART in master SPI mode (MSPIM) and the SPI in
+ * slave mode. Everything else on the I/O bus behaves like plain memory.
+ *
+ * The models are not generic: they implement exactly the rules the driver
+ * relies on (see i2s_driver.hpp), so that a mismatch between the declared
+ * constants and the generated code shows up as a broken I2S stream, the same
+ * way it would on real hardware.
+ */
+
+#include <cstdint>
+#include <vector>
+#include "avr_cpu.hpp"
+
+
+/**
+ * A single change on one of the traced pins
+ */
+struct PinChange {
+  uint64_t cycle;
+  uint8_t pin;
+  bool level;
+};
+
+
+/**
+ * A byte the CPU tried to write into UDR0 (or SPDR), and whether the USART
+ * module (or the SPI) actually accepted it
+ */
+struct BufferWrite {
+  uint64_t cycle;
+  uint8_t value;
+  bool accepted;
+};
+
+
+class ATmega328P : public DataBus {
+public:
+  // Data space addresses
+  static constexpr uint16_t PINB_ADDRESS = 0x23;
+  static constexpr uint16_t DDRB_ADDRESS = 0x24;
+  static constexpr uint16_t PORTB_ADDRESS = 0x25;
+  static constexpr uint16_t PIND_ADDRESS = 0x29;
+  static constexpr uint16_t DDRD_ADDRESS = 0x2a;
+  static constexpr uint16_t PORTD_ADDRESS = 0x2b;
+  static constexpr uint16_t TIFR0_ADDRESS = 0x35;
+  static constexpr uint16_t TIFR1_ADDRESS = 0x36;
+  static constexpr uint16_t GPIOR0_ADDRESS = 0x3e;
+  static constexpr uint16_t GTCCR_ADDRESS = 0x43;
+  static constexpr uint16_t TCCR0A_ADDRESS = 0x44;
+  static constexpr uint16_t TCCR0B_ADDRESS = 0x45;
+  static constexpr uint16_t TCNT0_ADDRESS = 0x46;
+  static constexpr uint16_t OCR0A_ADDRESS = 0x47;
+  static constexpr uint16_t OCR0B_ADDRESS = 0x48;
+  static constexpr uint16_t SPCR_ADDRESS = 0x4c;
+  static constexpr uint16_t SPSR_ADDRESS = 0x4d;
+  static constexpr uint16_t SPDR_ADDRESS = 0x4e;
+  static constexpr uint16_t TIMSK0_ADDRESS = 0x6e;
+  static constexpr uint16_t TIMSK1_ADDRESS = 0x6f;
+  static constexpr uint16_t TCCR1A_ADDRESS = 0x80;
+  static constexpr uint16_t TCCR1B_ADDRESS = 0x81;
+  static constexpr uint16_t TCNT1L_ADDRESS = 0x84;
+  static constexpr uint16_t TCNT1H_ADDRESS = 0x85;
+  static constexpr uint16_t ICR1L_ADDRESS = 0x86;
+  static constexpr uint16_t ICR1H_ADDRESS = 0x87;
+  static constexpr uint16_t OCR1AL_ADDRESS = 0x88;
+  static constexpr uint16_t OCR1AH_ADDRESS = 0x89;
+  static constexpr uint16_t OCR1BL_ADDRESS = 0x8a;
+  static constexpr uint16_t OCR1BH_ADDRESS = 0x8b;
+  static constexpr uint16_t UCSR0A_ADDRESS = 0xc0;
+  static constexpr uint16_t UCSR0B_ADDRESS = 0xc1;
+  static constexpr uint16_t UCSR0C_ADDRESS = 0xc2;
+  static constexpr uint16_t UBRR0L_ADDRESS = 0xc4;
+  static constexpr uint16_t UBRR0H_ADDRESS = 0xc5;
+  static constexpr uint16_t UDR0_ADDRESS = 0xc6;
+
+  // Traced pins (Arduino numbers: 0-7 are port D, 8-13 are port B)
+  static constexpr uint8_t TX_PIN = 1;
+  static constexpr uint8_t XCK_PIN = 4;
+  static constexpr uint8_t OC0A_PIN = 6;
+  static constexpr uint8_t OC1A_PIN = 9;
+  static constexpr uint8_t MISO_PIN = 12;
+
+  // Interrupt vector numbers
+  static constexpr uint8_t TIMER1_COMPA_VECTOR = 11;
+  static constexpr uint8_t TIMER1_OVF_VECTOR = 13;
+  static constexpr uint8_t TIMER0_COMPA_VECTOR = 14;
+  static constexpr uint8_t TIMER0_OVF_VECTOR = 16;
+  static constexpr uint8_t USART_UDRE_VECTOR = 19;
+  static constexpr uint8_t USART_TX_VECTOR = 20;
+
+  AVRCPU cpu{*this};
+  std::vector<PinChange> pinChanges;
+  std::vector<BufferWrite> bufferWrites;
+  /**
+   * Bytes written into SPDR; the SPI's SCK is assumed to be wired to XCK, and
+   * SS to ground (see dual_stream_i2s_driver.hpp)
+   */
+  std::vector<BufferWrite> spiWrites;
+  /**
+   * Start cycles of every byte shifted out by the USART module, in order
+   */
+  std::vector<uint64_t> byteStarts;
+  /**
+   * Every value written to GPIOR0, along with the cycle it was written at
+   * (useful as a cheap marker for measuring code sections)
+   */
+  std::vector<std::pair<uint64_t, uint8_t>> markers;
+
+  ATmega328P() {
+    io[UCSR0A_ADDRESS] = bit(UDRE0);
+    io[UCSR0C_ADDRESS] = 0x06;
+  }
+
+  /**
+   * The number of CPU cycles in a full USART clock period, as currently
+   * configured
+   */
+  uint16_t getFullBitPeriod() const {
+    return 2 * (ubrr + 1);
+  }
+
+  uint8_t read(uint16_t address, uint64_t cycle) override {
+    advanceTo(cycle);
+    switch (address) {
+    case PINB_ADDRESS:
+      return pinLevels >> 8;
+    case PIND_ADDRESS:
+      return pinLevels;
+    case TCNT0_ADDRESS:
+      return tcnt0;
+    case TCNT1L_ADDRESS:
+      // Reading the low byte latches the high one into TEMP
+      temp = tcnt1 >> 8;
+      return tcnt1;
+    case TCNT1H_ADDRESS:
+    case ICR1H_ADDRESS:
+      return temp;
+    case UDR0_ADDRESS:
+    case SPDR_ADDRESS:
+      return 0;
+    default:
+      return io[address];
+    }
+  }
+
+  void write(uint16_t address, uint8_t value, uint64_t cycle) override {
+    advanceTo(cycle);
+    switch (address) {
+    case PINB_ADDRESS:
+      io[PORTB_ADDRESS] ^= value;
+      break;
+    case PIND_ADDRESS:
+      io[PORTD_ADDRESS] ^= value;
+      break;
+    case TIFR1_ADDRESS:
+      io[TIFR1_ADDRESS] &= ~value;
+      break;
+    // 16-bit registers: the high byte is written into TEMP first, and both
+    // bytes are updated when the low one is written
+    case TCNT1H_ADDRESS:
+    case ICR1H_ADDRESS:
+    case OCR1AH_ADDRESS:
+    case OCR1BH_ADDRESS:
+      temp = value;
+      break;
+    case TCNT1L_ADDRESS:
+      tcnt1 = temp << 8 | value;
+      break;
+    case ICR1L_ADDRESS:
+    case OCR1AL_ADDRESS:
+    case OCR1BL_ADDRESS:
+      io[address] = value;
+      io[address + 1] = temp;
+      break;
+    case TIFR0_ADDRESS:
+      io[TIFR0_ADDRESS] &= ~value;
+      break;
+    case GTCCR_ADDRESS:
+      if (value & bit(PSRSYNC)) {
+        prescaler = 0;
+      }
+      io[GTCCR_ADDRESS] = value & bit(TSM);
+      break;
+    case TCNT0_ADDRESS:
+      tcnt0 = value;
+      break;
+    case GPIOR0_ADDRESS:
+      io[address] = value;
+      markers.emplace_back(cycle, value);
+      break;
+    case UCSR0A_ADDRESS:
+      if (value & bit(TXC0)) {
+        io[UCSR0A_ADDRESS] &= ~bit(TXC0);
+      }
+      break;
+    case UBRR0L_ADDRESS:
+      io[address] = value;
+      ubrr = (io[UBRR0H_ADDRESS] & 0x0f) << 8 | value;
+      clockOrigin = cycle;
+      break;
+    case UDR0_ADDRESS:
+      writeBuffer(value, cycle);
+      break;
+    case SPSR_ADDRESS:
+      io[address] = (io[address] & 0xfe) | (value & 1);
+      break;
+    case SPDR_ADDRESS:
+      writeSPIData(value, cycle);
+      break;
+    default:
+      io[address] = value;
+      break;
+    }
+    updatePins(cycle);
+  }
+
+  uint8_t pendingInterrupt(uint64_t cycle) override {
+    advanceTo(cycle);
+    if (io[TIMSK1_ADDRESS] & io[TIFR1_ADDRESS] & bit(OCF1A)) {
+      io[TIFR1_ADDRESS] &= ~bit(OCF1A);
+      return TIMER1_COMPA_VECTOR;
+    }
+    if (io[TIMSK1_ADDRESS] & io[TIFR1_ADDRESS] & bit(TOV1)) {
+      io[TIFR1_ADDRESS] &= ~bit(TOV1);
+      return TIMER1_OVF_VECTOR;
+    }
+    if (io[TIMSK0_ADDRESS] & io[TIFR0_ADDRESS] & bit(OCF0A)) {
+      io[TIFR0_ADDRESS] &= ~bit(OCF0A);
+      return TIMER0_COMPA_VECTOR;
+    }
+    if (io[TIMSK0_ADDRESS] & io[TIFR0_ADDRESS] & bit(TOV0)) {
+      io[TIFR0_ADDRESS] &= ~bit(TOV0);
+      return TIMER0_OVF_VECTOR;
+    }
+    if (io[UCSR0B_ADDRESS] & io[UCSR0A_ADDRESS] & bit(UDRE0)) {
+      return USART_UDRE_VECTOR;
+    }
+    if (io[UCSR0B_ADDRESS] & bit(TXCIE0) && io[UCSR0A_ADDRESS] & bit(TXC0)) {
+      io[UCSR0A_ADDRESS] &= ~bit(TXC0);
+      return USART_TX_VECTOR;
+    }
+    return 0;
+  }
+
+  /**
+   * Runs every peripheral up to (and including) the given cycle
+   */
+  void advanceTo(uint64_t cycle) {
+    while (now < cycle) {
+      now++;
+      tickPrescaler();
+      tickUSART();
+      tickSPI();
+      updatePins(now);
+    }
+  }
+
+private:
+  // Bit numbers
+  static constexpr uint8_t TOV0 = 0, OCF0A = 1;
+  static constexpr uint8_t PSRSYNC = 0, TSM = 7;
+  static constexpr uint8_t WGM00 = 0, WGM01 = 1, WGM02 = 3;
+  static constexpr uint8_t COM0A0 = 6;
+  static constexpr uint8_t TOV1 = 0, OCF1A = 1;
+  static constexpr uint8_t WGM10 = 0, WGM11 = 1, WGM12 = 3, WGM13 = 4;
+  static constexpr uint8_t COM1A0 = 6;
+  static constexpr uint8_t UDRE0 = 5, TXC0 = 6;
+  static constexpr uint8_t TXEN0 = 3, TXCIE0 = 6;
+  static constexpr uint8_t UCPOL0 = 0, UDORD0 = 2, UMSEL00 = 6;
+  static constexpr uint8_t MSTR = 4, DORD = 5, SPE = 6;
+  static constexpr uint8_t WCOL = 6, SPIF = 7;
+  /**
+   * The number of CPU cycles it takes the SPI to notice a change on SCK in
+   * slave mode (the datasheet only says that SCK must stay high and low for
+   * more than 2 cycles; the actual synchronizer delay is a guess)
+   */
+  static constexpr uint8_t SPI_SYNC_DELAY = 2;
+
+  static constexpr uint8_t bit(uint8_t n) {
+    return 1 << n;
+  }
+
+  uint8_t io[0x100] = {};
+  uint64_t now = 0;
+  uint16_t pinLevels = 0;
+
+  // Timer 0 state
+  uint16_t prescaler = 0;
+  uint8_t tcnt0 = 0;
+  bool oc0a = false;
+
+  // Timer 1 state
+  uint16_t tcnt1 = 0;
+  uint8_t temp = 0;
+  bool oc1a = false;
+
+  // USART state
+  uint16_t ubrr = 0;
+  uint64_t clockOrigin = 0;
+  bool hasBufferedByte = false;
+  uint8_t bufferedByte = 0;
+  uint64_t bufferBlockedUntil = 0;
+  bool hasLoadedByte = false;
+  uint64_t loadedByteReadyAt = 0;
+  bool shifting = false;
+  uint8_t shiftRegister = 0;
+  uint8_t bitsLeft = 0;
+  uint64_t currentBitStart = 0;
+  bool txLevel = true;
+  bool xckLevel = false;
+
+  // SPI state
+  uint8_t sckHistory = 0;
+  bool spiClock = false;
+  uint8_t spiShiftRegister = 0;
+  uint8_t spiSampledBits = 0;
+  bool misoLevel = false;
+
+  void tickPrescaler() {
+    if (io[GTCCR_ADDRESS] & bit(TSM)) {
+      return;
+    }
+    prescaler = (prescaler + 1) & 0x3ff;
+    static constexpr uint16_t DIVIDER_MASKS[] = {0, 0, 7, 63, 255, 1023};
+    uint8_t clockSelect = io[TCCR0B_ADDRESS] & 7;
+    if (clockSelect == 1
+        || (clockSelect >= 2 && clockSelect <= 5
+            && (prescaler & DIVIDER_MASKS[clockSelect]) == 0)) {
+      tickTimer0();
+    }
+    clockSelect = io[TCCR1B_ADDRESS] & 7;
+    if (clockSelect == 1
+        || (clockSelect >= 2 && clockSelect <= 5
+            && (prescaler & DIVIDER_MASKS[clockSelect]) == 0)) {
+      tickTimer1();
+    }
+  }
+
+  /**
+   * Only normal, CTC and fast PWM modes are supported. OCR0A is not double
+   * buffered (the driver only writes it while the timer is stopped).
+   */
+  void tickTimer0() {
+    uint8_t mode = (io[TCCR0A_ADDRESS] & (bit(WGM01) | bit(WGM00)))
+      | (io[TCCR0B_ADDRESS] & bit(WGM02)) >> 1;
+    bool fastPWM = mode == 3 || mode == 7;
+    uint8_t top = mode == 2 || mode == 7 ? io[OCR0A_ADDRESS] : 0xff;
+    // Compare matches are reported on the timer clock after the match
+    bool matchA = tcnt0 == io[OCR0A_ADDRESS];
+    if (tcnt0 == top) {
+      tcnt0 = 0;
+      if (fastPWM || mode == 0) {
+        io[TIFR0_ADDRESS] |= bit(TOV0);
+      }
+      if (fastPWM) {
+        uint8_t com = io[TCCR0A_ADDRESS] >> COM0A0 & 3;
+        if (com == 2) {
+          oc0a = true;
+        } else if (com == 3) {
+          oc0a = false;
+        }
+      }
+    } else {
+      tcnt0++;
+      if (tcnt0 == 0) {
+        io[TIFR0_ADDRESS] |= bit(TOV0);
+      }
+    }
+    if (matchA) {
+      io[TIFR0_ADDRESS] |= bit(OCF0A);
+      uint8_t com = io[TCCR0A_ADDRESS] >> COM0A0 & 3;
+      if (com == 1 && (!fastPWM || mode == 7)) {
+        oc0a = !oc0a;
+      } else if (com == 2) {
+        oc0a = false;
+      } else if (com == 3) {
+        oc0a = true;
+      }
+    }
+  }
+
+  /**
+   * Only normal, CTC (with OCR1A or ICR1 as top) and fast PWM modes are
+   * supported, and only OC1A is driven. Like OCR0A, OCR1A is not double
+   * buffered.
+   */
+  void tickTimer1() {
+    uint8_t mode = (io[TCCR1A_ADDRESS] & (bit(WGM11) | bit(WGM10)))
+      | (io[TCCR1B_ADDRESS] & (bit(WGM13) | bit(WGM12))) >> 1;
+    bool fastPWM = mode == 5 || mode == 6 || mode == 7 || mode == 14
+      || mode == 15;
+    const uint16_t ocr1a = io[OCR1AH_ADDRESS] << 8 | io[OCR1AL_ADDRESS];
+    const uint16_t icr1 = io[ICR1H_ADDRESS] << 8 | io[ICR1L_ADDRESS];
+    uint16_t top = 0xffff;
+    switch (mode) {
+    case 4: case 15: top = ocr1a; break;
+    case 12: case 14: top = icr1; break;
+    case 5: top = 0x00ff; break;
+    case 6: top = 0x01ff; break;
+    case 7: top = 0x03ff; break;
+    }
+    // Compare matches are reported on the timer clock after the match
+    bool matchA = tcnt1 == ocr1a;
+    uint8_t com = io[TCCR1A_ADDRESS] >> COM1A0 & 3;
+    if (tcnt1 == top) {
+      tcnt1 = 0;
+      if (fastPWM || mode == 0) {
+        io[TIFR1_ADDRESS] |= bit(TOV1);
+      }
+      if (fastPWM) {
+        if (com == 2) {
+          oc1a = true;
+        } else if (com == 3) {
+          oc1a = false;
+        }
+      }
+    } else {
+      tcnt1++;
+      if (tcnt1 == 0) {
+        io[TIFR1_ADDRESS] |= bit(TOV1);
+      }
+    }
+    if (matchA) {
+      io[TIFR1_ADDRESS] |= bit(OCF1A);
+      if (com == 1 && (!fastPWM || mode == 14 || mode == 15)) {
+        oc1a = !oc1a;
+      } else if (com == 2) {
+        oc1a = false;
+      } else if (com == 3) {
+        oc1a = true;
+      }
+    }
+  }
+
+  bool isMSPIM() const {
+    return (io[UCSR0C_ADDRESS] >> UMSEL00 & 3) == 3;
+  }
+
+  /**
+   * True if a new USART clock period starts at the given cycle. After writing
+   * UBRR0, the first period starts UBRR0 + 2 cycles later, and each following
+   * one 2 * (UBRR0 + 1) cycles after the previous one.
+   */
+  bool isBitBoundary(uint64_t cycle) const {
+    uint64_t first = clockOrigin + ubrr + 2;
+    return cycle >= first && (cycle - first) % getFullBitPeriod() == 0;
+  }
+
+  /**
+   * When the shift register is empty, a written byte takes 2 cycles to be
+   * loaded, and any other write during that time is ignored; afterwards, the
+   * byte is sent as soon as a new clock period starts. When the shift register
+   * is busy, the byte waits in the buffer and follows the current one without
+   * any gap.
+   */
+  void writeBuffer(uint8_t value, uint64_t cycle) {
+    bool accepted = false;
+    if (io[UCSR0B_ADDRESS] & bit(TXEN0) && cycle > bufferBlockedUntil
+        && !hasBufferedByte) {
+      accepted = true;
+      if (!shifting && !hasLoadedByte) {
+        hasLoadedByte = true;
+        shiftRegister = value;
+        loadedByteReadyAt = cycle + 2;
+        bufferBlockedUntil = cycle + 2;
+      } else {
+        hasBufferedByte = true;
+        bufferedByte = value;
+        io[UCSR0A_ADDRESS] &= ~bit(UDRE0);
+      }
+    }
+    bufferWrites.push_back({cycle, value, accepted});
+  }
+
+  void startByte(uint8_t value) {
+    shifting = true;
+    shiftRegister = value;
+    bitsLeft = 8;
+    byteStarts.push_back(now);
+  }
+
+  void tickUSART() {
+    if (!isMSPIM() || !(io[UCSR0B_ADDRESS] & bit(TXEN0))) {
+      return;
+    }
+    uint16_t halfPeriod = ubrr + 1;
+    if (shifting && now == currentBitStart + halfPeriod) {
+      xckLevel = !(io[UCSR0C_ADDRESS] & bit(UCPOL0));
+    }
+    if (!isBitBoundary(now)) {
+      return;
+    }
+    if (shifting && bitsLeft == 0) {
+      shifting = false;
+      if (hasBufferedByte) {
+        hasBufferedByte = false;
+        io[UCSR0A_ADDRESS] |= bit(UDRE0);
+        startByte(bufferedByte);
+      } else {
+        io[UCSR0A_ADDRESS] |= bit(TXC0);
+      }
+    }
+    if (!shifting && hasLoadedByte && now >= loadedByteReadyAt) {
+      hasLoadedByte = false;
+      startByte(shiftRegister);
+    }
+    xckLevel = io[UCSR0C_ADDRESS] & bit(UCPOL0);
+    if (shifting) {
+      bool lsbFirst = io[UCSR0C_ADDRESS] & bit(UDORD0);
+      txLevel = lsbFirst ? shiftRegister & 1 : shiftRegister >> 7;
+      shiftRegister = lsbFirst ? shiftRegister >> 1 : shiftRegister << 1;
+      bitsLeft--;
+      currentBitStart = now;
+    }
+  }
+
+  bool isSPISlave() const {
+    return (io[SPCR_ADDRESS] & (bit(SPE) | bit(MSTR))) == bit(SPE);
+  }
+
+  /**
+   * A byte can only be written between two transfers; a transfer starts when
+   * its first bit is sampled. The first bit is driven on MISO right away.
+   */
+  void writeSPIData(uint8_t value, uint64_t cycle) {
+    bool accepted = isSPISlave() && !spiSampledBits;
+    if (accepted) {
+      spiShiftRegister = value;
+      misoLevel = io[SPCR_ADDRESS] & bit(DORD) ? value & 1 : value >> 7;
+    } else {
+      io[SPSR_ADDRESS] |= bit(WCOL);
+    }
+    spiWrites.push_back({cycle, value, accepted});
+  }
+
+  /**
+   * Only mode 0 (CPOL = CPHA = 0) in slave mode is supported: bits are
+   * sampled on SCK's rising edges, and the next one is driven on the falling
+   * edges, both seen through the synchronizer.
+   */
+  void tickSPI() {
+    sckHistory = sckHistory << 1 | (pinLevels >> XCK_PIN & 1);
+    bool clock = sckHistory >> (SPI_SYNC_DELAY - 1) & 1;
+    bool risingEdge = clock && !spiClock, fallingEdge = !clock && spiClock;
+    spiClock = clock;
+    if (!isSPISlave()) {
+      spiSampledBits = 0;
+      return;
+    }
+    if (risingEdge && ++spiSampledBits == 8) {
+      spiSampledBits = 0;
+      io[SPSR_ADDRESS] |= bit(SPIF);
+    } else if (fallingEdge && spiSampledBits) {
+      bool lsbFirst = io[SPCR_ADDRESS] & bit(DORD);
+      spiShiftRegister = lsbFirst ? spiShiftRegister >> 1
+        : spiShiftRegister << 1;
+      misoLevel = lsbFirst ? spiShiftRegister & 1 : spiShiftRegister >> 7;
+    }
+  }
+
+  void updatePins(uint64_t cycle) {
+    uint8_t ddrd = io[DDRD_ADDRESS], ddrb = io[DDRB_ADDRESS];
+    uint16_t levels = (io[PORTB_ADDRESS] & ddrb) << 8
+      | (io[PORTD_ADDRESS] & ddrd);
+    auto override = [&](uint8_t pin, bool enabled, bool level) {
+      if (enabled) {
+        levels = (levels & ~(1u << pin)) | level << pin;
+      }
+    };
+    bool mspim = isMSPIM();
+    override(TX_PIN, io[UCSR0B_ADDRESS] & bit(TXEN0), txLevel);
+    override(XCK_PIN, mspim && ddrd & bit(XCK_PIN), xckLevel);
+    override(OC0A_PIN, io[TCCR0A_ADDRESS] >> COM0A0 & 3 && ddrd & bit(OC0A_PIN),
+             oc0a);
+    override(OC1A_PIN,
+             io[TCCR1A_ADDRESS] >> COM1A0 & 3 && ddrb & bit(OC1A_PIN - 8),
+             oc1a);
+    override(MISO_PIN, isSPISlave() && ddrb & bit(MISO_PIN - 8), misoLevel);
+    uint16_t changed = levels ^ pinLevels;
+    for (uint8_t pin : {TX_PIN, XCK_PIN, OC0A_PIN, OC1A_PIN, MISO_PIN}) {
+      if (changed >> pin & 1) {
+        pinChanges.push_back({cycle, pin, bool(levels >> pin & 1)});
+      }
+    }
+    pinLevels = levels;
+  }
+};
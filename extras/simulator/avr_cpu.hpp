@@ -0,0 +1,604 @@
+#pragma once
+
+/*
+ * Minimal, cycle-counting model of the AVR core found in the ATmega328P. It
+ * only knows about registers, SREG, the stack and the program memory: every
+ * other data space access is forwarded to a DataBus, which is where the
+ * peripherals live (see atmega328p.hpp).
+ */
+
+#include <cstdint>
+#include <vector>
+
+
+/**
+ * Interface used by AVRCPU for every data space access which doesn't target
+ * the register file, SREG or the stack pointer.
+ *
+ * Each access carries the CPU cycle at which it happens, so that peripherals
+ * can be brought up to date before the access is served:
+ * - writes happen on the last cycle of an instruction (e.g. an sts starting at
+ *   cycle N lands at cycle N + 2, which is also when the next instruction
+ *   starts);
+ * - reads happen during the last cycle of an instruction (e.g. an in starting
+ *   at cycle N samples the register at cycle N).
+ */
+class DataBus {
+public:
+  virtual ~DataBus() = default;
+  virtual uint8_t read(uint16_t address, uint64_t cycle) = 0;
+  virtual void write(uint16_t address, uint8_t value, uint64_t cycle) = 0;
+  /**
+   * Returns the vector number (1 for INT0, 2 for INT1 and so on) of the
+   * highest priority interrupt which is both enabled and pending, or 0 if
+   * there's none. Acknowledging the interrupt is up to the peripheral.
+   */
+  virtual uint8_t pendingInterrupt(uint64_t cycle) = 0;
+};
+
+
+/**
+ * Information about the last instruction run by AVRCPU::step(), used by tools
+ * which need to classify instructions (e.g. for counting idle cycles).
+ */
+struct ExecutedInstruction {
+  uint16_t address;
+  uint16_t opcode;
+  uint16_t nextOpcode;
+  uint8_t cycles;
+  bool interrupt;
+};
+
+
+class AVRCPU {
+public:
+  static constexpr uint16_t FLASH_WORDS = 16384;
+  static constexpr uint16_t DATA_SIZE = 0x900;
+  static constexpr uint16_t SREG_ADDRESS = 0x5f;
+  static constexpr uint16_t SPH_ADDRESS = 0x5e;
+  static constexpr uint16_t SPL_ADDRESS = 0x5d;
+
+  enum Flag : uint8_t { C = 0, Z, N, V, S, H, T, I };
+
+  std::vector<uint16_t> flash = std::vector<uint16_t>(FLASH_WORDS, 0xffff);
+  uint8_t data[DATA_SIZE] = {};
+  uint16_t pc = 0;
+  uint64_t cycle = 0;
+  /**
+   * Set when the program ends up in a "cli; rjmp .-2" loop (the way avr-libc's
+   * _exit() stops the program), since nothing can ever happen after that
+   */
+  bool halted = false;
+
+  explicit AVRCPU(DataBus& bus) : bus(bus) {
+    setSP(DATA_SIZE - 1);
+  }
+
+  uint16_t getSP() const {
+    return data[SPL_ADDRESS] | data[SPH_ADDRESS] << 8;
+  }
+
+  /**
+   * Runs a single instruction (or dispatches a single interrupt) and returns
+   * its description.
+   */
+  ExecutedInstruction step() {
+    ExecutedInstruction executed{pc, 0, 0, 0, false};
+    if (getFlag(I) && !interruptInhibited) {
+      uint8_t vector = bus.pendingInterrupt(cycle);
+      if (vector) {
+        pushPC(pc);
+        setFlag(I, false);
+        pc = vector * 2;
+        cycle += 4;
+        executed.cycles = 4;
+        executed.interrupt = true;
+        return executed;
+      }
+    }
+    interruptInhibited = false;
+    executed.opcode = fetch(pc);
+    executed.nextOpcode = fetch(pc + 1);
+    executed.cycles = execute(executed.opcode);
+    cycle += executed.cycles;
+    return executed;
+  }
+
+private:
+  DataBus& bus;
+  /**
+   * The instruction following sei and reti is always executed before any
+   * pending interrupt
+   */
+  bool interruptInhibited = false;
+
+  uint16_t fetch(uint16_t address) const {
+    return flash[address % FLASH_WORDS];
+  }
+
+  bool getFlag(Flag flag) const {
+    return data[SREG_ADDRESS] >> flag & 1;
+  }
+
+  void setFlag(Flag flag, bool value) {
+    data[SREG_ADDRESS] = (data[SREG_ADDRESS] & ~(1 << flag)) | value << flag;
+  }
+
+  void setSP(uint16_t value) {
+    data[SPL_ADDRESS] = value;
+    data[SPH_ADDRESS] = value >> 8;
+  }
+
+  uint16_t getPair(uint8_t low) const {
+    return data[low] | data[low + 1] << 8;
+  }
+
+  void setPair(uint8_t low, uint16_t value) {
+    data[low] = value;
+    data[low + 1] = value >> 8;
+  }
+
+  uint8_t readData(uint16_t address, uint64_t at) {
+    address %= DATA_SIZE;
+    if (address < 0x20 || address == SREG_ADDRESS || address == SPH_ADDRESS
+        || address == SPL_ADDRESS || address >= 0x100) {
+      return data[address];
+    }
+    return bus.read(address, at);
+  }
+
+  void writeData(uint16_t address, uint8_t value, uint64_t at) {
+    address %= DATA_SIZE;
+    if (address < 0x20 || address == SREG_ADDRESS || address == SPH_ADDRESS
+        || address == SPL_ADDRESS || address >= 0x100) {
+      data[address] = value;
+    } else {
+      bus.write(address, value, at);
+    }
+  }
+
+  void push(uint8_t value) {
+    uint16_t sp = getSP();
+    data[sp % DATA_SIZE] = value;
+    setSP(sp - 1);
+  }
+
+  uint8_t pop() {
+    uint16_t sp = getSP() + 1;
+    setSP(sp);
+    return data[sp % DATA_SIZE];
+  }
+
+  // The return address is stored big-endian, low byte pushed first
+  void pushPC(uint16_t value) {
+    push(value);
+    push(value >> 8);
+  }
+
+  uint16_t popPC() {
+    uint16_t high = pop();
+    return high << 8 | pop();
+  }
+
+  static bool isTwoWordInstruction(uint16_t opcode) {
+    return (opcode & 0xfc0f) == 0x9000 || (opcode & 0xfe0c) == 0x940c;
+  }
+
+  // Skips the next instruction, returns the extra cycles spent doing so
+  uint8_t skip() {
+    uint8_t words = isTwoWordInstruction(fetch(pc)) ? 2 : 1;
+    pc += words;
+    return words;
+  }
+
+  void setZNS(uint8_t result, bool v) {
+    setFlag(Z, result == 0);
+    setFlag(N, result >> 7);
+    setFlag(V, v);
+    setFlag(S, (result >> 7) ^ v);
+  }
+
+  uint8_t add(uint8_t rd, uint8_t rr, bool carry) {
+    uint8_t r = rd + rr + carry;
+    uint8_t c = (rd & rr) | (rr & ~r) | (~r & rd);
+    setFlag(H, c >> 3 & 1);
+    setFlag(C, c >> 7);
+    setZNS(r, ((rd & rr & ~r) | (~rd & ~rr & r)) >> 7 & 1);
+    return r;
+  }
+
+  uint8_t subtract(uint8_t rd, uint8_t rr, bool carry, bool keepZ) {
+    uint8_t r = rd - rr - carry;
+    uint8_t b = (~rd & rr) | (rr & r) | (r & ~rd);
+    bool z = getFlag(Z);
+    setFlag(H, b >> 3 & 1);
+    setFlag(C, b >> 7);
+    setZNS(r, ((rd & ~rr & ~r) | (~rd & rr & r)) >> 7 & 1);
+    if (keepZ) {
+      setFlag(Z, z && r == 0);
+    }
+    return r;
+  }
+
+  void logic(uint8_t r) {
+    setZNS(r, false);
+  }
+
+  void multiply(int32_t product, bool fractional) {
+    uint16_t result = product;
+    setFlag(C, result >> 15);
+    if (fractional) {
+      result <<= 1;
+    }
+    setFlag(Z, result == 0);
+    setPair(0, result);
+  }
+
+  uint8_t branch(bool condition, uint16_t opcode) {
+    if (!condition) {
+      return 1;
+    }
+    pc += int8_t(opcode >> 2 & 0xfe) >> 1;
+    return 2;
+  }
+
+  uint8_t loadStore(uint16_t opcode, uint8_t pointer, bool preDecrement,
+                    bool postIncrement, uint8_t displacement) {
+    uint8_t reg = opcode >> 4 & 0x1f;
+    uint16_t address = getPair(pointer);
+    if (preDecrement) {
+      address--;
+    }
+    if (opcode & 0x0200) {
+      writeData(address + displacement, data[reg], cycle + 2);
+    } else {
+      data[reg] = readData(address + displacement, cycle + 1);
+    }
+    if (postIncrement) {
+      address++;
+    }
+    if (preDecrement || postIncrement) {
+      setPair(pointer, address);
+    }
+    return 2;
+  }
+
+  uint8_t execute(uint16_t opcode) {
+    const uint16_t address = pc++;
+    const uint8_t d5 = opcode >> 4 & 0x1f;
+    const uint8_t r5 = (opcode & 0x0f) | (opcode >> 5 & 0x10);
+    const uint8_t d4 = 16 + (opcode >> 4 & 0x0f);
+    const uint8_t k8 = (opcode & 0x0f) | (opcode >> 4 & 0xf0);
+    uint8_t& rd = data[d5];
+    const uint8_t rr = data[r5];
+
+    switch (opcode >> 12) {
+    case 0x0:
+      switch (opcode >> 10 & 3) {
+      case 0:
+        switch (opcode >> 8 & 3) {
+        case 0:
+          return 1; // nop
+        case 1: // movw
+          setPair((opcode >> 4 & 0x0f) * 2, getPair((opcode & 0x0f) * 2));
+          return 1;
+        case 2: // muls
+          multiply(int8_t(data[d4]) * int8_t(data[16 + (opcode & 0x0f)]),
+                   false);
+          return 2;
+        default: {
+          uint8_t a = data[16 + (opcode >> 4 & 7)];
+          uint8_t b = data[16 + (opcode & 7)];
+          switch ((opcode >> 6 & 2) | (opcode >> 3 & 1)) {
+          case 0: // mulsu
+            multiply(int8_t(a) * b, false);
+            break;
+          case 1: // fmul
+            multiply(a * b, true);
+            break;
+          case 2: // fmuls
+            multiply(int8_t(a) * int8_t(b), true);
+            break;
+          default: // fmulsu
+            multiply(int8_t(a) * b, true);
+            break;
+          }
+          return 2;
+        }
+        }
+      case 1: // cpc
+        subtract(rd, rr, getFlag(C), true);
+        return 1;
+      case 2: // sbc
+        rd = subtract(rd, rr, getFlag(C), true);
+        return 1;
+      default: // add
+        rd = add(rd, rr, false);
+        return 1;
+      }
+    case 0x1:
+      switch (opcode >> 10 & 3) {
+      case 0: // cpse
+        return rd == rr ? 1 + skip() : 1;
+      case 1: // cp
+        subtract(rd, rr, false, false);
+        return 1;
+      case 2: // sub
+        rd = subtract(rd, rr, false, false);
+        return 1;
+      default: // adc
+        rd = add(rd, rr, getFlag(C));
+        return 1;
+      }
+    case 0x2:
+      switch (opcode >> 10 & 3) {
+      case 0: // and
+        rd &= rr;
+        logic(rd);
+        break;
+      case 1: // eor
+        rd ^= rr;
+        logic(rd);
+        break;
+      case 2: // or
+        rd |= rr;
+        logic(rd);
+        break;
+      default: // mov
+        rd = rr;
+        break;
+      }
+      return 1;
+    case 0x3: // cpi
+      subtract(data[d4], k8, false, false);
+      return 1;
+    case 0x4: // sbci
+      data[d4] = subtract(data[d4], k8, getFlag(C), true);
+      return 1;
+    case 0x5: // subi
+      data[d4] = subtract(data[d4], k8, false, false);
+      return 1;
+    case 0x6: // ori
+      data[d4] |= k8;
+      logic(data[d4]);
+      return 1;
+    case 0x7: // andi
+      data[d4] &= k8;
+      logic(data[d4]);
+      return 1;
+    case 0x8:
+    case 0xa: { // ldd/std (including ld/st through Y and Z without offset)
+      uint8_t q = (opcode & 7) | (opcode >> 7 & 0x18) | (opcode >> 8 & 0x20);
+      return loadStore(opcode, opcode & 0x08 ? 28 : 30, 0, false, q);
+    }
+    case 0x9:
+      return executeGroup9(opcode, d5, r5);
+    case 0xb: { // in/out
+      uint8_t ioAddress = (opcode & 0x0f) | (opcode >> 5 & 0x30);
+      if (opcode & 0x0800) {
+        writeData(0x20 + ioAddress, rd, cycle + 1);
+      } else {
+        rd = readData(0x20 + ioAddress, cycle);
+      }
+      return 1;
+    }
+    case 0xc: // rjmp
+      pc += int16_t(opcode << 4) >> 4;
+      if (pc == address && !getFlag(I)) {
+        halted = true;
+      }
+      return 2;
+    case 0xd: // rcall
+      pushPC(pc);
+      pc += int16_t(opcode << 4) >> 4;
+      return 3;
+    case 0xe: // ldi
+      data[d4] = k8;
+      return 1;
+    default:
+      if (!(opcode & 0x0800)) { // brbs/brbc
+        bool flag = getFlag(Flag(opcode & 7));
+        return branch(opcode & 0x0400 ? !flag : flag, opcode);
+      }
+      switch (opcode >> 9 & 3) {
+      case 0: // bld
+        rd = (rd & ~(1 << (opcode & 7))) | getFlag(T) << (opcode & 7);
+        return 1;
+      case 1: // bst
+        setFlag(T, rd >> (opcode & 7) & 1);
+        return 1;
+      case 2: // sbrc
+        return !(rd >> (opcode & 7) & 1) ? 1 + skip() : 1;
+      default: // sbrs
+        return rd >> (opcode & 7) & 1 ? 1 + skip() : 1;
+      }
+    }
+  }
+
+  uint8_t executeGroup9(uint16_t opcode, uint8_t d5, uint8_t r5) {
+    uint8_t& rd = data[d5];
+    switch (opcode >> 9 & 7) {
+    case 0:
+    case 1: // loads and stores (opcode bit 9 selects the direction)
+      switch (opcode & 0x0f) {
+      case 0x0: { // lds/sts
+        uint16_t target = fetch(pc++);
+        if (opcode & 0x0200) {
+          writeData(target, rd, cycle + 2);
+        } else {
+          rd = readData(target, cycle + 1);
+        }
+        return 2;
+      }
+      case 0x1:
+        return loadStore(opcode, 30, 0, true, 0);
+      case 0x2:
+        return loadStore(opcode, 30, 1, false, 0);
+      case 0x4:
+      case 0x5: { // lpm Rd, Z(+)
+        uint16_t z = getPair(30);
+        if (!(opcode & 0x0200)) {
+          uint16_t word = fetch(z >> 1);
+          rd = z & 1 ? word >> 8 : word;
+          if (opcode & 1) {
+            setPair(30, z + 1);
+          }
+        }
+        return 3;
+      }
+      case 0x9:
+        return loadStore(opcode, 28, 0, true, 0);
+      case 0xa:
+        return loadStore(opcode, 28, 1, false, 0);
+      case 0xc:
+        return loadStore(opcode, 26, 0, false, 0);
+      case 0xd:
+        return loadStore(opcode, 26, 0, true, 0);
+      case 0xe:
+        return loadStore(opcode, 26, 1, false, 0);
+      case 0xf: // pop/push
+        if (opcode & 0x0200) {
+          push(rd);
+        } else {
+          rd = pop();
+        }
+        return 2;
+      default:
+        return 1;
+      }
+    case 2:
+      switch (opcode & 0x0f) {
+      case 0x0: // com
+        rd = ~rd;
+        setZNS(rd, false);
+        setFlag(C, true);
+        return 1;
+      case 0x1: { // neg
+        uint8_t original = rd;
+        rd = -rd;
+        setFlag(H, (rd | original) >> 3 & 1);
+        setFlag(C, rd != 0);
+        setZNS(rd, rd == 0x80);
+        return 1;
+      }
+      case 0x2: // swap
+        rd = rd << 4 | rd >> 4;
+        return 1;
+      case 0x3: // inc
+        rd++;
+        setZNS(rd, rd == 0x80);
+        return 1;
+      case 0x5: // asr
+      case 0x6: // lsr
+      case 0x7: { // ror
+        bool carry = rd & 1;
+        uint8_t top = (opcode & 0x0f) == 5 ? rd & 0x80
+          : (opcode & 0x0f) == 7 ? getFlag(C) << 7 : 0;
+        rd = rd >> 1 | top;
+        setFlag(C, carry);
+        setZNS(rd, (rd >> 7) ^ carry);
+        return 1;
+      }
+      case 0x8:
+        if (opcode & 0x0100) {
+          switch (opcode >> 4 & 0x0f) {
+          case 0x0: // ret
+            pc = popPC();
+            return 4;
+          case 0x1: // reti
+            pc = popPC();
+            setFlag(I, true);
+            interruptInhibited = true;
+            return 4;
+          case 0xc: { // lpm (r0 implied)
+            uint16_t z = getPair(30);
+            uint16_t word = fetch(z >> 1);
+            data[0] = z & 1 ? word >> 8 : word;
+            return 3;
+          }
+          default: // sleep, break, wdr, spm and so on
+            return 1;
+          }
+        } else { // bset/bclr
+          bool set = !(opcode & 0x0080);
+          Flag flag = Flag(opcode >> 4 & 7);
+          if (set && flag == I && !getFlag(I)) {
+            interruptInhibited = true;
+          }
+          setFlag(flag, set);
+          return 1;
+        }
+      case 0x9: // ijmp/icall
+        if (opcode & 0x0100) {
+          pushPC(pc);
+          pc = getPair(30);
+          return 3;
+        }
+        pc = getPair(30);
+        return 2;
+      case 0xa: // dec
+        rd--;
+        setZNS(rd, rd == 0x7f);
+        return 1;
+      case 0xc:
+      case 0xd: // jmp
+      case 0xe:
+      case 0xf: { // call
+        uint16_t target = fetch(pc++);
+        if (opcode & 0x0002) {
+          pushPC(pc);
+          pc = target;
+          return 4;
+        }
+        pc = target;
+        return 3;
+      }
+      default:
+        return 1;
+      }
+    case 3: { // adiw/sbiw
+      uint8_t low = 24 + (opcode >> 3 & 6);
+      uint8_t k = (opcode & 0x0f) | (opcode >> 2 & 0x30);
+      uint16_t before = getPair(low);
+      uint16_t result;
+      bool v, c;
+      if (opcode & 0x0100) {
+        result = before - k;
+        v = (before & ~result) >> 15 & 1;
+        c = (result & ~before) >> 15 & 1;
+      } else {
+        result = before + k;
+        v = (~before & result) >> 15 & 1;
+        c = (~result & before) >> 15 & 1;
+      }
+      setPair(low, result);
+      setFlag(Z, result == 0);
+      setFlag(N, result >> 15);
+      setFlag(V, v);
+      setFlag(S, (result >> 15) ^ v);
+      setFlag(C, c);
+      return 2;
+    }
+    case 4:
+    case 5: { // cbi/sbic/sbi/sbis
+      uint16_t ioAddress = 0x20 + (opcode >> 3 & 0x1f);
+      uint8_t mask = 1 << (opcode & 7);
+      switch (opcode >> 8 & 3) {
+      case 0: // cbi
+        writeData(ioAddress, readData(ioAddress, cycle) & ~mask, cycle + 2);
+        return 2;
+      case 1: // sbic
+        return readData(ioAddress, cycle) & mask ? 1 : 1 + skip();
+      case 2: // sbi
+        writeData(ioAddress, readData(ioAddress, cycle) | mask, cycle + 2);
+        return 2;
+      default: // sbis
+        return readData(ioAddress, cycle) & mask ? 1 + skip() : 1;
+      }
+    }
+    default: // mul
+      multiply(rd * data[r5], false);
+      return 2;
+    }
+  }
+};
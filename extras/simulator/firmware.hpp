@@ -0,0 +1,108 @@
+#pragma once
+
+/*
+ * Loaders for the program memory image. Two formats are supported:
+ * - Intel HEX, which is what Arduino IDE produces with "Sketch > Export
+ *   compiled Binary";
+ * - the output of avr-objdump -dSz (such as disassembler-output.txt), which
+ *   only contains executable sections, and is thus fine for programs without
+ *   initialized data.
+ */
+
+#include <cstdint>
+#include <fstream>
+#include <regex>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+
+inline void storeFlashByte(
+  std::vector<uint16_t>& flash,
+  uint32_t address,
+  uint8_t value
+) {
+  if (address / 2 >= flash.size()) {
+    throw std::runtime_error("Address out of program memory bounds");
+  }
+  uint16_t& word = flash[address / 2];
+  word = address & 1
+    ? (word & 0x00ff) | value << 8
+    : (word & 0xff00) | value;
+}
+
+
+inline void loadIntelHex(std::istream& input, std::vector<uint16_t>& flash) {
+  std::string line;
+  uint32_t base = 0;
+  while (std::getline(input, line)) {
+    if (line.empty() || line[0] != ':') {
+      continue;
+    }
+    auto byteAt = [&](size_t index) {
+      return uint8_t(std::stoul(line.substr(1 + index * 2, 2), nullptr, 16));
+    };
+    uint8_t length = byteAt(0);
+    uint16_t offset = byteAt(1) << 8 | byteAt(2);
+    uint8_t type = byteAt(3);
+    if (type == 0) {
+      for (uint8_t i = 0; i < length; i++) {
+        storeFlashByte(flash, base + offset + i, byteAt(4 + i));
+      }
+    } else if (type == 1) {
+      break;
+    } else if (type == 2) {
+      base = (byteAt(4) << 8 | byteAt(5)) << 4;
+    } else if (type == 4) {
+      base = uint32_t(byteAt(4) << 8 | byteAt(5)) << 16;
+    }
+  }
+}
+
+
+inline void loadObjdumpListing(
+  std::istream& input,
+  std::vector<uint16_t>& flash
+) {
+  // e.g. "  cc:	20 93 c6 00 	sts	0x00C6, r18"
+  static const std::regex INSTRUCTION_LINE(
+    R"(^\s*([0-9a-f]+):\t((?:[0-9a-f]{2} )+))"
+  );
+  std::string line;
+  std::smatch match;
+  while (std::getline(input, line)) {
+    if (!std::regex_search(line, match, INSTRUCTION_LINE)) {
+      continue;
+    }
+    uint32_t address = std::stoul(match[1].str(), nullptr, 16);
+    std::string bytes = match[2].str();
+    for (size_t i = 0; i + 2 <= bytes.size(); i += 3) {
+      storeFlashByte(
+        flash,
+        address++,
+        std::stoul(bytes.substr(i, 2), nullptr, 16)
+      );
+    }
+  }
+}
+
+
+/**
+ * Loads a firmware image, guessing its format from the first character (Intel
+ * HEX records always start with a colon)
+ */
+inline void loadFirmware(
+  const std::string& path,
+  std::vector<uint16_t>& flash
+) {
+  std::ifstream input(path);
+  if (!input) {
+    throw std::runtime_error("Cannot open " + path);
+  }
+  int first = input.peek();
+  if (first == ':') {
+    loadIntelHex(input, flash);
+  } else {
+    loadObjdumpListing(input, flash);
+  }
+}
@@ -0,0 +1,287 @@
+#pragma once
+
+/*
+ * Decoder for the I2S signal traced by the simulator. It behaves like a
+ * receiver would (it only looks at the pins), then compares what it received
+ * against what the program tried to send.
+ */
+
+#include <cstdint>
+#include <vector>
+#include "atmega328p.hpp"
+
+
+/**
+ * A single bit, as sampled by a receiver on the rising edge of the bit clock
+ */
+struct SampledBit {
+  uint64_t cycle;
+  bool data;
+  bool wordSelect;
+};
+
+
+struct DecodedWord {
+  uint64_t firstBitCycle;
+  /**
+   * 0 for the left channel, 1 for the right one (or the slot index, in TDM
+   * mode)
+   */
+  uint8_t channel;
+  uint32_t value;
+};
+
+
+struct I2SReport {
+  uint32_t bits = 0;
+  std::vector<DecodedWord> words;
+  /**
+   * Pauses in the bit clock (the USART module ran out of data)
+   */
+  uint32_t bitClockGaps = 0;
+  uint64_t firstBitClockGapCycle = 0;
+  /**
+   * Word select edges which don't happen right before a word's LSB (measured
+   * from the start of the bitstream); in TDM mode, frame sync pulses which
+   * aren't sampled right before the first channel's MSB, or which last more
+   * than one bit
+   */
+  uint32_t wordSelectEdges = 0;
+  uint32_t misalignedWordSelectEdges = 0;
+  int16_t firstWordSelectMisalignment = 0;
+  /**
+   * Word select edges which don't happen on a falling edge of the bit clock
+   */
+  uint32_t skewedWordSelectEdges = 0;
+  bool firstWordIsLeft = true;
+  /**
+   * Comparison between the words sent by the program and the decoded ones
+   */
+  uint32_t expectedWords = 0;
+  uint32_t mismatchedWords = 0;
+  uint32_t firstMismatchedWord = 0;
+  /**
+   * If the words don't match, the bit offset (if any) which makes the
+   * received bitstream match the sent one
+   */
+  bool shiftDetected = false;
+  int8_t shift = 0;
+  uint32_t ignoredBufferWrites = 0;
+  uint64_t firstIgnoredBufferWriteCycle = 0;
+
+  bool isValid() const {
+    return bits && !bitClockGaps && !misalignedWordSelectEdges
+      && !skewedWordSelectEdges && firstWordIsLeft && !mismatchedWords
+      && !ignoredBufferWrites;
+  }
+};
+
+
+/**
+ * With more than 2 channels, the decoder expects a TDM stream: the channels'
+ * words are sent back to back, and word select carries a frame sync pulse,
+ * one bit long, sampled along with the last bit of each frame (see
+ * i2s_driver.hpp).
+ */
+class I2SDecoder {
+public:
+  I2SDecoder(
+    uint16_t fullBitPeriod,
+    uint8_t wordBits = 16,
+    uint8_t channels = 2
+  ) :
+    fullBitPeriod(fullBitPeriod),
+    wordBits(wordBits),
+    channels(channels)
+  {}
+
+  /**
+   * dataPin selects the data line to decode: TX_PIN for the USART module's,
+   * MISO_PIN for the SPI's (in which case bufferWrites are the SPDR writes)
+   */
+  I2SReport decode(
+    const std::vector<PinChange>& pinChanges,
+    const std::vector<BufferWrite>& bufferWrites,
+    uint8_t dataPin = ATmega328P::TX_PIN
+  ) const {
+    I2SReport report;
+    std::vector<SampledBit> bits;
+    std::vector<uint64_t> wordSelectEdgeCycles;
+    bool data = false, clock = false, wordSelect = false;
+    for (const PinChange& change : pinChanges) {
+      if (change.pin == dataPin) {
+        data = change.level;
+        continue;
+      }
+      switch (change.pin) {
+      case ATmega328P::XCK_PIN:
+        if (change.level && !clock) {
+          bits.push_back({change.cycle, data, wordSelect});
+        }
+        clock = change.level;
+        break;
+      case ATmega328P::OC0A_PIN:
+      case ATmega328P::OC1A_PIN:
+        wordSelect = change.level;
+        wordSelectEdgeCycles.push_back(change.cycle);
+        break;
+      }
+    }
+    report.bits = bits.size();
+    if (bits.empty()) {
+      return report;
+    }
+
+    for (size_t i = 1; i < bits.size(); i++) {
+      if (bits[i].cycle - bits[i - 1].cycle != fullBitPeriod) {
+        if (!report.bitClockGaps++) {
+          report.firstBitClockGapCycle = bits[i - 1].cycle;
+        }
+      }
+    }
+
+    report.firstWordIsLeft = !bits[0].wordSelect;
+    if (channels > 2) {
+      decodeTDMFrames(bits, report);
+    }
+    for (size_t i = 1; i < bits.size() && channels == 2; i++) {
+      if (bits[i].wordSelect == bits[i - 1].wordSelect) {
+        continue;
+      }
+      report.wordSelectEdges++;
+      // The new word select value is first sampled with the previous word's LSB
+      int16_t misalignment = (i + 1) % wordBits;
+      if (misalignment) {
+        if (misalignment > wordBits / 2) {
+          misalignment -= wordBits;
+        }
+        if (!report.misalignedWordSelectEdges++) {
+          report.firstWordSelectMisalignment = misalignment;
+        }
+      }
+      if (i + 1 >= wordBits) {
+        DecodedWord word{
+          bits[i + 1 - wordBits].cycle - fullBitPeriod / 2,
+          bits[i - 1].wordSelect,
+          0
+        };
+        for (size_t j = i + 1 - wordBits; j <= i; j++) {
+          word.value = word.value << 1 | bits[j].data;
+        }
+        report.words.push_back(word);
+      }
+    }
+    for (uint64_t edge : wordSelectEdgeCycles) {
+      if (edge < bits.front().cycle || edge > bits.back().cycle) {
+        continue;
+      }
+      // Falling edges happen half a period before each rising edge
+      uint64_t offset = (edge - bits.front().cycle + fullBitPeriod / 2)
+        % fullBitPeriod;
+      if (offset) {
+        report.skewedWordSelectEdges++;
+      }
+    }
+
+    std::vector<bool> sentBits;
+    for (const BufferWrite& write : bufferWrites) {
+      for (int8_t b = 7; b >= 0; b--) {
+        sentBits.push_back(write.value >> b & 1);
+      }
+      if (!write.accepted && !report.ignoredBufferWrites++) {
+        report.firstIgnoredBufferWriteCycle = write.cycle;
+      }
+    }
+    report.expectedWords = sentBits.size() / wordBits;
+    size_t firstDecodedWordBit = 0;
+    while (firstDecodedWordBit < bits.size() && !report.words.empty()
+           && bits[firstDecodedWordBit].cycle - fullBitPeriod / 2
+              != report.words.front().firstBitCycle) {
+      firstDecodedWordBit++;
+    }
+    // Without gaps, the n-th sampled bit is the n-th bit written to UDR0 (or
+    // SPDR)
+    size_t firstSentWord = firstDecodedWordBit / wordBits;
+    for (size_t w = 0; w < report.words.size(); w++) {
+      uint32_t expected = 0;
+      size_t start = (firstSentWord + w) * wordBits;
+      if (start + wordBits > sentBits.size()) {
+        break;
+      }
+      for (size_t j = start; j < start + wordBits; j++) {
+        expected = expected << 1 | sentBits[j];
+      }
+      if (expected != report.words[w].value && !report.mismatchedWords++) {
+        report.firstMismatchedWord = w;
+      }
+    }
+    if (report.mismatchedWords) {
+      detectShift(bits, sentBits, report);
+    }
+    return report;
+  }
+
+private:
+  uint16_t fullBitPeriod;
+  uint8_t wordBits;
+  uint8_t channels;
+
+  void decodeTDMFrames(
+    const std::vector<SampledBit>& bits,
+    I2SReport& report
+  ) const {
+    const size_t frameBits = size_t(channels) * wordBits;
+    for (size_t i = 0; i < bits.size(); i++) {
+      if (!bits[i].wordSelect) {
+        continue;
+      }
+      report.wordSelectEdges++;
+      // The pulse is sampled with the frame's last bit
+      int32_t misalignment = (i + 1) % frameBits;
+      if (misalignment > int32_t(frameBits / 2)) {
+        misalignment -= frameBits;
+      }
+      if (misalignment || (i && bits[i - 1].wordSelect)) {
+        if (!report.misalignedWordSelectEdges++) {
+          report.firstWordSelectMisalignment = misalignment;
+        }
+        continue;
+      }
+      if (i + 1 < frameBits) {
+        continue;
+      }
+      for (uint8_t channel = 0; channel < channels; channel++) {
+        size_t start = i + 1 - frameBits + size_t(channel) * wordBits;
+        DecodedWord word{bits[start].cycle - fullBitPeriod / 2, channel, 0};
+        for (size_t j = start; j < start + wordBits; j++) {
+          word.value = word.value << 1 | bits[j].data;
+        }
+        report.words.push_back(word);
+      }
+    }
+  }
+
+  void detectShift(
+    const std::vector<SampledBit>& bits,
+    const std::vector<bool>& sentBits,
+    I2SReport& report
+  ) const {
+    for (int8_t shift = -int8_t(wordBits); shift <= wordBits; shift++) {
+      size_t compared = 0;
+      bool matching = true;
+      for (size_t i = 0; i < bits.size() && matching; i++) {
+        int64_t j = int64_t(i) + shift;
+        if (j < 0 || size_t(j) >= sentBits.size()) {
+          continue;
+        }
+        matching = bits[i].data == sentBits[j];
+        compared++;
+      }
+      if (matching && compared >= 2u * wordBits) {
+        report.shiftDetected = true;
+        report.shift = shift;
+        return;
+      }
+    }
+  }
+};
@@ -0,0 +1,257 @@
+/*
+ * Runs the sketch on a simulated ATmega328P, records the I2S pins (PD4 as bit
+ * clock, PD1 as data, PD6 or PB1 as word select, depending on the timer, and
+ * PB4 as the secondary data line of DualStreamI2SDriver) and checks the
+ * resulting signal.
+ *
+ * The firmware can be either the Intel HEX file exported by Arduino IDE or
+ * the output of avr-objdump -dSz (e.g. disassembler-output.txt). See the
+ * README for build instructions.
+ */
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+#include "atmega328p.hpp"
+#include "firmware.hpp"
+#include "i2s_decoder.hpp"
+
+
+namespace {
+
+/**
+ * True for the instructions emitted by the functions in delay_in_cycles.hpp:
+ * nop, "rjmp .+0", lpm (implied r0 form) and the dec/sbiw + "brne .-4" loops
+ * generated by _delay_loop_1(), _delay_loop_2() and delayInCyclesWithAsmLoop()
+ */
+bool isIdleInstruction(
+  const ExecutedInstruction& executed,
+  const std::vector<uint16_t>& flash
+) {
+  constexpr uint16_t NOP = 0x0000, RJMP_NEXT = 0xc000, LPM = 0x95c8;
+  constexpr uint16_t BRNE_BACK_2 = 0xf7f1;
+  auto isCounterUpdate = [](uint16_t opcode) {
+    return (opcode & 0xfe0f) == 0x940a || (opcode & 0xff00) == 0x9700;
+  };
+  if (executed.interrupt) {
+    return false;
+  }
+  if (executed.opcode == NOP || executed.opcode == RJMP_NEXT
+      || executed.opcode == LPM) {
+    return true;
+  }
+  if (isCounterUpdate(executed.opcode)) {
+    return executed.nextOpcode == BRNE_BACK_2;
+  }
+  return executed.opcode == BRNE_BACK_2 && executed.address
+    && isCounterUpdate(flash[executed.address - 1]);
+}
+
+
+void writeVCD(
+  const std::string& path,
+  const std::vector<PinChange>& pinChanges,
+  uint32_t cpuFrequency
+) {
+  std::ofstream output(path);
+  output << "$timescale 1 ps $end\n"
+    << "$scope module atmega328p $end\n"
+    << "$var wire 1 s sck $end\n"
+    << "$var wire 1 d sd $end\n"
+    << "$var wire 1 w ws $end\n"
+    << "$var wire 1 m sd2 $end\n"
+    << "$upscope $end\n"
+    << "$enddefinitions $end\n"
+    << "#0\n0s\n0d\n0w\n0m\n";
+  const uint64_t picosecondsPerCycle = 1000000000000ull / cpuFrequency;
+  for (const PinChange& change : pinChanges) {
+    char id = change.pin == ATmega328P::XCK_PIN ? 's'
+      : change.pin == ATmega328P::TX_PIN ? 'd'
+      : change.pin == ATmega328P::MISO_PIN ? 'm' : 'w';
+    output << '#' << change.cycle * picosecondsPerCycle << '\n'
+      << change.level << id << '\n';
+  }
+}
+
+
+void printDecodedWords(const char* label, const I2SReport& report) {
+  std::printf("%s%zu of %u sent (%u mismatched", label, report.words.size(),
+              report.expectedWords, report.mismatchedWords);
+  if (report.mismatchedWords) {
+    std::printf(", first is #%u", report.firstMismatchedWord);
+    if (report.shiftDetected) {
+      std::printf(", bitstream shifted by %+d bits", report.shift);
+    }
+  }
+  std::printf(")\n");
+}
+
+
+int usage(const char* program) {
+  std::fprintf(
+    stderr,
+    "Usage: %s [--cycles N] [--channels N] [--word-bits N] [--vcd FILE]"
+    " [--f-cpu HZ] FIRMWARE\n"
+    "  FIRMWARE   Intel HEX file or avr-objdump -dSz output\n"
+    "  --cycles   number of CPU cycles to simulate (default 1000000)\n"
+    "  --channels channels per frame (default 2; more means TDM, with a"
+    " frame sync pulse\n"
+    "             instead of word select)\n"
+    "  --word-bits bits per sample: 16 (default), 24 or 32\n"
+    "  --vcd      also dump the traced pins to a VCD file\n"
+    "  --f-cpu    CPU frequency, only used for VCD timestamps"
+    " (default 16000000)\n",
+    program
+  );
+  return 2;
+}
+
+}
+
+
+int main(int argc, char** argv) {
+  uint64_t cycles = 1000000;
+  uint32_t cpuFrequency = 16000000;
+  unsigned long channels = 2;
+  unsigned long wordBits = 16;
+  std::string vcdPath, firmwarePath;
+  for (int i = 1; i < argc; i++) {
+    if (!std::strcmp(argv[i], "--cycles") && i + 1 < argc) {
+      cycles = std::strtoull(argv[++i], nullptr, 0);
+    } else if (!std::strcmp(argv[i], "--channels") && i + 1 < argc) {
+      channels = std::strtoul(argv[++i], nullptr, 0);
+    } else if (!std::strcmp(argv[i], "--word-bits") && i + 1 < argc) {
+      wordBits = std::strtoul(argv[++i], nullptr, 0);
+    } else if (!std::strcmp(argv[i], "--vcd") && i + 1 < argc) {
+      vcdPath = argv[++i];
+    } else if (!std::strcmp(argv[i], "--f-cpu") && i + 1 < argc) {
+      cpuFrequency = std::strtoul(argv[++i], nullptr, 0);
+    } else if (argv[i][0] == '-' || !firmwarePath.empty()) {
+      return usage(argv[0]);
+    } else {
+      firmwarePath = argv[i];
+    }
+  }
+  if (firmwarePath.empty() || channels < 2 || channels > 255
+      || (wordBits != 16 && wordBits != 24 && wordBits != 32)) {
+    return usage(argv[0]);
+  }
+
+  ATmega328P mcu;
+  try {
+    loadFirmware(firmwarePath, mcu.cpu.flash);
+  } catch (const std::exception& e) {
+    std::fprintf(stderr, "%s\n", e.what());
+    return 2;
+  }
+
+  std::vector<std::pair<uint64_t, uint8_t>> idleInstructions;
+  while (mcu.cpu.cycle < cycles && !mcu.cpu.halted) {
+    uint64_t start = mcu.cpu.cycle;
+    ExecutedInstruction executed = mcu.cpu.step();
+    if (isIdleInstruction(executed, mcu.cpu.flash)) {
+      idleInstructions.emplace_back(start, executed.cycles);
+    }
+  }
+  mcu.advanceTo(mcu.cpu.cycle);
+  if (!vcdPath.empty()) {
+    writeVCD(vcdPath, mcu.pinChanges, cpuFrequency);
+  }
+
+  const uint16_t fullBitPeriod = mcu.getFullBitPeriod();
+  I2SDecoder decoder(fullBitPeriod, wordBits, channels);
+  I2SReport report = decoder.decode(mcu.pinChanges, mcu.bufferWrites);
+
+  std::printf("simulated cycles:        %llu%s\n",
+              (unsigned long long) mcu.cpu.cycle,
+              mcu.cpu.halted ? " (program halted)" : "");
+  std::printf("bit period:              %u cycles\n", fullBitPeriod);
+  std::printf("bits received:           %u\n", report.bits);
+  std::printf("bit clock gaps:          %u", report.bitClockGaps);
+  if (report.bitClockGaps) {
+    std::printf(" (first after cycle %llu)",
+                (unsigned long long) report.firstBitClockGapCycle);
+  }
+  std::printf("\nignored UDR0 writes:     %u", report.ignoredBufferWrites);
+  if (report.ignoredBufferWrites) {
+    std::printf(" (first at cycle %llu)",
+                (unsigned long long) report.firstIgnoredBufferWriteCycle);
+  }
+  std::printf(channels > 2 ? "\nfirst word on slot 0:    %s\n"
+              : "\nfirst word on left:      %s\n",
+              report.firstWordIsLeft ? "yes" : "NO");
+  std::printf(channels > 2 ? "frame sync pulses:       %u (%u misaligned"
+              : "word select edges:       %u (%u misaligned",
+              report.wordSelectEdges, report.misalignedWordSelectEdges);
+  if (report.misalignedWordSelectEdges) {
+    std::printf(", first by %+d bits", report.firstWordSelectMisalignment);
+  }
+  std::printf(", %u off the bit clock's falling edge)\n",
+              report.skewedWordSelectEdges);
+  printDecodedWords("words decoded:           ", report);
+
+  /*
+   * The secondary data line (see dual_stream_i2s_driver.hpp) shares the bit
+   * clock and word select, so only its data needs to be checked.
+   */
+  bool valid = report.isValid();
+  if (!mcu.spiWrites.empty()) {
+    I2SReport secondary = decoder.decode(
+      mcu.pinChanges,
+      mcu.spiWrites,
+      ATmega328P::MISO_PIN
+    );
+    std::printf("ignored SPDR writes:     %u", secondary.ignoredBufferWrites);
+    if (secondary.ignoredBufferWrites) {
+      std::printf(" (first at cycle %llu)",
+                  (unsigned long long) secondary.firstIgnoredBufferWriteCycle);
+    }
+    std::printf("\n");
+    printDecodedWords("secondary words:         ", secondary);
+    valid = valid && !secondary.words.empty() && !secondary.mismatchedWords
+      && !secondary.ignoredBufferWrites;
+  }
+
+  /*
+   * Frames start with the MSB of each left (or slot 0) sample; only complete
+   * frames are taken into account.
+   */
+  std::vector<uint64_t> frameStarts;
+  for (const DecodedWord& word : report.words) {
+    if (!word.channel) {
+      frameStarts.push_back(word.firstBitCycle);
+    }
+  }
+  if (frameStarts.size() >= 2) {
+    uint32_t minimum = UINT32_MAX, maximum = 0;
+    uint64_t total = 0;
+    auto idle = idleInstructions.begin();
+    for (size_t f = 0; f + 1 < frameStarts.size(); f++) {
+      uint32_t frameIdle = 0;
+      while (idle != idleInstructions.end() && idle->first < frameStarts[f]) {
+        idle++;
+      }
+      while (idle != idleInstructions.end()
+             && idle->first < frameStarts[f + 1]) {
+        frameIdle += idle->second;
+        idle++;
+      }
+      minimum = std::min(minimum, frameIdle);
+      maximum = std::max(maximum, frameIdle);
+      total += frameIdle;
+    }
+    size_t frames = frameStarts.size() - 1;
+    std::printf("frame period:            %llu cycles\n",
+                (unsigned long long) (frameStarts[1] - frameStarts[0]));
+    std::printf("idle cycles per frame:   min %u, avg %.1f, max %u"
+                " (over %zu frames)\n",
+                minimum, double(total) / frames, maximum, frames);
+  }
+
+  std::printf("result:                  %s\n", valid ? "OK" : "BROKEN");
+  return valid ? 0 : 1;
+}
@@ -0,0 +1,384 @@
+#pragma once
+
+/*
+ * Generators go straight to the driver, with no processing in between. This
+ * header provides filter stages, which wrap a generator (or a Mixer, or
+ * another filter) and behave like one, with a fixed, known duration: a cheap
+ * one-pole low-pass, e.g. to soften a square wave's edges and the aliasing
+ * that comes with them, and a general-purpose biquad.
+ *
+ * The filters' durations were counted from the instructions they need, not
+ * measured on a listing yet.
+ */
+
+#include <stdint.h>
+
+
+/**
+ * Computes OnePoleLowPass's coefficient for the given cutoff frequency (in
+ * Hz), at the sample rate F_CPU / frameCycles; the result is clamped between
+ * 1 and 255. When the arguments are constants, so is the result.
+ *
+ * The exact coefficient would be 1 - e^(-w), w being the cutoff's angular
+ * frequency divided by the sample rate; w / (1 + w) is a close approximation
+ * which doesn't need an exponential.
+ */
+constexpr uint8_t GET_ONE_POLE_COEFFICIENT(
+  const uint16_t frameCycles,
+  const uint32_t cutoffFrequency
+) {
+  const double w = 2 * 3.14159265358979 * cutoffFrequency * frameCycles / F_CPU;
+  const double coefficient = 256 * w / (1 + w) + 0.5;
+  return coefficient < 1 ? 1 : coefficient > 255 ? 255 : uint8_t(coefficient);
+}
+
+
+/**
+ * One-pole low-pass filter (6 dB per octave), i.e. an exponential moving
+ * average of the source's samples:
+ *   y += (x - y) * coefficient / 256
+ * where coefficient (between 1 and 255, see GET_ONE_POLE_COEFFICIENT()) sets
+ * the cutoff frequency: the lower, the darker the sound.
+ *
+ * Source must provide getNextSample() and GET_NEXT_SAMPLE_DURATION; the filter
+ * only holds a reference to it, and its own GET_NEXT_SAMPLE_DURATION includes
+ * the source's one, so it can be used wherever the source could:
+ *   OnePoleLowPass filter(
+ *     square,
+ *     GET_ONE_POLE_COEFFICIENT(Driver::FRAME_PERIOD, 2000)
+ *   );
+ *   workItem<filter.GET_NEXT_SAMPLE_DURATION>([&] {
+ *     sample = filter.getNextSample();
+ *   })
+ *
+ * Some technical considerations.
+ *
+ * Both x and y are halved before the subtraction, so the difference always
+ * fits in 16 bits (y never leaves the range of the source's samples); the
+ * product is then doubled back. The multiplication is split between the
+ * difference's two bytes, like WavetableGenerator's multiplyAndShift(), so the
+ * hardware multiplier does it with a mulsu and a mul, and there are no
+ * branches at all.
+ *
+ * Since the product is truncated, y settles up to about 512 / coefficient
+ * steps below a constant input; that's inaudible, and it can't accumulate.
+ *
+ * FILTER_DURATION counts the filter's state as living in SRAM, like
+ * BiquadFilter's one:
+ * - loading y and coefficient (3 lds, 6 cycles);
+ * - halving x and y (5 cycles, including a copy of y);
+ * - subtraction (2 cycles);
+ * - multiplication by coefficient (9 cycles);
+ * - doubling and accumulation (4 cycles);
+ * - storing y back (2 sts, 4 cycles).
+ */
+template<typename Source>
+class OnePoleLowPass {
+private:
+  Source& source;
+  int16_t y;
+  uint8_t coefficient;
+
+public:
+  /**
+   * The number of CPU cycles required by the filter itself
+   */
+  static constexpr uint8_t FILTER_DURATION = 30;
+  /**
+   * The number of CPU cycles required to run getNextSample()
+   */
+  static constexpr uint16_t GET_NEXT_SAMPLE_DURATION =
+    Source::GET_NEXT_SAMPLE_DURATION + FILTER_DURATION;
+
+  OnePoleLowPass(Source& source, uint8_t coefficient) :
+    source(source),
+    y(0),
+    coefficient(coefficient)
+  {}
+
+  void setCoefficient(uint8_t value) {
+    coefficient = value;
+  }
+
+  int16_t getFirstSample() {
+    return 0;
+  }
+
+  int16_t getNextSample() {
+    const int16_t x = source.getNextSample();
+    const int16_t difference = (x >> 1) - (y >> 1);
+    const int16_t high = int8_t(difference >> 8) * coefficient;
+    const uint8_t low = (uint8_t(difference) * coefficient) >> 8;
+    y += uint16_t(high + low) << 1;
+    return y;
+  }
+};
+
+
+/**
+ * The coefficients of a BiquadFilter, as Q1.14 fixed-point numbers (i.e. the
+ * real coefficient multiplied by 16384, so they range from -2 to about 2),
+ * already normalized by a0:
+ *   y[n] = b0 x[n] + b1 x[n-1] + b2 x[n-2] - a1 y[n-1] - a2 y[n-2]
+ */
+struct BiquadCoefficients {
+  int16_t b0;
+  int16_t b1;
+  int16_t b2;
+  int16_t a1;
+  int16_t a2;
+};
+
+
+/**
+ * The kinds of filters GET_BIQUAD_COEFFICIENTS() can design
+ */
+enum class BiquadType : uint8_t {
+  LOW_PASS,
+  HIGH_PASS,
+  BAND_PASS
+};
+
+
+/**
+ * Sine and cosine of x, between 0 and pi, as Taylor series (there's no
+ * constexpr math library); used at compile time only
+ */
+constexpr double GET_BIQUAD_SINE(const double x) {
+  double term = x;
+  double sum = x;
+  for (uint8_t i = 1; i < 12; i++) {
+    term = -term * x * x / ((2 * i) * (2 * i + 1));
+    sum += term;
+  }
+  return sum;
+}
+
+constexpr double GET_BIQUAD_COSINE(const double x) {
+  double term = 1;
+  double sum = 1;
+  for (uint8_t i = 1; i < 12; i++) {
+    term = -term * x * x / ((2 * i - 1) * (2 * i));
+    sum += term;
+  }
+  return sum;
+}
+
+constexpr int16_t GET_BIQUAD_Q14(const double value) {
+  const double scaled = value * 16384 + (value < 0 ? -0.5 : 0.5);
+  // -32768 is avoided, so that BiquadFilter can negate any coefficient
+  return scaled < -32767 ? -32767 : scaled > 32767 ? 32767 : int16_t(scaled);
+}
+
+
+/**
+ * Designs a biquad filter (the formulas are the usual ones from Robert
+ * Bristow-Johnson's "Audio EQ Cookbook"), given its type, its cutoff (or
+ * center) frequency in Hz, which must be lower than half the sample rate
+ * F_CPU / frameCycles, and its Q in hundredths (71 for a Butterworth
+ * response, higher values give a resonant peak). When the arguments are
+ * constants, so is the result.
+ *
+ * With Q1.14 coefficients, cutoffs below about 1% of the sample rate lose
+ * most of their precision (b0 gets rounded to a few units); use
+ * OnePoleLowPass there.
+ */
+constexpr BiquadCoefficients GET_BIQUAD_COEFFICIENTS(
+  const uint16_t frameCycles,
+  const BiquadType type,
+  const uint32_t frequency,
+  const uint16_t qHundredths = 71
+) {
+  const double w = 2 * 3.14159265358979 * frequency * frameCycles / F_CPU;
+  const double cosine = GET_BIQUAD_COSINE(w);
+  const double alpha = GET_BIQUAD_SINE(w) * 50 / qHundredths;
+  const double a0 = 1 + alpha;
+  double b0 = 0;
+  double b1 = 0;
+  if (type == BiquadType::LOW_PASS) {
+    b0 = (1 - cosine) / 2;
+    b1 = 1 - cosine;
+  } else if (type == BiquadType::HIGH_PASS) {
+    b0 = (1 + cosine) / 2;
+    b1 = -(1 + cosine);
+  } else {
+    // Peak gain of 1 (0 dB)
+    b0 = alpha;
+  }
+  const double b2 = type == BiquadType::BAND_PASS ? -alpha : b0;
+  return {
+    GET_BIQUAD_Q14(b0 / a0),
+    GET_BIQUAD_Q14(b1 / a0),
+    GET_BIQUAD_Q14(b2 / a0),
+    GET_BIQUAD_Q14(-2 * cosine / a0),
+    GET_BIQUAD_Q14((1 - alpha) / a0)
+  };
+}
+
+
+/**
+ * Biquad (second order IIR) filter, in direct form I, with Q1.14 coefficients
+ * (see BiquadCoefficients and GET_BIQUAD_COEFFICIENTS()) and a 32-bit
+ * accumulator.
+ *
+ * Source works like in OnePoleLowPass:
+ *   BiquadFilter filter(
+ *     mixer,
+ *     GET_BIQUAD_COEFFICIENTS(Driver::FRAME_PERIOD, BiquadType::LOW_PASS, 3000)
+ *   );
+ *
+ * The output is not saturated: when the filter's gain exceeds 1 at some
+ * frequency (e.g. a resonant low-pass, whose peak gain is about Q), the
+ * source must leave enough headroom, or the output wraps around.
+ *
+ * Some technical considerations.
+ *
+ * Each of the five products is a signed 16x16-bit multiplication accumulated
+ * into 32 bits, which takes four hardware multiplications (muls, mul and two
+ * mulsu, whose carry gives the sign extension of the cross products), as in
+ * Atmel's AVR201 application note; on AVR targets, it's written in inline
+ * assembly, so that it takes exactly MULTIPLY_ACCUMULATE_DURATION cycles no
+ * matter the compiler's choices. a1 and a2 are stored negated, so that every
+ * product is added. The accumulator starts from 2^13, so that the final
+ * shift by 14 bits rounds to the nearest integer.
+ *
+ * FILTER_DURATION adds up these steps:
+ * - five multiply-accumulate blocks (5 * 24 cycles);
+ * - loading the coefficients and the state from SRAM (36 cycles), and
+ *   storing the state back (16 cycles);
+ * - accumulator initialization (4 cycles);
+ * - shift by 14 bits, i.e. by 2 bits to the left, keeping the upper two
+ *   bytes (6 cycles);
+ * - register copies (4 cycles).
+ * extras/host/multiply_accumulate_test.cpp runs the multiply-accumulate
+ * block on the simulated CPU, and checks both its duration and its result
+ * against the C++ version.
+ *
+ * At 186 cycles, a biquad doesn't fit in a frame slot with the default
+ * timings (HALF_BIT_PERIOD = 5 leaves 153 cycles to the first slot, and 155
+ * to the second one): it needs HALF_BIT_PERIOD to be at least 7 (217 cycles
+ * for the first slot, i.e. 31 for the source), which limits the sample rate
+ * to about 35.7 kHz. Timer 0 can generate word select up to HALF_BIT_PERIOD =
+ * 8; beyond that (e.g. for a more expensive source), word select must come
+ * from timer 1. Checking the budget next to the driver's declaration gives a
+ * clearer error than the one from runFrameLoop():
+ *   using Driver = I2SDriver<7, 5, WordSelectTimer::TIMER_1>;
+ *   using Square = SquareWaveGenerator<Driver::FRAME_PERIOD>;
+ *   static_assert(
+ *     BiquadFilter<Square>::GET_NEXT_SAMPLE_DURATION
+ *       <= FrameScheduler<Driver>::GET_SLOT_BUDGET(0),
+ *     "The filter doesn't fit in the first slot!"
+ *   );
+ */
+template<typename Source>
+class BiquadFilter {
+private:
+  Source& source;
+  int16_t b0;
+  int16_t b1;
+  int16_t b2;
+  int16_t negatedA1;
+  int16_t negatedA2;
+  int16_t x1;
+  int16_t x2;
+  int16_t y1;
+  int16_t y2;
+
+public:
+  /**
+   * The number of CPU cycles required by multiplyAccumulate()
+   */
+  static constexpr uint8_t MULTIPLY_ACCUMULATE_DURATION = 24;
+  /**
+   * The number of CPU cycles required by the filter itself
+   */
+  static constexpr uint8_t FILTER_DURATION =
+    5 * MULTIPLY_ACCUMULATE_DURATION + 66;
+  /**
+   * The number of CPU cycles required to run getNextSample()
+   */
+  static constexpr uint16_t GET_NEXT_SAMPLE_DURATION =
+    Source::GET_NEXT_SAMPLE_DURATION + FILTER_DURATION;
+
+  /**
+   * Adds a * b to sum
+   */
+  static void multiplyAccumulate(
+    int32_t& sum,
+    const int16_t a,
+    const int16_t b
+  ) {
+#ifdef __AVR__
+    uint8_t zero;
+    asm(
+      "clr %[zero]\n\t"
+      "muls %B[a], %B[b]\n\t"
+      "add %C[sum], r0\n\t"
+      "adc %D[sum], r1\n\t"
+      "mul %A[a], %A[b]\n\t"
+      "add %A[sum], r0\n\t"
+      "adc %B[sum], r1\n\t"
+      "adc %C[sum], %[zero]\n\t"
+      "adc %D[sum], %[zero]\n\t"
+      "mulsu %B[a], %A[b]\n\t"
+      "sbc %D[sum], %[zero]\n\t"
+      "add %B[sum], r0\n\t"
+      "adc %C[sum], r1\n\t"
+      "adc %D[sum], %[zero]\n\t"
+      "mulsu %B[b], %A[a]\n\t"
+      "sbc %D[sum], %[zero]\n\t"
+      "add %B[sum], r0\n\t"
+      "adc %C[sum], r1\n\t"
+      "adc %D[sum], %[zero]\n\t"
+      "clr __zero_reg__"
+      : [sum] "+r" (sum), [zero] "=&r" (zero)
+      : [a] "a" (a), [b] "a" (b)
+      : "r0"
+    );
+#else
+    sum += int32_t(a) * b;
+#endif
+  }
+
+  BiquadFilter(Source& source, const BiquadCoefficients& coefficients) :
+    source(source),
+    x1(0),
+    x2(0),
+    y1(0),
+    y2(0)
+  {
+    setCoefficients(coefficients);
+  }
+
+  /**
+   * Changes the filter's response; the state is kept, so a sweep doesn't
+   * restart the filter (large jumps may still click)
+   */
+  void setCoefficients(const BiquadCoefficients& coefficients) {
+    b0 = coefficients.b0;
+    b1 = coefficients.b1;
+    b2 = coefficients.b2;
+    negatedA1 = -coefficients.a1;
+    negatedA2 = -coefficients.a2;
+  }
+
+  int16_t getFirstSample() {
+    return 0;
+  }
+
+  int16_t getNextSample() {
+    const int16_t x = source.getNextSample();
+    int32_t sum = int32_t(1) << 13;
+    multiplyAccumulate(sum, b0, x);
+    multiplyAccumulate(sum, b1, x1);
+    multiplyAccumulate(sum, b2, x2);
+    multiplyAccumulate(sum, negatedA1, y1);
+    multiplyAccumulate(sum, negatedA2, y2);
+    const int16_t y = uint32_t(sum) << 2 >> 16;
+    x2 = x1;
+    x1 = x;
+    y2 = y1;
+    y1 = y;
+    return y;
+  }
+};
@@ -0,0 +1,652 @@
+#pragma once
+
+/*
+ * Filling the time between two sendSample() invocations by hand is tedious:
+ * every piece of code needs a known duration, and the delays must be updated
+ * every time something changes. This header provides a compile-time scheduler
+ * which does the cycle counting on behalf of the caller, runFrameLoop().
+ */
+
+#include "delay_in_cycles.hpp"
+#include "type_traits_clone.hpp"
+
+
+/**
+ * The channel whose sample is computed by a work item, which determines the
+ * frame slot the item must run in:
+ * - ANY, the item can run in either slot (e.g. it computes a sample sent to
+ *   both channels, or something which is not a sample at all);
+ * - LEFT, the item must run before the left sample is sent (first slot);
+ * - RIGHT, the item must run after the left sample is sent and before the
+ *   right one is (second slot).
+ * In TDM mode, channels are numbered, and each one has its own slot (see
+ * GET_TDM_CHANNEL()); LEFT and RIGHT are channels 0 and 1.
+ */
+enum class Channel : uint8_t {
+  ANY,
+  LEFT,
+  RIGHT
+};
+
+
+constexpr Channel GET_TDM_CHANNEL(const uint8_t index) {
+  return Channel(index + 1);
+}
+
+
+/**
+ * Template class which wraps a piece of code (usually a lambda) together with
+ * the number of CPU cycles it takes to run.
+ *
+ * Template parameters:
+ * - DURATION, the number of CPU cycles needed by the wrapped code (e.g.
+ *   GET_NEXT_SAMPLE_DURATION for a call to getNextSample());
+ * - Function, the type of the wrapped code (no arguments, result ignored);
+ * - CHANNEL, the channel the item computes a sample for (see Channel).
+ *
+ * Instances are usually created via workItem(), leftChannelWorkItem(),
+ * rightChannelWorkItem() or tdmChannelWorkItem(), which deduce Function.
+ */
+template<
+  uint16_t DURATION_IN_CYCLES,
+  typename Function,
+  Channel ITEM_CHANNEL = Channel::ANY
+>
+struct WorkItem {
+  static constexpr uint16_t DURATION = DURATION_IN_CYCLES;
+  static constexpr Channel CHANNEL = ITEM_CHANNEL;
+  Function function;
+
+  void run() {
+    function();
+  }
+};
+
+
+template<uint16_t DURATION, typename Function>
+inline WorkItem<DURATION, Function> workItem(Function function) {
+  return {function};
+}
+
+
+template<uint16_t DURATION, typename Function>
+inline WorkItem<DURATION, Function, Channel::LEFT> leftChannelWorkItem(
+  Function function
+) {
+  return {function};
+}
+
+
+template<uint16_t DURATION, typename Function>
+inline WorkItem<DURATION, Function, Channel::RIGHT> rightChannelWorkItem(
+  Function function
+) {
+  return {function};
+}
+
+
+template<uint16_t DURATION, uint8_t CHANNEL_INDEX, typename Function>
+inline WorkItem<DURATION, Function, GET_TDM_CHANNEL(CHANNEL_INDEX)>
+tdmChannelWorkItem(Function function) {
+  return {function};
+}
+
+
+/**
+ * The timing constraints of the driver's deferred write, if any, i.e. the
+ * bytes which can't be written by sendSample() itself: the secondary sample's
+ * low byte (see DualStreamI2SDriver), or the low bytes of 24 and 32-bit
+ * samples (see I2SDriver). In each slot, the write must start exactly
+ * SLOT_OFFSET cycles after the slot does, and it takes DURATION cycles. Drivers
+ * sending 16-bit samples on a single stream don't have any constraint.
+ */
+template<typename Driver, typename = void>
+struct DeferredWriteTiming {
+  static constexpr bool ENABLED = false;
+  static constexpr bool SECONDARY_STREAM = false;
+  static constexpr uint16_t SLOT_OFFSET = 0;
+  static constexpr uint8_t DURATION = 0;
+
+  static void write(Driver&) {}
+};
+
+
+template<typename Driver>
+struct DeferredWriteTiming<
+  Driver,
+  void_t<decltype(Driver::SECONDARY_LOW_BYTE_WRITE_OFFSET)>
+> {
+  static constexpr bool ENABLED = true;
+  static constexpr bool SECONDARY_STREAM = true;
+  static constexpr uint16_t SLOT_OFFSET =
+    Driver::SECONDARY_LOW_BYTE_WRITE_OFFSET - Driver::SEND_SAMPLE_DURATION;
+  static constexpr uint8_t DURATION = Driver::SEND_SECONDARY_LOW_BYTE_DURATION;
+
+  static void write(Driver& driver) {
+    driver.sendSecondaryLowByte();
+  }
+};
+
+
+template<typename Driver>
+struct DeferredWriteTiming<
+  Driver,
+  enable_if_t<(Driver::SAMPLE_BITS > 16)>
+> {
+  static constexpr bool ENABLED = true;
+  static constexpr bool SECONDARY_STREAM = false;
+  static constexpr uint16_t SLOT_OFFSET =
+    Driver::LOW_BYTES_WRITE_OFFSET - Driver::SEND_SAMPLE_DURATION;
+  static constexpr uint8_t DURATION = Driver::SEND_LOW_BYTES_DURATION;
+
+  static void write(Driver& driver) {
+    driver.sendSampleLowBytes();
+  }
+};
+
+
+/**
+ * The driver's timing checks (see I2SDriver's TIMING_CHECKS), if enabled: they
+ * run at the start of TIMING_CHECK_SLOT (i.e. right after the first channel's
+ * sample is sent) and take DURATION cycles. Drivers without them (including
+ * DualStreamI2SDriver) don't need anything.
+ */
+template<typename Driver, typename = void>
+struct TimingCheck {
+  static constexpr uint8_t DURATION = 0;
+
+  static void run(Driver&) {}
+};
+
+
+template<typename Driver>
+struct TimingCheck<Driver, enable_if_t<Driver::INSTRUMENTED>> {
+  static constexpr uint8_t DURATION = Driver::CHECK_TIMING_DURATION;
+
+  static void run(Driver& driver) {
+    driver.checkTiming();
+  }
+};
+
+
+constexpr uint8_t TIMING_CHECK_SLOT = 1;
+
+
+/**
+ * Template class which runs the driver's main loop, placing a list of work
+ * items around the sendSample() invocations and filling the remaining time
+ * with exact delays.
+ *
+ * Template parameters:
+ * - Driver, the I2SDriver (or DualStreamI2SDriver) instance whose constants
+ *   define the cycle budget;
+ * - WorkItems, the types of the work items (see WorkItem).
+ *
+ * Each frame contains two slots, one after each sendSample() invocation, and
+ * each slot lasts SAMPLE_PERIOD - SEND_SAMPLE_DURATION cycles. It's easier to
+ * picture the frame as starting right after the right sample has been sent:
+ * - the first slot runs before the next left sample is sent;
+ * - the second slot runs before the next right sample is sent.
+ * Work items bound to a channel (see Channel) always run in the respective
+ * slot. The other ones are packed into the first slot, in the given order, as
+ * long as they fit (next to the LEFT items); the remaining ones are placed
+ * into the second slot. Within each slot, work items run in the given order.
+ * If the work items don't fit in both slots, compilation fails.
+ *
+ * In TDM mode, there's one slot per channel (the N-th slot runs before the
+ * N-th channel's sample is sent), and unbound work items spill over from
+ * each slot to the next one in the same way. The loop is started by
+ * runTDMFrameLoop(), which takes the samples as an array.
+ *
+ * For a mono signal, a single ANY item does the job. For a stereo signal,
+ * binding each channel's generator to its channel means the right sample is
+ * computed while the left one is being transmitted, and vice versa, so each
+ * channel gets a whole slot without adding any cycles to the frame:
+ *   runFrameLoop(
+ *     driver,
+ *     left,
+ *     right,
+ *     leftChannelWorkItem<leftGenerator.GET_NEXT_SAMPLE_DURATION>([&] {
+ *       left = leftGenerator.getNextSample();
+ *     }),
+ *     rightChannelWorkItem<rightGenerator.GET_NEXT_SAMPLE_DURATION>([&] {
+ *       right = rightGenerator.getNextSample();
+ *     })
+ *   );
+ * The right sample computed during the second slot is sent right away, while
+ * the left one computed during the first slot is sent at the start of the
+ * next frame; both channels are thus computed exactly once per frame, and the
+ * right one lags half a frame behind, just like the I2S transmission itself.
+ *
+ * With a DualStreamI2SDriver, the loop is started by
+ * runDualStreamFrameLoop() instead, which also sends the secondary samples.
+ * Each slot then contains a sendSecondaryLowByte() invocation on a fixed
+ * cycle (roughly halfway through the slot): work items still run in the same
+ * order, and the write is placed before the first work item which would end
+ * past that cycle, after an exact delay. Work items are never split, so the
+ * delay can waste some cycles, which are accounted for when checking the
+ * budget. With 24 and 32-bit samples, sendSampleLowBytes() is placed the same
+ * way (16 bits into each sample), and samples are int32_t.
+ *
+ * With a driver's timing checks enabled, checkTiming() runs at the start of
+ * the second slot, before any work item, and its duration is taken from that
+ * slot's budget.
+ *
+ * Some technical considerations.
+ *
+ * The durations are simply added, which assumes the compiler doesn't
+ * interleave instructions belonging to different work items (or to the
+ * delays). This is the same assumption main() has always relied upon.
+ *
+ * The first slot also accounts for the jump back to the start of the loop
+ * (LOOP_JUMP_DURATION), which the work items' durations don't include. Since
+ * that slot ends the loop's iteration, its idle delay runs before its work
+ * items (right after the deferred write, if any), rather than after them: the
+ * last work item is then followed by the jump itself, like the generator in
+ * disassembler-output.txt, where the compiler copies the jump at the end of
+ * both arms of the generator's last branch. Placing the delay after the work
+ * items would make those arms join before the delay instead, which usually
+ * takes a jump in one arm only.
+ *
+ * The idle cycles are spent in delayInCyclesWithAsmLoop(), whose loop counter
+ * is loaded inside the assembly statement: its duration doesn't depend on
+ * where the compiler chooses to load constants, and it only takes a few words
+ * no matter how much of the frame is left.
+ */
+template<typename Driver, typename... WorkItems>
+class FrameScheduler {
+public:
+  /**
+   * The number of CPU cycles required to jump back to the start of the loop
+   * (a single rjmp, not included in the work items' durations)
+   */
+  static constexpr uint8_t LOOP_JUMP_DURATION = 2;
+
+  /**
+   * Returns the number of CPU cycles available to the work items of the given
+   * slot (the N-th slot runs before the N-th channel's sample is sent)
+   */
+  static constexpr uint16_t GET_SLOT_BUDGET(const uint8_t slot) {
+    return
+      Driver::SAMPLE_PERIOD
+      - Driver::SEND_SAMPLE_DURATION
+      - (slot ? 0 : LOOP_JUMP_DURATION);
+  }
+
+private:
+  static constexpr uint16_t DURATIONS[] = {WorkItems::DURATION..., 0};
+  static constexpr Channel CHANNELS[] = {WorkItems::CHANNEL..., Channel::ANY};
+  static constexpr uint8_t WORK_ITEMS_COUNT = sizeof...(WorkItems);
+  static constexpr uint8_t SLOTS_COUNT = Driver::CHANNELS;
+  static constexpr uint8_t UNASSIGNED_SLOT = 0xff;
+
+  using Sample = typename Driver::Sample;
+  using DeferredWrite = DeferredWriteTiming<Driver>;
+  using DriverTimingCheck = TimingCheck<Driver>;
+
+  /**
+   * The slot each work item runs in
+   */
+  struct SlotAssignment {
+    uint8_t slots[WORK_ITEMS_COUNT + 1];
+  };
+
+  /**
+   * How a slot is filled: the deferred write (see DeferredWriteTiming) runs
+   * before the deferredWriteIndex-th work item (WORK_ITEMS_COUNT if after all
+   * of them), right after deferredWriteDelay delay cycles; usedCycles accounts
+   * for the work items, the write and its delay (and the timing check, see
+   * TimingCheck).
+   */
+  struct SlotLayout {
+    uint8_t deferredWriteIndex;
+    uint16_t deferredWriteDelay;
+    uint16_t usedCycles;
+  };
+
+  struct SlotLayouts {
+    SlotLayout slots[SLOTS_COUNT];
+  };
+
+  static constexpr bool ARE_WORK_ITEMS_BOUND_TO_EXISTING_CHANNELS() {
+    for (uint8_t i = 0; i < WORK_ITEMS_COUNT; i++) {
+      if (CHANNELS[i] != Channel::ANY
+          && uint8_t(CHANNELS[i]) - 1 >= SLOTS_COUNT) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  static_assert(
+    ARE_WORK_ITEMS_BOUND_TO_EXISTING_CHANNELS(),
+    "A work item is bound to a channel the driver doesn't have!"
+  );
+
+  static constexpr SlotLayout GET_SLOT_LAYOUT(
+    const uint8_t slot,
+    const SlotAssignment& assignment
+  ) {
+    SlotLayout layout{
+      WORK_ITEMS_COUNT,
+      0,
+      slot == TIMING_CHECK_SLOT ? DriverTimingCheck::DURATION : uint8_t(0)
+    };
+    bool deferredWritePlaced = !DeferredWrite::ENABLED;
+    for (uint8_t i = 0; i < WORK_ITEMS_COUNT; i++) {
+      if (assignment.slots[i] != slot) {
+        continue;
+      }
+      if (!deferredWritePlaced
+          && layout.usedCycles + DURATIONS[i] > DeferredWrite::SLOT_OFFSET) {
+        layout.deferredWriteIndex = i;
+        layout.deferredWriteDelay =
+          DeferredWrite::SLOT_OFFSET - layout.usedCycles;
+        layout.usedCycles =
+          DeferredWrite::SLOT_OFFSET + DeferredWrite::DURATION;
+        deferredWritePlaced = true;
+      }
+      layout.usedCycles += DURATIONS[i];
+    }
+    if (!deferredWritePlaced) {
+      layout.deferredWriteDelay =
+        DeferredWrite::SLOT_OFFSET - layout.usedCycles;
+      layout.usedCycles =
+        DeferredWrite::SLOT_OFFSET + DeferredWrite::DURATION;
+    }
+    return layout;
+  }
+
+  /**
+   * Bound work items go to their channel's slot; unbound ones are placed in
+   * the current slot (starting from the first one) as long as they fit next
+   * to the items already there, then the next slot becomes the current one
+   * (the last slot takes whatever is left)
+   */
+  static constexpr SlotAssignment GET_SLOT_ASSIGNMENT() {
+    SlotAssignment assignment{};
+    for (uint8_t i = 0; i < WORK_ITEMS_COUNT; i++) {
+      assignment.slots[i] = CHANNELS[i] == Channel::ANY
+        ? UNASSIGNED_SLOT
+        : uint8_t(CHANNELS[i]) - 1;
+    }
+    uint8_t slot = 0;
+    for (uint8_t i = 0; i < WORK_ITEMS_COUNT; i++) {
+      if (CHANNELS[i] != Channel::ANY) {
+        continue;
+      }
+      for (;;) {
+        assignment.slots[i] = slot;
+        if (
+          slot == SLOTS_COUNT - 1
+          || GET_SLOT_LAYOUT(slot, assignment).usedCycles
+            <= GET_SLOT_BUDGET(slot)
+        ) {
+          break;
+        }
+        slot++;
+      }
+    }
+    return assignment;
+  }
+
+  static constexpr SlotAssignment SLOT_ASSIGNMENT = GET_SLOT_ASSIGNMENT();
+
+  static constexpr SlotLayouts GET_SLOT_LAYOUTS() {
+    SlotLayouts layouts{};
+    for (uint8_t slot = 0; slot < SLOTS_COUNT; slot++) {
+      layouts.slots[slot] = GET_SLOT_LAYOUT(slot, SLOT_ASSIGNMENT);
+    }
+    return layouts;
+  }
+
+  static constexpr SlotLayouts SLOT_LAYOUTS = GET_SLOT_LAYOUTS();
+
+  static constexpr bool DO_OTHER_SLOTS_FIT() {
+    for (uint8_t slot = 1; slot < SLOTS_COUNT; slot++) {
+      if (SLOT_LAYOUTS.slots[slot].usedCycles > GET_SLOT_BUDGET(slot)) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  static_assert(
+    !DeferredWrite::ENABLED
+    || DriverTimingCheck::DURATION <= DeferredWrite::SLOT_OFFSET,
+    "The timing check doesn't fit before the deferred write!"
+  );
+  static_assert(
+    SLOT_LAYOUTS.slots[0].usedCycles <= GET_SLOT_BUDGET(0),
+    "The left channel's work items don't fit in the first slot!"
+  );
+  static_assert(
+    DO_OTHER_SLOTS_FIT(),
+    "The work items don't fit in the frame's cycle budget!"
+  );
+
+  /**
+   * Returns the index of the work item the idle delay of the given slot runs
+   * before (WORK_ITEMS_COUNT if after all of them): right after the deferred
+   * write in the first slot, at the end in the other ones (see above)
+   */
+  static constexpr uint8_t GET_IDLE_DELAY_INDEX(const uint8_t slot) {
+    if (slot) {
+      return WORK_ITEMS_COUNT;
+    }
+    return DeferredWrite::ENABLED
+      ? SLOT_LAYOUTS.slots[0].deferredWriteIndex
+      : 0;
+  }
+
+  template<uint8_t SLOT, uint8_t INDEX>
+  static void runDeferredWriteAndDelay(Driver& driver) {
+    if constexpr (
+      DeferredWrite::ENABLED
+      && SLOT_LAYOUTS.slots[SLOT].deferredWriteIndex == INDEX
+    ) {
+      delayInCyclesWithAsmLoop<SLOT_LAYOUTS.slots[SLOT].deferredWriteDelay>();
+      DeferredWrite::write(driver);
+    }
+    if constexpr (GET_IDLE_DELAY_INDEX(SLOT) == INDEX) {
+      delayInCyclesWithAsmLoop<GET_SLOT_IDLE_CYCLES(SLOT)>();
+    }
+  }
+
+  template<uint8_t SLOT, uint8_t INDEX>
+  static void runSlot(Driver& driver) {
+    runDeferredWriteAndDelay<SLOT, INDEX>(driver);
+  }
+
+  template<uint8_t SLOT, uint8_t INDEX, typename First, typename... Rest>
+  static void runSlot(Driver& driver, First& first, Rest&... rest) {
+    runDeferredWriteAndDelay<SLOT, INDEX>(driver);
+    if constexpr (SLOT_ASSIGNMENT.slots[INDEX] == SLOT) {
+      first.run();
+    }
+    runSlot<SLOT, INDEX + 1>(driver, rest...);
+  }
+
+  /**
+   * Runs the work items of a slot, and waits until the slot ends
+   */
+  template<uint8_t SLOT>
+  static void finishSlot(Driver& driver, WorkItems&... workItems) {
+    if constexpr (SLOT == TIMING_CHECK_SLOT) {
+      DriverTimingCheck::run(driver);
+    }
+    runSlot<SLOT, 0>(driver, workItems...);
+  }
+
+  template<uint8_t CHANNEL = 0>
+  static void runTDMFrame(
+    Driver& driver,
+    const Sample (&samples)[SLOTS_COUNT],
+    WorkItems&... workItems
+  ) {
+    driver.sendSample(samples[CHANNEL]);
+    finishSlot<(CHANNEL + 1) % SLOTS_COUNT>(driver, workItems...);
+    if constexpr (CHANNEL + 1 < SLOTS_COUNT) {
+      runTDMFrame<CHANNEL + 1>(driver, samples, workItems...);
+    }
+  }
+
+public:
+  /**
+   * Returns the number of delay cycles added to the given slot
+   */
+  static constexpr uint16_t GET_SLOT_IDLE_CYCLES(const uint8_t slot) {
+    return GET_SLOT_BUDGET(slot) - SLOT_LAYOUTS.slots[slot].usedCycles;
+  }
+
+  /**
+   * The number of delay cycles added to each slot
+   */
+  static constexpr uint16_t FIRST_SLOT_IDLE_CYCLES = GET_SLOT_IDLE_CYCLES(0);
+  static constexpr uint16_t SECOND_SLOT_IDLE_CYCLES = GET_SLOT_IDLE_CYCLES(1);
+
+  static constexpr uint16_t GET_IDLE_CYCLES_PER_FRAME() {
+    uint16_t cycles = 0;
+    for (uint8_t slot = 0; slot < SLOTS_COUNT; slot++) {
+      cycles += GET_SLOT_IDLE_CYCLES(slot);
+    }
+    return cycles;
+  }
+
+  /**
+   * The number of CPU cycles per frame which are still available for other
+   * work items
+   */
+  static constexpr uint16_t IDLE_CYCLES_PER_FRAME =
+    GET_IDLE_CYCLES_PER_FRAME();
+
+  /**
+   * Runs the main loop forever. left and right are read right when the
+   * respective samples are sent, so work items can update them.
+   */
+  [[noreturn]] static void run(
+    Driver& driver,
+    const Sample& left,
+    const Sample& right,
+    WorkItems&... workItems
+  ) {
+    static_assert(
+      !DeferredWrite::SECONDARY_STREAM,
+      "Dual stream drivers need runDualStreamFrameLoop()!"
+    );
+    static_assert(SLOTS_COUNT == 2, "TDM drivers need runTDMFrameLoop()!");
+    for (;;) {
+      driver.sendSample(left);
+      finishSlot<1>(driver, workItems...);
+      driver.sendSample(right);
+      finishSlot<0>(driver, workItems...);
+    }
+  }
+
+  /**
+   * Same as run(), for dual stream drivers: secondaryLeft and secondaryRight
+   * are read along with left and right, and their low bytes are sent half a
+   * sample later.
+   */
+  [[noreturn]] static void run(
+    Driver& driver,
+    const int16_t& left,
+    const int16_t& right,
+    const int16_t& secondaryLeft,
+    const int16_t& secondaryRight,
+    WorkItems&... workItems
+  ) {
+    static_assert(
+      DeferredWrite::SECONDARY_STREAM,
+      "Single stream drivers need runFrameLoop()!"
+    );
+    for (;;) {
+      driver.sendSample(left, secondaryLeft);
+      finishSlot<1>(driver, workItems...);
+      driver.sendSample(right, secondaryRight);
+      finishSlot<0>(driver, workItems...);
+    }
+  }
+
+  /**
+   * Same as run(), for TDM drivers: each channel's sample is read from the
+   * array right when it's sent.
+   */
+  [[noreturn]] static void run(
+    Driver& driver,
+    const Sample (&samples)[SLOTS_COUNT],
+    WorkItems&... workItems
+  ) {
+    static_assert(
+      !DeferredWrite::SECONDARY_STREAM,
+      "Dual stream drivers need runDualStreamFrameLoop()!"
+    );
+    for (;;) {
+      runTDMFrame(driver, samples, workItems...);
+    }
+  }
+};
+
+
+/**
+ * Shorthand for FrameScheduler<Driver, WorkItems...>::run(), which deduces
+ * the work items' types. The samples' type must match the driver's exactly
+ * (int16_t, or int32_t for 24 and 32-bit samples): otherwise, the loop would
+ * keep reading a converted copy instead of the variables themselves.
+ */
+template<typename Driver, typename Sample, typename... WorkItems>
+[[noreturn]] inline void runFrameLoop(
+  Driver& driver,
+  const Sample& left,
+  const Sample& right,
+  WorkItems... workItems
+) {
+  static_assert(
+    is_same<Sample, typename Driver::Sample>::value,
+    "The samples' type doesn't match the driver's!"
+  );
+  FrameScheduler<Driver, WorkItems...>::run(
+    driver,
+    left,
+    right,
+    workItems...
+  );
+}
+
+
+/**
+ * Shorthand for FrameScheduler<Driver, WorkItems...>::run() with a dual stream
+ * driver (see DualStreamI2SDriver), which deduces the work items' types.
+ */
+template<typename Driver, typename... WorkItems>
+[[noreturn]] inline void runDualStreamFrameLoop(
+  Driver& driver,
+  const int16_t& left,
+  const int16_t& right,
+  const int16_t& secondaryLeft,
+  const int16_t& secondaryRight,
+  WorkItems... workItems
+) {
+  FrameScheduler<Driver, WorkItems...>::run(
+    driver,
+    left,
+    right,
+    secondaryLeft,
+    secondaryRight,
+    workItems...
+  );
+}
+
+
+/**
+ * Shorthand for FrameScheduler<Driver, WorkItems...>::run() with a TDM driver
+ * (see I2SDriver), which deduces the work items' types.
+ */
+template<typename Driver, typename... WorkItems>
+[[noreturn]] inline void runTDMFrameLoop(
+  Driver& driver,
+  const typename Driver::Sample (&samples)[Driver::CHANNELS],
+  WorkItems... workItems
+) {
+  FrameScheduler<Driver, WorkItems...>::run(driver, samples, workItems...);
+}
@@ -5,17 +5,76 @@
 #include "type_traits_clone.hpp"
 
 
+/**
+ * The timers which can generate the word select signal:
+ * - TIMER_0, 8-bit, output on pin 6 (OC0A); since a whole sample period must
+ *   fit in its counter, HALF_BIT_PERIOD can't exceed 8 (i.e. the sample rate
+ *   can't go below 31.25 kHz per channel);
+ * - TIMER_1, 16-bit, output on pin 9 (OC1A); HALF_BIT_PERIOD can go up to 127,
+ *   which allows lower sample rates (e.g. 25 kHz with HALF_BIT_PERIOD = 10),
+ *   and thus more CPU cycles per frame. Timer 0 is left unconfigured (but,
+ *   since interrupts stay disabled, millis() and delay() still don't work).
+ */
+enum class WordSelectTimer : uint8_t {
+  TIMER_0,
+  TIMER_1
+};
+
+
+/**
+ * The highest HALF_BIT_PERIOD supported by each word select timer, given the
+ * number of bits per sample (with timer 0, a whole sample period must fit in
+ * 256 cycles; with timer 1, the limit comes from FULL_BIT_PERIOD being a byte)
+ */
+constexpr uint8_t GET_MAX_HALF_BIT_PERIOD(
+  const WordSelectTimer timer,
+  const uint8_t wordBits = 16
+) {
+  return timer == WordSelectTimer::TIMER_0 ? 128 / wordBits : 127;
+}
+
+
+/**
+ * The counters updated by I2SDriver::checkTiming() (see TIMING_CHECKS):
+ * - frames, the number of frames sent so far;
+ * - slips, the number of frames where the loop was found out of step with the
+ *   word select timer, or where the USART buffer was found empty right after
+ *   a sample was written (i.e. a byte was dropped);
+ * - lateWrites, the number of frames where the USART module ran out of data
+ *   (the transmission stopped, so the following bits are shifted relative to
+ *   word select).
+ * All of them wrap around.
+ */
+struct I2STimingCounters {
+  uint32_t frames;
+  uint16_t slips;
+  uint16_t lateWrites;
+};
+
+
 /**
  * Template class used to configure and start the I2S-related clock signals (bit
- * clock and word select). This driver works with 16-bit signed samples, one per
- * channel (left and right).
+ * clock and word select). This driver works with 16-bit signed samples (or 24
+ * and 32-bit ones, see WORD_BITS), one per channel (left and right, or more in
+ * TDM mode).
  *
- * The only two template parameters are:
+ * Template parameters:
  * - HALF_BIT_PERIOD, whose name should be self-descriptive, and whose value
- *   must be between 1 (included) and 8 (included);
+ *   must be between 1 (included) and 8 (included), or 127 (included) when
+ *   word select is generated by timer 1 (with timer 0, the upper limit drops
+ *   to 5 for 24-bit samples and 4 for 32-bit ones);
  * - BUSY_EXTERNAL_CYCLES_BEFORE_FIRST_BUFFER_WRITE, which is the number of
  *   additional CPU cycles between the driver's initialization and the first
- *   time the USART buffer is written (first sendSample() invocation).
+ *   time the USART buffer is written (first sendSample() invocation);
+ * - WORD_SELECT_TIMER, the timer which generates the word select signal (see
+ *   WordSelectTimer); timer 0 by default;
+ * - CHANNEL_COUNT, the number of 16-bit slots in each frame; 2 (the default)
+ *   means standard I2S, anything more means TDM mode (see below), which
+ *   requires timer 1;
+ * - WORD_BITS, the number of bits per sample (16, the default, 24 or 32); the
+ *   bit rate stays the same, so wider samples mean a lower sample rate;
+ * - TIMING_CHECKS, whether checkTiming() is available (false by default, see
+ *   below).
  *
  * Most of the driver's configuration revolves around the USART module alone,
  * which takes care of both the actual data and the bit clock signal. This
@@ -30,7 +89,8 @@
  * (GET_ADDITIONAL_CYCLES_BEFORE_EARLIEST_BUFFER_WRITE()) was written for
  * handling it.
  *
- * For the word select signal, timer 0 was used. Configuring it is not easier
+ * For the word select signal, timer 0 was used (timer 1 is available as an
+ * option, and it's configured the same way). Configuring it is not easier
  * than with the USART module, because of one issue: the timer's output signal
  * needs to be perfectly synchronized with the bitstream generated by the USART
  * module (and I2S' rules on each sample's LSB must be followed as well).
@@ -39,6 +99,42 @@
  * BUSY_EXTERNAL_CYCLES_BEFORE_FIRST_BUFFER_WRITE (which is configured by the
  * caller) was created for this purpose as well.
  *
+ * In TDM mode (e.g. for 4 or 8-channel DACs and codecs), the channels' samples
+ * are sent back to back, in order, and the word select pin carries a frame sync
+ * pulse instead of a 50% duty cycle signal: the pulse is one bit long and
+ * covers the last bit of each frame, so that it's sampled by the receiver
+ * right before the MSB of the first channel (like word select's 1-bit delay in
+ * I2S, and like the DSP/TDM mode with 1-bit delay supported by most codecs).
+ * Every slot is sent with the same timing as an I2S sample, one every
+ * SAMPLE_PERIOD cycles.
+ *
+ * The USART module only buffers two bytes (one in UDR0, one in the shift
+ * register), so 24 and 32-bit samples can't be written in a single burst:
+ * sendSample() writes the two most significant bytes, exactly like with
+ * 16-bit samples, and latches the other ones into GPIOR1 (and GPIOR2); then,
+ * sendSampleLowBytes() writes them exactly LOW_BYTES_WRITE_OFFSET cycles
+ * after sendSample() starts (FrameScheduler takes care of it). At that point,
+ * 16 bits later, the buffer has been free since the second byte moved into
+ * the shift register, and the third byte is written right before the second
+ * one has been sent, with the same timing as the first byte of the sample;
+ * the fourth byte follows 3 cycles later, like the second one. This is the
+ * only spacing that's been verified for the later bytes (a single byte can
+ * be written anywhere in the 8 bits before, but a 2-byte burst can't). Since
+ * the low bytes are latched, work items can update the next sample in the
+ * meantime; GPIOR1 and GPIOR2 must not be used for anything else.
+ *
+ * A single miscounted cycle in the loop shifts the data relative to word
+ * select, and nothing but a logic analyzer would notice. With TIMING_CHECKS,
+ * checkTiming() must be invoked once per frame, right after the first
+ * channel's sendSample() (FrameScheduler takes care of it), and it updates
+ * some counters (see I2STimingCounters and getTimingCounters()): the word
+ * select timer's counter (and, in I2S mode, the word select pin) must have
+ * the exact value expected at that point, the USART buffer must hold the
+ * sample's second byte, and the transmission must not have stopped since the
+ * previous check (the TXC0 flag, which is then cleared). checkTiming() has
+ * no branches, so it takes CHECK_TIMING_DURATION cycles in every frame, and
+ * it can stay enabled in production builds.
+ *
  * Additionally, this template provides some constants which represent various
  * clock-related periods (in CPU cycles) and come in handy during cycle counting
  * and generating signals with an accurate frequency.
@@ -46,29 +142,66 @@
 template<
   uint8_t HALF_BIT_PERIOD,
   uint8_t BUSY_EXTERNAL_CYCLES_BEFORE_FIRST_BUFFER_WRITE,
-  enable_if_t<HALF_BIT_PERIOD && HALF_BIT_PERIOD <= 8, int> = 0
+  WordSelectTimer WORD_SELECT_TIMER = WordSelectTimer::TIMER_0,
+  uint8_t CHANNEL_COUNT = 2,
+  uint8_t WORD_BITS = 16,
+  bool TIMING_CHECKS = false,
+  enable_if_t<
+    HALF_BIT_PERIOD
+    && HALF_BIT_PERIOD <= GET_MAX_HALF_BIT_PERIOD(WORD_SELECT_TIMER, WORD_BITS)
+    && CHANNEL_COUNT >= 2
+    && (WORD_BITS == 16 || WORD_BITS == 24 || WORD_BITS == 32),
+    int
+  > = 0
 >
 class I2SDriver {
 private:
+  static constexpr bool TDM = CHANNEL_COUNT > 2;
+
+  /**
+   * Only instantiated (i.e. allocated) when used, i.e. with TIMING_CHECKS
+   */
+  inline static I2STimingCounters timingCounters{};
+
+  static_assert(
+    !TDM || WORD_SELECT_TIMER == WordSelectTimer::TIMER_1,
+    "TDM mode requires timer 1!"
+  );
+
   /**
    * After writing to UDR0, the USART module waits at least 2 CPU cycles before
    * starting the transmission (probably to update the shift register)
    */
   static constexpr uint8_t USART_BUFFER_DELAY = 2;
   /**
-   * The number of CPU cycles required to start timer 0 (basically to run
-   * bitSet(TCCR0B, CS00))
+   * The number of CPU cycles required to start the word select timer
+   * (basically to run bitSet(TCCR0B, CS00), i.e. in, ori and out, or
+   * bitSet(TCCR1B, CS10), i.e. lds, ori and sts, since TCCR1B lies outside of
+   * the I/O space)
    */
-  static constexpr uint8_t TIMER_0_ACTIVATION_DELAY = 3;
+  static constexpr uint8_t TIMER_ACTIVATION_DELAY =
+    WORD_SELECT_TIMER == WordSelectTimer::TIMER_0 ? 3 : 5;
   /**
    * The number of CPU cycles required for the first instruction of sendSample()
    * (useful for computing the total delay of the first write operation)
    */
   static constexpr uint8_t SEND_SAMPLE_FIRST_WRITE_DELAY = 2;
+  /**
+   * The number of CPU cycles required for the first two instructions of
+   * sendSampleLowBytes() (in from GPIOR1, then sts)
+   */
+  static constexpr uint8_t SEND_LOW_BYTES_FIRST_WRITE_DELAY = 3;
+  /**
+   * The number of CPU cycles from the start of checkTiming() to the moment
+   * the word select timer's counter is sampled (in on TCNT0 samples it right
+   * away, lds on TCNT1L one cycle later)
+   */
+  static constexpr uint8_t CHECK_TIMING_COUNTER_READ_DELAY =
+    WORD_SELECT_TIMER == WordSelectTimer::TIMER_0 ? 0 : 1;
   static constexpr uint8_t
     BUSY_CYCLES_FROM_USART_INIT_TO_FIRST_BUFFER_WRITE =
     BUSY_EXTERNAL_CYCLES_BEFORE_FIRST_BUFFER_WRITE
-    + TIMER_0_ACTIVATION_DELAY;
+    + TIMER_ACTIVATION_DELAY;
 
   /**
    * Given the number of CPU cycles elapsed (in the past or the future),
@@ -140,23 +273,60 @@ private:
     }
   }
 
-  static void configureTimer0() {
-    constexpr uint8_t TOTAL_CYCLES_FROM_USART_INIT_TO_FIRST_BUFFER_WRITE =
+  /**
+   * In TDM mode, the first buffer write must happen late enough for the timer
+   * to generate the whole frame sync pulse before it (i.e. the timer's counter
+   * must start before the pulse does, see configureTimer1()). Delaying the
+   * write by a multiple of FULL_BIT_PERIOD keeps it in sync with the USART
+   * module's internal clock.
+   */
+  static constexpr uint16_t GET_OTHER_EXTERNAL_DELAY_CYCLES() {
+    uint16_t cycles = GET_ADDITIONAL_CYCLES_BEFORE_EARLIEST_BUFFER_WRITE(
+      BUSY_CYCLES_FROM_USART_INIT_TO_FIRST_BUFFER_WRITE
+    );
+    if (TDM) {
+      while (
+        BUSY_EXTERNAL_CYCLES_BEFORE_FIRST_BUFFER_WRITE
+        + cycles
+        + SEND_SAMPLE_FIRST_WRITE_DELAY
+        + USART_BUFFER_DELAY
+        <= FULL_BIT_PERIOD
+      ) {
+        cycles += FULL_BIT_PERIOD;
+      }
+    }
+    return cycles;
+  }
+
+  /**
+   * Computes how many cycles the word select timer must wait, from the moment
+   * it's activated, before its counter resets to 0 for the first time
+   */
+  static constexpr int32_t
+  GET_CYCLES_FOR_SYNCING_WORD_SELECT_WITH_USART_CLOCK() {
+    constexpr uint16_t TOTAL_CYCLES_FROM_USART_INIT_TO_FIRST_BUFFER_WRITE =
       BUSY_CYCLES_FROM_USART_INIT_TO_FIRST_BUFFER_WRITE
       + OTHER_EXTERNAL_DELAY_CYCLES_BEFORE_FIRST_BUFFER_WRITE;
-    constexpr uint8_t TOTAL_CYCLES_FROM_TIMER_INIT_TO_FIRST_BUFFER_WRITE =
+    constexpr uint16_t TOTAL_CYCLES_FROM_TIMER_INIT_TO_FIRST_BUFFER_WRITE =
       TOTAL_CYCLES_FROM_USART_INIT_TO_FIRST_BUFFER_WRITE
-      - TIMER_0_ACTIVATION_DELAY;
+      - TIMER_ACTIVATION_DELAY;
     /*
      * We need to remember that, according to the I2S specifications, the word
      * select signal must change before sending the previous byte's LSB; this
-     * explains why we subtract FULL_BIT_PERIOD.
+     * explains why we subtract FULL_BIT_PERIOD. In TDM mode, instead, the
+     * counter resets right when the first channel's MSB is sent, and the frame
+     * sync pulse is generated by a compare match one bit earlier.
      */
-    constexpr int16_t CYCLES_FOR_SYNCING_WORD_SELECT_WITH_USART_CLOCK =
-      TOTAL_CYCLES_FROM_TIMER_INIT_TO_FIRST_BUFFER_WRITE
+    return
+      int32_t(TOTAL_CYCLES_FROM_TIMER_INIT_TO_FIRST_BUFFER_WRITE)
       + SEND_SAMPLE_FIRST_WRITE_DELAY
       + USART_BUFFER_DELAY
-      - FULL_BIT_PERIOD;
+      - (TDM ? 0 : FULL_BIT_PERIOD);
+  }
+
+  static void configureTimer0() {
+    constexpr int16_t CYCLES_FOR_SYNCING_WORD_SELECT_WITH_USART_CLOCK =
+      GET_CYCLES_FOR_SYNCING_WORD_SELECT_WITH_USART_CLOCK();
     /*
      * From the moment the timer is activated, it should wait
      * CYCLES_FOR_SYNCING_WORD_SELECT_WITH_USART_CLOCK cycles before its
@@ -187,15 +357,72 @@ private:
     /*
      * The timer's period matches the sample period.
      * 
-     * Also notice that, because SAMPLE_PERIOD = 32 * HALF_BIT_PERIOD and OCR0A
-     * is a 8-bit register, SAMPLE_PERIOD can't exceed 256, which translates
-     * into HALF_BIT_PERIOD <= 8. This is the reason for the upper limit on
-     * HALF_BIT_PERIOD.
+     * Also notice that, because SAMPLE_PERIOD = 32 * HALF_BIT_PERIOD (with
+     * 16-bit samples) and OCR0A is a 8-bit register, SAMPLE_PERIOD can't
+     * exceed 256, which translates into HALF_BIT_PERIOD <= 8. This is the
+     * reason for the upper limit on HALF_BIT_PERIOD (unless timer 1 is used).
      */
     OCR0A = SAMPLE_PERIOD - 1;
     TCNT0 = -CYCLES_FOR_SYNCING_WORD_SELECT_WITH_USART_CLOCK;
   }
 
+  /**
+   * Same as configureTimer0(), with timer 1's 16-bit registers: fast PWM mode
+   * 15 (OCR1A as the counter's top value) behaves exactly like timer 0's mode
+   * 7, and OC1A toggles on every compare match like OC0A.
+   *
+   * TCNT1 and OCR1A are written through the TEMP register (high byte first),
+   * which the compiler takes care of; since the timer is stopped, the order
+   * and timing of these writes don't matter.
+   *
+   * In TDM mode, the timer's period matches the frame period instead, and
+   * fast PWM mode 14 (ICR1 as the counter's top value) leaves OCR1A free for
+   * the frame sync pulse: in inverting mode, OC1A is set on the compare match
+   * one bit before the top value, and cleared when the counter resets. The
+   * counter starts below the compare value (GET_OTHER_EXTERNAL_DELAY_CYCLES()
+   * makes sure of that), so it never overflows through 0xffff, where OC1A
+   * wouldn't be cleared, and even the first frame gets its pulse.
+   */
+  static void configureTimer1() {
+    constexpr int32_t CYCLES_FOR_SYNCING_WORD_SELECT_WITH_USART_CLOCK =
+      GET_CYCLES_FOR_SYNCING_WORD_SELECT_WITH_USART_CLOCK();
+    if constexpr (TDM) {
+      static_assert(
+        CYCLES_FOR_SYNCING_WORD_SELECT_WITH_USART_CLOCK > FULL_BIT_PERIOD
+        && CYCLES_FOR_SYNCING_WORD_SELECT_WITH_USART_CLOCK <= FRAME_PERIOD,
+        "The frame sync pulse can't precede the first sample!"
+      );
+      static_assert(
+        uint32_t(SAMPLE_PERIOD) * CHANNELS <= 65536,
+        "The frame period doesn't fit in timer 1's counter!"
+      );
+
+      // Fast PWM (mode 14, continues below), don't start the timer yet
+      TCCR1B = bit(WGM13) | bit(WGM12);
+      // OC1A inverting mode, OC1B normal mode operation, fast PWM (mode 14)
+      TCCR1A = bit(COM1A1) | bit(COM1A0) | bit(WGM11);
+      // The timer's period matches the frame period
+      ICR1 = FRAME_PERIOD - 1;
+      OCR1A = FRAME_PERIOD - FULL_BIT_PERIOD - 1;
+      TCNT1 = FRAME_PERIOD - CYCLES_FOR_SYNCING_WORD_SELECT_WITH_USART_CLOCK;
+    } else {
+      static_assert(
+        CYCLES_FOR_SYNCING_WORD_SELECT_WITH_USART_CLOCK + SAMPLE_PERIOD - 1
+        < 65536,
+        "The word select signal is not low on the first sample!"
+      );
+
+      // Fast PWM (mode 15, continues below), don't start the timer yet
+      TCCR1B = bit(WGM13) | bit(WGM12);
+      // OC1A toggle mode operation, OC1B normal mode operation, fast PWM
+      // (mode 15)
+      TCCR1A = bit(COM1A0) | bit(WGM11) | bit(WGM10);
+      // The timer's period matches the sample period
+      OCR1A = SAMPLE_PERIOD - 1;
+      TCNT1 = -CYCLES_FOR_SYNCING_WORD_SELECT_WITH_USART_CLOCK;
+    }
+  }
+
   static void configureUSART() {
     // Set UBRR0 to 0 before enabling MSPIM mode
     UBRR0 = 0;
@@ -219,15 +446,27 @@ public:
    * The number of additional delay cycles the driver's user must wait for
    * before actually invoking sendSample() the first time
    */
-  static constexpr uint8_t
+  static constexpr uint16_t
     OTHER_EXTERNAL_DELAY_CYCLES_BEFORE_FIRST_BUFFER_WRITE =
-    GET_ADDITIONAL_CYCLES_BEFORE_EARLIEST_BUFFER_WRITE(
-      BUSY_CYCLES_FROM_USART_INIT_TO_FIRST_BUFFER_WRITE
-    );
+    GET_OTHER_EXTERNAL_DELAY_CYCLES();
+  /**
+   * The type of the samples taken by sendSample()
+   */
+  using Sample = conditional_t<WORD_BITS == 16, int16_t, int32_t>;
+  /**
+   * The number of bits per sample
+   */
+  static constexpr uint8_t SAMPLE_BITS = WORD_BITS;
   /**
    * The number of CPU cycles required by sendSample()
    */
-  static constexpr uint8_t SEND_SAMPLE_DURATION = 5;
+  static constexpr uint8_t SEND_SAMPLE_DURATION = WORD_BITS == 32 ? 6 : 5;
+  /**
+   * The number of CPU cycles required by sendSampleLowBytes() (0 with 16-bit
+   * samples, which don't need it)
+   */
+  static constexpr uint8_t SEND_LOW_BYTES_DURATION =
+    WORD_BITS == 16 ? 0 : (WORD_BITS - 16) / 8 * 3;
   /**
    * The number of CPU cycles between two consecutive bits
    */
@@ -236,38 +475,189 @@ public:
    * The number of CPU cycles between two consecutive audio samples (keep in
    * mind that a sample has to be produced for each channel)
    */
-  static const uint16_t SAMPLE_PERIOD = FULL_BIT_PERIOD * 16;
+  static const uint16_t SAMPLE_PERIOD = FULL_BIT_PERIOD * WORD_BITS;
+  /**
+   * The number of CPU cycles between the start of sendSample() and the start
+   * of the following sendSampleLowBytes() (16 bits later)
+   */
+  static constexpr uint16_t LOW_BYTES_WRITE_OFFSET =
+    FULL_BIT_PERIOD * 16
+    + SEND_SAMPLE_FIRST_WRITE_DELAY
+    - SEND_LOW_BYTES_FIRST_WRITE_DELAY;
+  /**
+   * The number of channels (i.e. samples) in each frame
+   */
+  static constexpr uint8_t CHANNELS = CHANNEL_COUNT;
   /**
    * The number of CPU cycles between two consecutive audio frames (a frame
    * consists of a pair of audio samples which will be played at the same time;
    * the first sample is for the left channel and the second one is for the
-   * right channel)
+   * right channel; in TDM mode, there's one sample per channel)
    */
-  static const uint16_t FRAME_PERIOD = SAMPLE_PERIOD * 2;
+  static const uint16_t FRAME_PERIOD = SAMPLE_PERIOD * CHANNELS;
+
+  /**
+   * Returns the number of CPU cycles between the sendSample() invocation for
+   * the first channel and the one for the given channel, within a frame
+   */
+  static constexpr uint16_t GET_SEND_SAMPLE_OFFSET(const uint8_t channel) {
+    return channel * SAMPLE_PERIOD;
+  }
+
+  /**
+   * Whether checkTiming() is available
+   */
+  static constexpr bool INSTRUMENTED = TIMING_CHECKS;
+  /**
+   * The number of CPU cycles required by checkTiming():
+   * - loading the counters from SRAM and storing them back (32 cycles);
+   * - updating them (11 cycles);
+   * - reading UCSR0A, clearing TXC0 and checking UDRE0 (8 cycles);
+   * - comparing the timer's counter, and the word select pin in I2S mode (6
+   *   cycles with timer 0, 12 with timer 1, 9 in TDM mode).
+   * It was counted from the instructions, not measured on a listing.
+   */
+  static constexpr uint8_t CHECK_TIMING_DURATION =
+    51
+    + (
+      WORD_SELECT_TIMER == WordSelectTimer::TIMER_0 ? 6
+      : TDM ? 9
+      : 12
+    );
+  /**
+   * The value of the word select timer's counter expected by checkTiming()
+   * (see GET_CYCLES_FOR_SYNCING_WORD_SELECT_WITH_USART_CLOCK(): the counter
+   * resets right when the first byte's MSB would start, minus a bit in I2S
+   * mode)
+   */
+  static constexpr uint16_t EXPECTED_TIMER_COUNT =
+    SEND_SAMPLE_DURATION
+    + CHECK_TIMING_COUNTER_READ_DELAY
+    + (TDM ? 0 : FULL_BIT_PERIOD)
+    - SEND_SAMPLE_FIRST_WRITE_DELAY
+    - USART_BUFFER_DELAY;
 
   I2SDriver() {
     noInterrupts();
-    /*
-     * Set pins 6 (timer 0's OC0A), 4 (USART clock) and 1 (USART TX) as outputs;
-     * everything else can be left as input.
-     */
-    DDRD = bit(DDD6) | bit(DDD4) | bit(DDD1);
-    configureTimer0();
+    if constexpr (WORD_SELECT_TIMER == WordSelectTimer::TIMER_0) {
+      /*
+       * Set pins 6 (timer 0's OC0A), 4 (USART clock) and 1 (USART TX) as
+       * outputs; everything else can be left as input.
+       */
+      DDRD = bit(DDD6) | bit(DDD4) | bit(DDD1);
+      configureTimer0();
+    } else {
+      // Same as above, with pin 9 (timer 1's OC1A) instead of pin 6
+      DDRD = bit(DDD4) | bit(DDD1);
+      DDRB = bit(DDB1);
+      configureTimer1();
+    }
     configureUSART();
-    // Start timer 0 (without prescaler)
-    bitSet(TCCR0B, CS00);
+    // Start the timer (without prescaler)
+    if constexpr (WORD_SELECT_TIMER == WordSelectTimer::TIMER_0) {
+      bitSet(TCCR0B, CS00);
+    } else {
+      bitSet(TCCR1B, CS10);
+    }
   }
 
-  void sendSample(const int16_t sample) {
-    UDR0 = int8_t(sample >> 8);
-    /*
-     * During the 2 cycles delay needed by the USART module after writing UDR0,
-     * it seems that a new byte written to UDR0 is ignored. When executing two
-     * sts instructions one right after another, the second one is executed 2
-     * cycles after the first one, but after some testing this seems not to be
-     * enough. Thus, an additional 1-cycle delay was added.
-     */
-    delayInCyclesWithNOP<1>();
-    UDR0 = uint8_t(sample & 0xff);
+  void sendSample(const Sample sample) {
+    if constexpr (WORD_BITS == 16) {
+      UDR0 = int8_t(sample >> 8);
+      /*
+       * During the 2 cycles delay needed by the USART module after writing
+       * UDR0, it seems that a new byte written to UDR0 is ignored. When
+       * executing two sts instructions one right after another, the second one
+       * is executed 2 cycles after the first one, but after some testing this
+       * seems not to be enough. Thus, an additional 1-cycle delay was added.
+       */
+      delayInCyclesWithNOP<1>();
+      UDR0 = uint8_t(sample & 0xff);
+    } else {
+      UDR0 = int8_t(sample >> (WORD_BITS - 8));
+      // Replaces the 1-cycle delay above
+      GPIOR1 = uint8_t(sample >> (WORD_BITS - 24));
+      UDR0 = uint8_t(sample >> (WORD_BITS - 16));
+      if constexpr (WORD_BITS == 32) {
+        GPIOR2 = uint8_t(sample & 0xff);
+      }
+    }
+  }
+
+  /**
+   * Updates the timing counters (only with TIMING_CHECKS, see above); it must
+   * be invoked right after the first channel's sendSample() (the timer's
+   * counter is sampled by its first instruction, see
+   * CHECK_TIMING_COUNTER_READ_DELAY)
+   */
+  void checkTiming() {
+    static_assert(TIMING_CHECKS, "Timing checks are disabled!");
+    uint8_t mismatch;
+    if constexpr (WORD_SELECT_TIMER == WordSelectTimer::TIMER_0) {
+      mismatch = TCNT0 ^ uint8_t(EXPECTED_TIMER_COUNT);
+      // Word select is low during the first channel
+      mismatch |= PIND & bit(PD6);
+    } else {
+      const uint16_t counter = TCNT1 ^ EXPECTED_TIMER_COUNT;
+      mismatch = uint8_t(counter) | uint8_t(counter >> 8);
+      if constexpr (!TDM) {
+        mismatch |= PINB & bit(PB1);
+      }
+    }
+    const uint8_t status = UCSR0A;
+    uint8_t transmitComplete = status & bit(TXC0);
+    // Writing 1 clears the flag, writing 0 leaves it as it is
+    UCSR0A = transmitComplete;
+    // The second byte must still be waiting inside the buffer
+    mismatch |= status & bit(UDRE0);
+    I2STimingCounters& counters = timingCounters;
+#ifdef __AVR__
+    // No branches: the flags go through the carry
+    asm(
+      "cp __zero_reg__, %[mismatch]\n\t"
+      "adc %A[slips], __zero_reg__\n\t"
+      "adc %B[slips], __zero_reg__\n\t"
+      "lsl %[transmitComplete]\n\t"
+      "lsl %[transmitComplete]\n\t"
+      "adc %A[lateWrites], __zero_reg__\n\t"
+      "adc %B[lateWrites], __zero_reg__\n\t"
+      "subi %A[frames], 0xff\n\t"
+      "sbci %B[frames], 0xff\n\t"
+      "sbci %C[frames], 0xff\n\t"
+      "sbci %D[frames], 0xff"
+      : [slips] "+r" (counters.slips),
+        [lateWrites] "+r" (counters.lateWrites),
+        [frames] "+d" (counters.frames),
+        [transmitComplete] "+r" (transmitComplete)
+      : [mismatch] "r" (mismatch)
+    );
+#else
+    counters.slips += mismatch != 0;
+    counters.lateWrites += transmitComplete >> TXC0;
+    counters.frames++;
+#endif
+  }
+
+  static const I2STimingCounters& getTimingCounters() {
+    static_assert(TIMING_CHECKS, "Timing checks are disabled!");
+    return timingCounters;
+  }
+
+  static void resetTimingCounters() {
+    static_assert(TIMING_CHECKS, "Timing checks are disabled!");
+    timingCounters = {};
+  }
+
+  /**
+   * Sends the bytes latched by the last sendSample() invocation (only with 24
+   * and 32-bit samples, see above)
+   */
+  void sendSampleLowBytes() {
+    static_assert(WORD_BITS > 16, "16-bit samples have no low bytes to send!");
+    UDR0 = GPIOR1;
+    if constexpr (WORD_BITS == 32) {
+      // in takes 1 cycle, like the nop in sendSample()
+      UDR0 = GPIOR2;
+    }
   }
 };
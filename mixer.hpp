@@ -0,0 +1,295 @@
+#pragma once
+
+/*
+ * A single generator can only play one note at a time. This header provides
+ * Mixer, which sums the output of multiple generators (voices) while keeping
+ * a fixed, known duration, so that it can be used as a work item inside
+ * runFrameLoop() like any generator.
+ */
+
+#include <stdint.h>
+#include "frame_scheduler.hpp"
+#include "type_traits_clone.hpp"
+
+
+/**
+ * The ways Mixer can prevent the sum of its voices from overflowing:
+ * - HEADROOM, each voice is divided by the smallest power of 2 which is not
+ *   lower than the number of voices (via arithmetic shifts), so the sum can
+ *   never overflow, no matter the voices' amplitudes; the price is a quieter
+ *   output (and fewer bits of resolution per voice);
+ * - SATURATION, voices are summed as they are, and every addition which
+ *   overflows is clamped to the nearest 16-bit value; this keeps the output
+ *   level, and it's the better choice when the voices' amplitudes are known to
+ *   (mostly) fit.
+ */
+enum class MixingMode : uint8_t {
+  HEADROOM,
+  SATURATION
+};
+
+
+/**
+ * References to the voices of a Mixer, stored as a recursive list (the AVR
+ * toolchain doesn't provide std::tuple).
+ */
+template<typename... Voices>
+struct VoiceList {
+  template<typename Function>
+  void forEach(Function) {}
+};
+
+template<typename First, typename... Rest>
+struct VoiceList<First, Rest...> {
+  First& voice;
+  VoiceList<Rest...> rest;
+
+  VoiceList(First& voice, Rest&... rest) : voice(voice), rest(rest...) {}
+
+  template<typename Function>
+  void forEach(Function function) {
+    function(voice);
+    rest.forEach(function);
+  }
+};
+
+
+/**
+ * Tells whether Voice can be used inside a Mixer, i.e. whether it provides
+ * GET_STATE_ACCESS_DURATION() (see Mixer)
+ */
+template<typename Voice, typename = void>
+struct IsMixerVoice {
+  static constexpr bool value = false;
+};
+
+template<typename Voice>
+struct IsMixerVoice<
+  Voice,
+  void_t<decltype(Voice::GET_STATE_ACCESS_DURATION())>
+> {
+  static constexpr bool value = true;
+};
+
+
+/**
+ * Template class which sums the samples generated by a set of voices.
+ *
+ * Template parameters:
+ * - MODE, the way overflows are prevented (see MixingMode);
+ * - Voices, the types of the voices; each one must provide getNextSample(),
+ *   GET_NEXT_SAMPLE_DURATION and GET_STATE_ACCESS_DURATION() (e.g.
+ *   SquareWaveGenerator with a 16 or 24-bit accumulator).
+ *
+ * The mixer only holds references to the voices, which keep living (and can
+ * be accessed) outside of it. Instances are usually created via mixVoices(),
+ * which deduces Voices (here, three SquareWaveGenerator<FRAME_PERIOD, 24>):
+ *   auto chord = mixVoices<MixingMode::SATURATION>(root, third, fifth);
+ *   runFrameLoop(
+ *     driver,
+ *     sample,
+ *     sample,
+ *     workItem<chord.GET_NEXT_SAMPLE_DURATION>([&] {
+ *       sample = chord.getNextSample();
+ *     })
+ *   );
+ *
+ * GET_MAX_MIXER_VOICES() tells how many voices of a given type fit inside a
+ * frame slot; exceeding the frame's cycle budget still makes runFrameLoop()
+ * fail to compile, so the scheduler remains the final check.
+ *
+ * Some technical considerations.
+ *
+ * The additions and shifts are written in inline assembly (on AVR targets),
+ * so that their duration doesn't depend on the compiler's choices:
+ * - a voice's shift (HEADROOM mode) takes 2 cycles per bit (asr and ror);
+ * - a plain addition (HEADROOM mode) takes 2 cycles (add and adc);
+ * - a saturating addition takes 8 cycles, no matter whether it overflows.
+ *   After the addition, an overflow is detected through the V flag; in that
+ *   case, both operands had the same sign, and the carry flag tells which one
+ *   (it's only set when both were negative), so the result is 0x7fff plus the
+ *   carry. The other branch is padded with delays, like the ones inside
+ *   SquareWaveGenerator::getNextSample().
+ * The first voice is never added to anything, it simply initializes the sum.
+ * GET_NEXT_SAMPLE_DURATION assumes each voice's sample is produced right
+ * inside the registers used by the sum (the voices' getNextSample() gets
+ * inlined).
+ *
+ * A voice's GET_NEXT_SAMPLE_DURATION assumes its state stays inside
+ * registers, which is only true when the voice runs alone: a few voices'
+ * state doesn't fit in the register file. So each voice also pays for
+ * loading its state from SRAM and storing back the bytes it changes, which
+ * it declares with GET_STATE_ACCESS_DURATION(). Only the voices without any
+ * compiler-generated branch declare it, since the forced delays which
+ * balance such branches only hold for the machine code they were measured
+ * on (see SquareWaveGenerator::getNextSample()), and a voice inside a mixer
+ * is compiled differently; the others (e.g. SquareWaveGenerator with a
+ * 32-bit accumulator) are rejected at compile time.
+ *
+ * With saturating additions, the result depends on the voices' order when an
+ * intermediate sum overflows (e.g. 30000 + 30000 - 30000 gives 2767, rather
+ * than 30000); this never happens if the sum of the amplitudes fits in 16
+ * bits.
+ */
+template<MixingMode MODE, typename... Voices>
+class Mixer {
+private:
+  static constexpr uint8_t VOICES_COUNT = sizeof...(Voices);
+  static_assert(VOICES_COUNT, "A mixer needs at least one voice!");
+  static_assert(
+    (... && IsMixerVoice<Voices>::value),
+    "Every voice must be branch-free and provide GET_STATE_ACCESS_DURATION()"
+    " (e.g. SquareWaveGenerator with a 16 or 24-bit accumulator)!"
+  );
+
+  VoiceList<Voices...> voices;
+
+public:
+  static constexpr uint8_t GET_HEADROOM_SHIFT(const uint8_t voicesCount) {
+    uint8_t shift = 0;
+    while ((1u << shift) < voicesCount) {
+      shift++;
+    }
+    return shift;
+  }
+
+  /**
+   * The number of CPU cycles required by the mixer itself, given the number of
+   * voices (their getNextSample() invocations are not included)
+   */
+  static constexpr uint16_t GET_MIXING_DURATION(const uint8_t voicesCount) {
+    return
+      MODE == MixingMode::HEADROOM
+      ? 2 * GET_HEADROOM_SHIFT(voicesCount) * voicesCount
+        + 2 * (voicesCount - 1)
+      : 8 * (voicesCount - 1);
+  }
+
+  /**
+   * The number of bits each voice is shifted by (HEADROOM mode only)
+   */
+  static constexpr uint8_t HEADROOM_SHIFT =
+    MODE == MixingMode::HEADROOM ? GET_HEADROOM_SHIFT(VOICES_COUNT) : 0;
+  /**
+   * The number of CPU cycles required to run getNextSample(), including the
+   * voices' state loads and stores
+   */
+  static constexpr uint16_t GET_NEXT_SAMPLE_DURATION =
+    (
+      0 + ... + (
+        Voices::GET_NEXT_SAMPLE_DURATION
+        + Voices::GET_STATE_ACCESS_DURATION()
+      )
+    )
+    + GET_MIXING_DURATION(VOICES_COUNT);
+
+  Mixer(Voices&... voices) : voices(voices...) {}
+
+  int16_t getFirstSample() {
+    return 0;
+  }
+
+  int16_t getNextSample() {
+    int16_t sum = scale(voices.voice.getNextSample());
+    voices.rest.forEach([&](auto& voice) {
+      sum = add(sum, scale(voice.getNextSample()));
+    });
+    return sum;
+  }
+
+private:
+  static int16_t scale(int16_t sample) {
+    if constexpr (HEADROOM_SHIFT != 0) {
+#ifdef __AVR__
+      asm(
+        ".rept %[shift]\n\t"
+        "asr %B[sample]\n\t"
+        "ror %A[sample]\n\t"
+        ".endr"
+        : [sample] "+r" (sample)
+        : [shift] "I" (HEADROOM_SHIFT)
+      );
+#else
+      sample >>= HEADROOM_SHIFT;
+#endif
+    }
+    return sample;
+  }
+
+  static int16_t add(int16_t sum, const int16_t sample) {
+    if constexpr (MODE == MixingMode::HEADROOM) {
+#ifdef __AVR__
+      asm(
+        "add %A[sum], %A[sample]\n\t"
+        "adc %B[sum], %B[sample]"
+        : [sum] "+r" (sum)
+        : [sample] "r" (sample)
+      );
+#else
+      sum += sample;
+#endif
+    } else {
+#ifdef __AVR__
+      asm(
+        "add %A[sum], %A[sample]\n\t"
+        "adc %B[sum], %B[sample]\n\t"
+        "brvs 1f\n\t"
+        "nop\n\t"
+        "rjmp .+0\n\t"
+        "rjmp 2f\n"
+        "1:\n\t"
+        "ldi %A[sum], 0xff\n\t"
+        "ldi %B[sum], 0x7f\n\t"
+        "adc %A[sum], __zero_reg__\n\t"
+        "adc %B[sum], __zero_reg__\n"
+        "2:"
+        : [sum] "+d" (sum)
+        : [sample] "r" (sample)
+      );
+#else
+      const int32_t wide = int32_t(sum) + sample;
+      sum = wide > INT16_MAX ? INT16_MAX : wide < INT16_MIN ? INT16_MIN : wide;
+#endif
+    }
+    return sum;
+  }
+};
+
+
+template<MixingMode MODE, typename... Voices>
+inline Mixer<MODE, Voices...> mixVoices(Voices&... voices) {
+  return {voices...};
+}
+
+
+/**
+ * Computes the maximum number of voices of type Voice that a Mixer can sum
+ * within a single frame slot of Driver (i.e. between two sendSample()
+ * invocations), when nothing else runs in that slot.
+ *
+ * Each voice costs its GET_NEXT_SAMPLE_DURATION plus its
+ * GET_STATE_ACCESS_DURATION() (see Mixer). The first slot's budget is used,
+ * because it's the smaller one and it's the slot where mono signals must be
+ * computed (see FrameScheduler).
+ */
+template<typename Driver, typename Voice, MixingMode MODE>
+constexpr uint8_t GET_MAX_MIXER_VOICES() {
+  constexpr uint16_t SLOT_BUDGET =
+    FrameScheduler<Driver>::FIRST_SLOT_IDLE_CYCLES;
+  static_assert(
+    IsMixerVoice<Voice>::value,
+    "Voice must be branch-free and provide GET_STATE_ACCESS_DURATION()!"
+  );
+  uint8_t count = 0;
+  while (
+    count < 255
+    && (count + 1) * uint16_t(
+        Voice::GET_NEXT_SAMPLE_DURATION + Voice::GET_STATE_ACCESS_DURATION()
+      )
+      + Mixer<MODE, Voice>::GET_MIXING_DURATION(count + 1)
+      <= SLOT_BUDGET
+  ) {
+    count++;
+  }
+  return count;
+}
@@ -0,0 +1,110 @@
+#pragma once
+
+#include <stdint.h>
+#include "type_traits_clone.hpp"
+
+
+/**
+ * Lock-free ring buffer, meant to be shared between exactly one producer and
+ * one consumer (e.g. the main program and an interrupt handler).
+ *
+ * Template parameters:
+ * - T, the type of the stored items;
+ * - SIZE, the number of slots, which must be a power of 2 between 2 and 256
+ *   (included).
+ *
+ * One slot is always left empty, in order to tell a full buffer apart from an
+ * empty one; thus, the buffer holds at most SIZE - 1 items.
+ *
+ * Some technical considerations.
+ *
+ * Both indices fit in a single byte, so reading or writing them is atomic on
+ * the AVR architecture, and no interrupts need to be disabled. Each index is
+ * only ever written by one side: the producer writes head, the consumer
+ * writes tail. An item is only published (by advancing head) after it has
+ * been fully written, and only released (by advancing tail) after it has been
+ * fully read; the empty asm statements are compiler barriers, which prevent
+ * the compiler from moving the accesses to the items past the index updates.
+ *
+ * Since SIZE is a power of 2, wrapping an index around is a single andi
+ * instruction (or nothing at all, when SIZE is 256).
+ */
+template<
+  typename T,
+  uint16_t SIZE,
+  enable_if_t<SIZE >= 2 && SIZE <= 256 && !(SIZE & (SIZE - 1)), int> = 0
+>
+class RingBuffer {
+private:
+  static constexpr uint8_t MASK = SIZE - 1;
+  T items[SIZE];
+  volatile uint8_t head = 0;
+  volatile uint8_t tail = 0;
+
+public:
+  /**
+   * The maximum number of items the buffer can hold
+   */
+  static constexpr uint8_t CAPACITY = SIZE - 1;
+
+  uint8_t getUsedSpace() const {
+    return (head - tail) & MASK;
+  }
+
+  uint8_t getFreeSpace() const {
+    return CAPACITY - getUsedSpace();
+  }
+
+  /**
+   * Producer side: appends an item, unless the buffer is full (in which case
+   * false is returned)
+   */
+  bool push(const T& item) {
+    uint8_t currentHead = head;
+    uint8_t nextHead = (currentHead + 1) & MASK;
+    if (nextHead == tail) {
+      return false;
+    }
+    items[currentHead] = item;
+    asm volatile("" ::: "memory");
+    head = nextHead;
+    return true;
+  }
+
+  /**
+   * Producer side: appends count items at once, building the i-th one with
+   * makeItem(i), unless there's not enough space (in which case nothing is
+   * pushed and false is returned). head is only updated once, after every
+   * item has been written.
+   */
+  template<typename Function>
+  bool pushBlock(const uint8_t count, Function makeItem) {
+    if (getFreeSpace() < count) {
+      return false;
+    }
+    uint8_t index = head;
+    for (uint8_t i = 0; i < count; i++) {
+      items[index] = makeItem(i);
+      index = (index + 1) & MASK;
+    }
+    asm volatile("" ::: "memory");
+    head = index;
+    return true;
+  }
+
+  /**
+   * Consumer side: removes the oldest item and copies it into item, unless
+   * the buffer is empty (in which case false is returned and item is left
+   * untouched)
+   */
+  bool pop(T& item) {
+    uint8_t currentTail = tail;
+    if (currentTail == head) {
+      return false;
+    }
+    item = items[currentTail];
+    asm volatile("" ::: "memory");
+    tail = (currentTail + 1) & MASK;
+    return true;
+  }
+};
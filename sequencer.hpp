@@ -0,0 +1,205 @@
+#pragma once
+
+/*
+ * Interrupts are disabled while the driver runs, so millis() and delay() are
+ * of no use for timing a song. The sequencer in this header uses the frame as
+ * its clock instead: it reads a stream of events from flash, and applies them
+ * from within a work item whose duration doesn't depend on whether an event is
+ * due.
+ *
+ * TICK_DURATION was counted from the instructions tick() needs, not measured
+ * on a listing yet.
+ */
+
+#include <avr/pgmspace.h>
+#include "control_rate.hpp"
+#include "delay_in_cycles.hpp"
+#include "frame_scheduler.hpp"
+
+
+/**
+ * Commands with a special meaning (see SequencerEvent); the other ones, from
+ * 0 up, select the sequencer's handlers
+ */
+constexpr uint8_t SEQUENCER_REST = 0xfe;
+constexpr uint8_t SEQUENCER_JUMP = 0xff;
+
+
+/**
+ * A single event of a song, stored in flash:
+ * - command, which handler applies the event (0 for the first handler passed
+ *   to sequencerWorkItem(), e.g. note on, 1 for the second one, e.g. note off,
+ *   and so on), or one of the following:
+ *   - SEQUENCER_REST, which does nothing (useful for pauses longer than 65535
+ *     frames);
+ *   - SEQUENCER_JUMP, which continues from the value-th event of the song (for
+ *     loops; a jump to itself, with frames set to 0xffff, stops the song);
+ * - voice and value, the arguments of the handler (e.g. which generator plays
+ *   the note, and its frequency as a phase increment, precomputed for the
+ *   driver's FRAME_PERIOD by the generator's constexpr functions);
+ * - frames, the number of frames between this event and the next one (at
+ *   least 1).
+ */
+struct SequencerEvent {
+  uint8_t command;
+  uint8_t voice;
+  uint16_t frames;
+  uint32_t value;
+};
+
+
+/**
+ * Returns the number of frames which last (approximately) the given time, at
+ * least 1 and at most 65535
+ */
+constexpr uint16_t GET_SEQUENCER_FRAMES(
+  const uint16_t frameCycles,
+  const uint32_t milliseconds
+) {
+  const uint64_t frames =
+    (uint64_t(F_CPU) * milliseconds / 1000 + frameCycles / 2) / frameCycles;
+  return frames < 1 ? 1 : frames > 0xffff ? 0xffff : frames;
+}
+
+
+/**
+ * Plays a song (an array of SequencerEvent stored in flash), using frames as
+ * its timebase.
+ *
+ * The sequencer only keeps track of time and reads the events; applying them
+ * is up to the handlers passed to sequencerWorkItem(), which read the event's
+ * arguments with getVoice() and getValue(). tick() must be invoked exactly
+ * once per frame, which sequencerWorkItem() takes care of.
+ *
+ * Events are applied one per frame at most: events meant to happen at the
+ * same time (e.g. the notes of a chord) are written with frames set to 1, and
+ * they're applied on consecutive frames, i.e. a few tens of microseconds
+ * apart.
+ *
+ * Some technical considerations.
+ *
+ * Every frame sets the command to SEQUENCER_REST, so that no handler runs,
+ * and decrements a 16-bit countdown. When the countdown reaches 0, the next
+ * event is read from flash (with lpm, the 8 bytes take the same time no
+ * matter the event), overwriting the command, and the countdown is reloaded
+ * with its frames; otherwise, the same time is spent in a forced delay. The
+ * command is cleared before the branch (behind a compiler barrier, so it
+ * can't be moved into the other arm), so both arms pay for the same stores.
+ * Jumps are handled while reading the event, with a balanced branch.
+ *
+ * TICK_DURATION adds up these steps:
+ * - clearing the command (ldi and sts, 3 cycles);
+ * - countdown load, decrement, store and test, including the branch (13
+ *   cycles);
+ * - event read, including the address computation (26 cycles);
+ * - next event's address, including the jump's branch (8 cycles);
+ * - storing the state, i.e. command, voice, countdown, value and next (20
+ *   cycles).
+ */
+class Sequencer {
+private:
+  /**
+   * The number of CPU cycles required to read an event and store it, i.e.
+   * the forced delay used when no event is due
+   */
+  static constexpr uint8_t READ_DURATION = 54;
+
+  const SequencerEvent* events;
+  const SequencerEvent* next;
+  uint16_t countdown;
+  uint8_t command;
+  uint8_t voice;
+  uint32_t value;
+
+public:
+  /**
+   * The number of CPU cycles required to run tick()
+   */
+  static constexpr uint8_t TICK_DURATION = READ_DURATION + 16;
+
+  /**
+   * events must point to an array stored in flash (PROGMEM); the first event
+   * is applied on the first frame
+   */
+  constexpr Sequencer(const SequencerEvent* events) :
+    events(events),
+    next(events),
+    countdown(1),
+    command(SEQUENCER_REST),
+    voice(0),
+    value(0)
+  {}
+
+  /**
+   * Starts playing the song from its beginning, on the next frame
+   */
+  void restart() {
+    next = events;
+    countdown = 1;
+  }
+
+  /**
+   * The command to apply on the current frame, or SEQUENCER_REST
+   */
+  uint8_t getCommand() const {
+    return command;
+  }
+
+  uint8_t getVoice() const {
+    return voice;
+  }
+
+  uint32_t getValue() const {
+    return value;
+  }
+
+  void tick() {
+    command = SEQUENCER_REST;
+    asm volatile("" ::: "memory");
+    if (--countdown) {
+      delayInCyclesWithAsmLoop<READ_DURATION>();
+    } else {
+      const SequencerEvent* event = next;
+      command = pgm_read_byte(&event->command);
+      voice = pgm_read_byte(&event->voice);
+      countdown = pgm_read_word(&event->frames);
+      value = pgm_read_dword(&event->value);
+      if (command == SEQUENCER_JUMP) {
+        next = events + uint16_t(value);
+      } else {
+        delayInCyclesWithNOP<1>();
+        next = event + 1;
+      }
+    }
+  }
+};
+
+
+/**
+ * Returns a work item (see FrameScheduler) which advances sequencer by one
+ * frame and, when an event is due, runs the handler selected by its command
+ * (work items themselves, whose durations must be constant like any other
+ * work item's, e.g. workItem<...>([&] { osc.setPhaseIncrement(
+ * sequencer.getValue()); envelope.noteOn(); })). Like in controlRateWorkItem(),
+ * the handlers are padded to the longest one, so every frame costs the same
+ * number of cycles, whether an event is applied or not.
+ */
+template<typename... Handlers>
+inline auto sequencerWorkItem(Sequencer& sequencer, Handlers... handlers) {
+  static_assert(
+    sizeof...(Handlers) && sizeof...(Handlers) < SEQUENCER_REST,
+    "There must be at least one handler, and less than SEQUENCER_REST!"
+  );
+  constexpr uint16_t CHUNK_DURATION =
+    GET_CONTROL_RATE_CHUNK_DURATION<Handlers...>();
+  return workItem<Sequencer::TICK_DURATION + CHUNK_DURATION + 2>(
+    [&sequencer, handlers...]() mutable {
+      sequencer.tick();
+      // The command is loaded from SRAM (2 cycles)
+      runControlRateChunk<CHUNK_DURATION, 0>(
+        sequencer.getCommand(),
+        handlers...
+      );
+    }
+  );
+}
@@ -3,7 +3,8 @@
 /*
  * Unfortunately, the AVR toolchain doesn't provide many standard C++ headers.
  * This header file is a replacement for <type_traits>, and it only provides the
- * template helpers enable_if and enable_if_t.
+ * template helpers enable_if, enable_if_t, void_t, conditional, conditional_t
+ * and is_same.
  * 
  * Implementation copied-n-pasted from
  * https://en.cppreference.com/w/cpp/types/enable_if
@@ -17,3 +18,21 @@ struct enable_if<true, T> { typedef T type; };
 
 template<bool B, class T = void>
 using enable_if_t = typename enable_if<B,T>::type;
+
+template<class...>
+using void_t = void;
+
+template<bool B, class T, class F>
+struct conditional { typedef T type; };
+
+template<class T, class F>
+struct conditional<false, T, F> { typedef F type; };
+
+template<bool B, class T, class F>
+using conditional_t = typename conditional<B,T,F>::type;
+
+template<class T, class U>
+struct is_same { static constexpr bool value = false; };
+
+template<class T>
+struct is_same<T, T> { static constexpr bool value = true; };
@@ -1,7 +1,153 @@
 #pragma once
 
+/*
+ * Apart from SquareWaveGenerator's 32-bit version, measured on
+ * disassembler-output.txt, the durations in this header were counted from
+ * the instructions each computation needs, and haven't been checked on a
+ * listing yet (extras/simulator can run one).
+ */
+
+#include <avr/pgmspace.h>
+#include "delay_in_cycles.hpp"
+#include "dpcm.hpp"
 #include "i2s_driver.hpp"
 #include "type_traits_clone.hpp"
+#include "wavetables.hpp"
+
+
+/**
+ * Integer types and timing information for each supported phase accumulator
+ * size (16, 24 and 32 bits), used by SquareWaveGenerator.
+ *
+ * The 32-bit accumulator runs the C++ version of getNextSample(), whose
+ * duration was measured on disassembler-output.txt (see SquareWaveGenerator).
+ * The branches of that version are only balanced for the machine code the
+ * compiler generated there, so the smaller accumulators don't reuse it: on AVR
+ * targets, they run getNextSquareSample(), written in assembly without any
+ * branch (see the breakdown above each one), so their duration doesn't depend
+ * on the compiler, nor on the constants involved. Like any work item's
+ * duration, GET_NEXT_SAMPLE_DURATION doesn't include the jump back to the
+ * start of the main loop (see FrameScheduler::LOOP_JUMP_DURATION), and it
+ * assumes the generator's state is kept inside registers, like in the
+ * measured listing.
+ */
+template<uint8_t BITS>
+struct PhaseAccumulator;
+
+template<>
+struct PhaseAccumulator<16> {
+  using Unsigned = uint16_t;
+  using Signed = int16_t;
+  /*
+   * - addition (2 cycles);
+   * - subtraction of the period, on a copy (3 cycles);
+   * - wrap-around, a skip around a movw (2 cycles, either way);
+   * - comparison with half the period, on a copy (3 cycles);
+   * - sign mask from the comparison's carry (1 cycle);
+   * - conditional negation of the amplitude (5 cycles).
+   */
+  static constexpr uint8_t GET_NEXT_SAMPLE_DURATION = 16;
+
+#ifdef __AVR__
+  template<uint32_t PERIOD, uint32_t HALF_PERIOD>
+  static int16_t getNextSquareSample(
+    Unsigned& elapsed,
+    const Unsigned increment,
+    const int16_t amplitude
+  ) {
+    Unsigned tmp;
+    int16_t sample;
+    asm(
+      "add %A[elapsed], %A[increment]\n\t"
+      "adc %B[elapsed], %B[increment]\n\t"
+      "movw %A[tmp], %A[elapsed]\n\t"
+      "subi %A[tmp], lo8(%[period])\n\t"
+      "sbci %B[tmp], hi8(%[period])\n\t"
+      "sbrs %B[tmp], 7\n\t"
+      "movw %A[elapsed], %A[tmp]\n\t"
+      "movw %A[tmp], %A[elapsed]\n\t"
+      "subi %A[tmp], lo8(%[half])\n\t"
+      "sbci %B[tmp], hi8(%[half])\n\t"
+      "sbc %A[tmp], %A[tmp]\n\t"
+      "movw %A[sample], %A[amplitude]\n\t"
+      "eor %A[sample], %A[tmp]\n\t"
+      "eor %B[sample], %A[tmp]\n\t"
+      "sub %A[sample], %A[tmp]\n\t"
+      "sbc %B[sample], %A[tmp]"
+      : [elapsed] "+r" (elapsed), [tmp] "=&d" (tmp), [sample] "=&r" (sample)
+      : [increment] "r" (increment),
+        [amplitude] "r" (amplitude),
+        [period] "n" (PERIOD),
+        [half] "n" (HALF_PERIOD)
+    );
+    return sample;
+  }
+#endif
+};
+
+template<>
+struct PhaseAccumulator<24> {
+  using Unsigned = __uint24;
+  using Signed = __int24;
+  /*
+   * - addition (3 cycles);
+   * - subtraction of the period, on a copy (5 cycles);
+   * - wrap-around, a skip around a movw and a mov (4 cycles, either way);
+   * - comparison with half the period, on a copy of the top byte only (2
+   *   cycles, see HALF_PERIOD_IN_TICKS inside SquareWaveGenerator);
+   * - sign mask from the comparison's carry (1 cycle);
+   * - conditional negation of the amplitude (5 cycles).
+   */
+  static constexpr uint8_t GET_NEXT_SAMPLE_DURATION = 20;
+
+#ifdef __AVR__
+  template<uint32_t PERIOD, uint32_t HALF_PERIOD>
+  static int16_t getNextSquareSample(
+    Unsigned& elapsed,
+    const Unsigned increment,
+    const int16_t amplitude
+  ) {
+    Unsigned tmp;
+    int16_t sample;
+    asm(
+      "add %A[elapsed], %A[increment]\n\t"
+      "adc %B[elapsed], %B[increment]\n\t"
+      "adc %C[elapsed], %C[increment]\n\t"
+      "movw %A[tmp], %A[elapsed]\n\t"
+      "mov %C[tmp], %C[elapsed]\n\t"
+      "subi %A[tmp], lo8(%[period])\n\t"
+      "sbci %B[tmp], hi8(%[period])\n\t"
+      "sbci %C[tmp], hlo8(%[period])\n\t"
+      "sbrs %C[tmp], 7\n\t"
+      "movw %A[elapsed], %A[tmp]\n\t"
+      "sbrs %C[tmp], 7\n\t"
+      "mov %C[elapsed], %C[tmp]\n\t"
+      "mov %A[tmp], %C[elapsed]\n\t"
+      "subi %A[tmp], hlo8(%[half])\n\t"
+      "sbc %A[tmp], %A[tmp]\n\t"
+      "movw %A[sample], %A[amplitude]\n\t"
+      "eor %A[sample], %A[tmp]\n\t"
+      "eor %B[sample], %A[tmp]\n\t"
+      "sub %A[sample], %A[tmp]\n\t"
+      "sbc %B[sample], %A[tmp]"
+      : [elapsed] "+r" (elapsed), [tmp] "=&d" (tmp), [sample] "=&r" (sample)
+      : [increment] "r" (increment),
+        [amplitude] "r" (amplitude),
+        [period] "n" (PERIOD),
+        [half] "n" (HALF_PERIOD)
+    );
+    return sample;
+  }
+#endif
+};
+
+template<>
+struct PhaseAccumulator<32> {
+  using Unsigned = uint32_t;
+  using Signed = int32_t;
+  // 6 + 7 + 6 + 4, measured (see SquareWaveGenerator)
+  static constexpr uint8_t GET_NEXT_SAMPLE_DURATION = 23;
+};
 
 
 /**
@@ -73,30 +219,135 @@
  * measuring time. Rather than measuring it in multiples of a CPU clock cycle,
  * we're using a smaller unit, a "tick", such that a clock cycle contains
  * exactly F_WAVE ticks.
+ *
+ * The template parameter ACCUMULATOR_BITS (16, 24 or 32) selects the size of
+ * elapsedTicks and ticksIncrement. On an 8-bit CPU every additional byte costs
+ * more instructions in each addition, subtraction and comparison, but F_CPU
+ * doesn't fit in less than 32 bits (at least not with the signed comparison
+ * trick explained below). Smaller accumulators thus use bigger ticks: every
+ * value is divided by 2^TICKS_SHIFT, TICKS_SHIFT being the smallest value
+ * which makes PERIOD_IN_TICKS fit. PERIOD_IN_TICKS stays exact (F_CPU must be
+ * a multiple of 2^TICKS_SHIFT), while ticksIncrement gets rounded to the
+ * nearest integer, and that's where the frequency error comes from: the
+ * generated frequency is ticksIncrement * 2^TICKS_SHIFT / FRAME_PERIOD, so
+ * rounding can move it by up to 2^(TICKS_SHIFT - 1) / FRAME_PERIOD Hz
+ * (MAX_FREQUENCY_ERROR_MILLIHERTZ). With a 16 MHz clock and a frame period of
+ * 320 cycles, that's 0 for 32 bits, about 3 mHz for 24 bits and 0.8 Hz for 16
+ * bits (about 3 cents at 440 Hz).
  */
 template<
   uint16_t FRAME_PERIOD_IN_CYCLES,
+  uint8_t ACCUMULATOR_BITS = 32,
   enable_if_t<FRAME_PERIOD_IN_CYCLES, int> = 0
 >
 class SquareWaveGenerator {
 private:
-  static const uint32_t PERIOD_IN_TICKS = F_CPU;
-  uint32_t ticksIncrement;
-  uint32_t elapsedTicks;
+  using Accumulator =
+    typename PhaseAccumulator<ACCUMULATOR_BITS>::Unsigned;
+  using SignedAccumulator =
+    typename PhaseAccumulator<ACCUMULATOR_BITS>::Signed;
+
+  /**
+   * elapsedTicks - PERIOD_IN_TICKS must fit inside SignedAccumulator, and
+   * elapsedTicks + ticksIncrement (where ticksIncrement doesn't exceed
+   * PERIOD_IN_TICKS / 2) must fit inside Accumulator; both are true as long as
+   * PERIOD_IN_TICKS doesn't exceed 2^(ACCUMULATOR_BITS - 1).
+   */
+  static constexpr uint8_t GET_TICKS_SHIFT() {
+    uint8_t shift = 0;
+    while ((uint32_t(F_CPU) >> shift) > uint32_t(1) << (ACCUMULATOR_BITS - 1)) {
+      shift++;
+    }
+    return shift;
+  }
+
+  static constexpr uint8_t TICKS_SHIFT = GET_TICKS_SHIFT();
+  static_assert(
+    !(uint32_t(F_CPU) & ((uint32_t(1) << TICKS_SHIFT) - 1)),
+    "F_CPU is not a multiple of 2^TICKS_SHIFT!"
+  );
+  static constexpr Accumulator PERIOD_IN_TICKS =
+    uint32_t(F_CPU) >> TICKS_SHIFT;
+  /**
+   * The threshold between the negative and the positive half of the wave.
+   * With a 24-bit accumulator, it's rounded to a multiple of 2^16, so that
+   * only elapsedTicks' top byte needs to be compared (3 cycles less); the
+   * duty cycle moves away from 50% by at most 2^15 / PERIOD_IN_TICKS (0.4%
+   * with a 16 MHz clock), which is less than a single frame's share of the
+   * period above 2^(15 + TICKS_SHIFT) / FRAME_PERIOD_IN_CYCLES Hz (205 Hz
+   * with a 16 MHz clock and 320-cycle frames).
+   */
+  static constexpr Accumulator HALF_PERIOD_IN_TICKS =
+    ACCUMULATOR_BITS == 24
+    ? (uint32_t(PERIOD_IN_TICKS / 2) + 0x8000) & 0xff0000
+    : PERIOD_IN_TICKS / 2;
+  Accumulator ticksIncrement;
+  Accumulator elapsedTicks;
   int16_t amplitude;
   
 public:
   /**
    * The number of CPU cycles required to run getNextSample()
    */
-  static constexpr uint8_t GET_NEXT_SAMPLE_DURATION = 25;
+  static constexpr uint8_t GET_NEXT_SAMPLE_DURATION =
+    PhaseAccumulator<ACCUMULATOR_BITS>::GET_NEXT_SAMPLE_DURATION;
+  /**
+   * The worst-case difference between the requested frequency and the
+   * generated one (in mHz, rounded up)
+   */
+  static constexpr uint32_t MAX_FREQUENCY_ERROR_MILLIHERTZ =
+    TICKS_SHIFT
+    ? ((uint32_t(1000) << (TICKS_SHIFT - 1)) + FRAME_PERIOD_IN_CYCLES - 1)
+      / FRAME_PERIOD_IN_CYCLES
+    : 0;
+
+  /**
+   * The number of CPU cycles required to load elapsedTicks, ticksIncrement
+   * and amplitude from SRAM, and to store elapsedTicks back (2 cycles per
+   * byte, lds or sts), when they can't stay inside registers (see Mixer).
+   * Only provided for the 16 and 24-bit accumulators, whose getNextSample()
+   * has no branches.
+   */
+  template<
+    uint8_t BITS = ACCUMULATOR_BITS,
+    enable_if_t<BITS != 32, int> = 0
+  >
+  static constexpr uint8_t GET_STATE_ACCESS_DURATION() {
+    return 2 * (3 * (ACCUMULATOR_BITS / 8) + 2);
+  }
+
+  /**
+   * Computes ticksIncrement for the given frequency (in Hz); when frequency is
+   * a constant, so is the result.
+   */
+  static constexpr Accumulator GET_TICKS_INCREMENT(const uint32_t frequency) {
+    return
+      (
+        uint32_t(FRAME_PERIOD_IN_CYCLES) * frequency
+        + (TICKS_SHIFT ? uint32_t(1) << (TICKS_SHIFT - 1) : 0)
+      )
+      >> TICKS_SHIFT;
+  }
 
-  SquareWaveGenerator(uint32_t frequency, int16_t amplitude) :
-    ticksIncrement(FRAME_PERIOD_IN_CYCLES * frequency),
+  constexpr SquareWaveGenerator(uint32_t frequency, int16_t amplitude) :
+    ticksIncrement(GET_TICKS_INCREMENT(frequency)),
     elapsedTicks(0),
     amplitude(amplitude)
   {}
 
+  /**
+   * Changes the frequency (see GET_TICKS_INCREMENT(), which is best computed
+   * in advance, since it requires a 32-bit multiplication); elapsedTicks is
+   * kept, so there's no discontinuity
+   */
+  void setTicksIncrement(Accumulator increment) {
+    ticksIncrement = increment;
+  }
+
+  void setAmplitude(int16_t value) {
+    amplitude = value;
+  }
+
   int16_t getFirstSample() {
     return 0;
   }
@@ -121,8 +372,17 @@ public:
    *   - like the first if-else, a forced delay made sure both branches took the
    *     same number of cycles;
    *   - the machine code includes the jumps required to go back to the start of
-   *     the infinite loop inside main().
-   * The entire method takes 25 cycles.
+   *     the infinite loop inside main() (2 cycles, in both branches).
+   * The entire method takes 25 cycles with a 32-bit accumulator, the loop's
+   * jump included. GET_NEXT_SAMPLE_DURATION leaves the jump out (23 cycles),
+   * since FrameScheduler accounts for it separately (LOOP_JUMP_DURATION).
+   *
+   * Notice how the forced delays only balance the branches for this specific
+   * machine code: the compiler folded ticksIncrement and PERIOD_IN_TICKS into
+   * immediate operands, and skipped the byte of ticksIncrement which happened
+   * to be 0. With smaller accumulators, where there's no measured listing, the
+   * whole method is written in assembly instead, without any branch (see
+   * PhaseAccumulator).
    * 
    * The section which makes sure elapsedTicks doesn't exceed PERIOD_IN_TICKS
    * deserves an in-depth discussion on some technical aspects.
@@ -146,17 +406,1098 @@ public:
    * it ended up doing).
    */
   int16_t getNextSample() {
+#ifdef __AVR__
+    if constexpr (ACCUMULATOR_BITS != 32) {
+      return PhaseAccumulator<ACCUMULATOR_BITS>
+        ::template getNextSquareSample<PERIOD_IN_TICKS, HALF_PERIOD_IN_TICKS>(
+          elapsedTicks,
+          ticksIncrement,
+          amplitude
+        );
+    }
+#endif
     elapsedTicks += ticksIncrement;
-    int32_t tmp = elapsedTicks - PERIOD_IN_TICKS;
+    SignedAccumulator tmp = elapsedTicks - PERIOD_IN_TICKS;
     if (tmp >= 0) {
       delayInCyclesWithNOP<4>();
       elapsedTicks = tmp;
     }
-    if (elapsedTicks >= PERIOD_IN_TICKS / 2) {
+    if (elapsedTicks >= HALF_PERIOD_IN_TICKS) {
       return amplitude;
     } else {
       delayInCyclesWithNOP<1>();
       return -amplitude;
     }
   }
+
+  /**
+   * Writes the next count samples into out, producing the same values as
+   * count invocations of getNextSample().
+   *
+   * The generator's state is copied into local variables, so the compiler can
+   * keep it inside registers for the whole block, and only write it back at
+   * the end; this avoids reloading elapsedTicks, ticksIncrement and amplitude
+   * from SRAM (and the call overhead) on every sample. On the other hand,
+   * there are no forced delays: the duration of each sample depends on the
+   * branches taken, so this method is meant for producers which don't need
+   * cycle-exact timing (such as the ones feeding BufferedI2SDriver).
+   *
+   * A count of 0 writes nothing.
+   */
+  void renderBlock(int16_t* out, uint8_t count) {
+    Accumulator elapsed = elapsedTicks;
+    const Accumulator increment = ticksIncrement;
+    const int16_t high = amplitude;
+    const int16_t low = -amplitude;
+    while (count--) {
+      elapsed += increment;
+      SignedAccumulator tmp = elapsed - PERIOD_IN_TICKS;
+      if (tmp >= 0) {
+        elapsed = tmp;
+      }
+      *out++ = elapsed >= HALF_PERIOD_IN_TICKS ? high : low;
+    }
+    elapsedTicks = elapsed;
+  }
+};
+
+
+/**
+ * Wavetable oscillator, which plays a single-cycle waveform stored in flash
+ * (see wavetables.hpp for the tables' layout and some ready-made ones).
+ *
+ * Template parameters:
+ * - FRAME_PERIOD_IN_CYCLES, same as SquareWaveGenerator;
+ * - INTERPOLATE, whether to linearly interpolate between two consecutive
+ *   table samples (smoother output, especially at low frequencies, but more
+ *   cycles per sample).
+ *
+ * The phase is a 24-bit fixed-point number which counts waveform periods: the
+ * 8 most significant bits are the table index, the following 8 are the
+ * fraction used by the interpolation, and the remaining ones only add
+ * precision to the accumulator. This is a classic direct digital synthesis
+ * (DDS) oscillator: every sample, the phase is incremented by
+ * f * 2^24 / F_SAMPLE, and it wraps around on its own when it overflows, so
+ * there are no branches at all, and the duration doesn't depend on the
+ * phase. With a frame period of 320 cycles (50 kHz), the frequency
+ * resolution is about 3 mHz.
+ *
+ * The table sample (between -127 and 127) is multiplied by amplitude
+ * (between 0 and 255), so the output ranges from -32385 to 32385.
+ *
+ * Some technical considerations.
+ *
+ * Everything is done with 8-bit multiplications, which the hardware multiplier
+ * performs in 2 cycles (mul and mulsu); wider multiplications would make the
+ * compiler call a library function instead. When interpolating, the sample is
+ *   s0 * 256 + (s1 - s0) * fraction = s0 * 256 - s0 * fraction + s1 * fraction
+ * which only needs 8-bit operands (s1 - s0 wouldn't fit in 8 bits). Scaling
+ * the resulting 16-bit value by amplitude is split between its high and low
+ * bytes as well (see multiplyAndShift()).
+ *
+ * Thanks to the guard sample at the end of each table, s1 is read with the
+ * post-increment form of lpm, and the index never needs to wrap around.
+ *
+ * GET_NEXT_SAMPLE_DURATION assumes the generator's state lives inside
+ * registers, like in main().
+ */
+template<
+  uint16_t FRAME_PERIOD_IN_CYCLES,
+  bool INTERPOLATE = false,
+  enable_if_t<FRAME_PERIOD_IN_CYCLES, int> = 0
+>
+class WavetableGenerator {
+private:
+  const int8_t* table;
+  __uint24 phase;
+  __uint24 phaseIncrement;
+  uint8_t amplitude;
+
+  /**
+   * Computes value * factor / 256 (rounded towards negative infinity) with
+   * two 8-bit multiplications
+   */
+  static int16_t multiplyAndShift(const int16_t value, const uint8_t factor) {
+    const int16_t high = int8_t(value >> 8) * factor;
+    const uint8_t low = (uint8_t(value) * factor) >> 8;
+    return high + low;
+  }
+
+public:
+  /**
+   * The number of CPU cycles required to run getNextSample():
+   * - phase increment (3 cycles);
+   * - table address computation (3 cycles);
+   * - without interpolation:
+   *   - table read (3 cycles);
+   *   - multiplication by amplitude and result copy (4 cycles);
+   * - with interpolation:
+   *   - two table reads (6 cycles);
+   *   - s0 * 256 (2 cycles);
+   *   - two multiplications by fraction and their accumulation (8 cycles);
+   *   - multiplication by amplitude (multiplyAndShift(), 9 cycles);
+   * - a few register copies, because mul and mulsu only accept some registers
+   *   (2 cycles).
+   */
+  static constexpr uint8_t GET_NEXT_SAMPLE_DURATION = INTERPOLATE ? 33 : 15;
+
+  /**
+   * The number of CPU cycles required to load table, phase, phaseIncrement
+   * and amplitude from SRAM (9 bytes), and to store phase back (3 bytes),
+   * when they can't stay inside registers (see Mixer)
+   */
+  static constexpr uint8_t GET_STATE_ACCESS_DURATION() {
+    return 2 * (9 + 3);
+  }
+
+  /**
+   * Computes phaseIncrement for the given frequency (in Hz); when frequency
+   * is a constant, so is the result.
+   */
+  static constexpr __uint24 GET_PHASE_INCREMENT(const uint32_t frequency) {
+    return
+      (
+        (uint64_t(FRAME_PERIOD_IN_CYCLES) * frequency << 24)
+        + uint32_t(F_CPU) / 2
+      )
+      / uint32_t(F_CPU);
+  }
+
+  /**
+   * table must point to a table stored in flash (PROGMEM)
+   */
+  constexpr WavetableGenerator(
+    const int8_t* table,
+    uint32_t frequency,
+    uint8_t amplitude
+  ) :
+    table(table),
+    phase(0),
+    phaseIncrement(GET_PHASE_INCREMENT(frequency)),
+    amplitude(amplitude)
+  {}
+
+  /**
+   * Changes the frequency (see GET_PHASE_INCREMENT()) without resetting the
+   * phase
+   */
+  void setPhaseIncrement(__uint24 increment) {
+    phaseIncrement = increment;
+  }
+
+  void setAmplitude(uint8_t value) {
+    amplitude = value;
+  }
+
+  int16_t getFirstSample() {
+    return int8_t(pgm_read_byte(table)) * amplitude;
+  }
+
+  int16_t getNextSample() {
+    phase += phaseIncrement;
+    const int8_t* address = table + uint8_t(phase >> 16);
+    const int8_t s0 = pgm_read_byte(address);
+    if constexpr (!INTERPOLATE) {
+      return s0 * amplitude;
+    } else {
+      const int8_t s1 = pgm_read_byte(address + 1);
+      const uint8_t fraction = phase >> 8;
+      const int16_t value = s0 * 256 - s0 * fraction + s1 * fraction;
+      return multiplyAndShift(value, amplitude);
+    }
+  }
+};
+
+
+/**
+ * The waveforms BandLimitedGenerator can produce:
+ * - SQUARE, a square wave with a duty cycle of 50%, which is low during the
+ *   first half of the period (like SquareWaveGenerator);
+ * - SAWTOOTH, a rising sawtooth wave.
+ */
+enum class BandLimitedWaveform : uint8_t {
+  SQUARE,
+  SAWTOOTH
+};
+
+
+/**
+ * Square or sawtooth wave generator which reduces aliasing with PolyBLEP
+ * (polynomial band-limited step) corrections.
+ *
+ * Template parameters:
+ * - FRAME_PERIOD_IN_CYCLES, same as SquareWaveGenerator;
+ * - WAVEFORM, the generated waveform (see BandLimitedWaveform).
+ *
+ * As explained in SquareWaveGenerator's description, a "naive" square wave
+ * can't be clean: its sharp edges contain harmonics well beyond the Nyquist
+ * frequency, and these fold back as audible, inharmonic tones (aliasing). The
+ * same is true for the sawtooth's drop. PolyBLEP smooths every discontinuity
+ * over the two samples which surround it, subtracting a polynomial which
+ * approximates the difference between an ideal (band-limited) step and the
+ * naive one. Given the distance between a sample and the discontinuity,
+ * measured in samples (y, between 0 and 1), the correction is (1 - y)^2 times
+ * half the step's height, and it always pushes the sample towards the level
+ * on the other side of the discontinuity. Oversampling would achieve the same
+ * result, but it would multiply the generator's cost.
+ *
+ * The phase works like WavetableGenerator's one (a 24-bit DDS accumulator),
+ * and the output ranges from -amplitude * 128 to amplitude * 128 (amplitude
+ * being between 0 and 255).
+ *
+ * Some technical considerations.
+ *
+ * Dividing the distance by the phase increment would be far too slow, so the
+ * reciprocal of the increment (inverseIncrement) is computed once, by the
+ * constructor, and y is obtained with three 8-bit multiplications (the
+ * product of the two low bytes is neglected, which makes y slightly smaller,
+ * by 2/256 at most). A 16-bit reciprocal can represent the ones of frequencies
+ * down to MIN_FULLY_CORRECTED_FREQUENCY; below that, it's clamped, and
+ * samples farther than 1/256 of a period from a discontinuity are left
+ * uncorrected. Low frequencies have little aliasing to begin with, so this
+ * doesn't matter much.
+ *
+ * For square waves, both edges are handled as a single discontinuity of the
+ * phase multiplied by 2 (whose period is half the wave's period). Both
+ * waveforms are high (or rising towards their highest value) in the second
+ * half of the period, and a sample's distance from the closest discontinuity
+ * is the absolute value of the (doubled) phase, taken as a signed number. The
+ * absolute value and the final sign are computed without branches, with a
+ * mask made of copies of the sign bit.
+ *
+ * Whether the sample is close enough to a discontinuity to need a correction
+ * (y < 1) doesn't need a branch either: on AVR targets, the weight (the
+ * complement of y's low byte) is cleared by an instruction which cpse skips
+ * when y's high byte is 0, which takes 4 cycles either way, like
+ * GaloisLFSR::getSample().
+ */
+template<
+  uint16_t FRAME_PERIOD_IN_CYCLES,
+  BandLimitedWaveform WAVEFORM = BandLimitedWaveform::SQUARE,
+  enable_if_t<FRAME_PERIOD_IN_CYCLES, int> = 0
+>
+class BandLimitedGenerator {
+private:
+  /**
+   * The number of discontinuities per period
+   */
+  static constexpr uint8_t EDGES_PER_PERIOD =
+    WAVEFORM == BandLimitedWaveform::SQUARE ? 2 : 1;
+
+  __uint24 phase;
+  __uint24 phaseIncrement;
+  uint16_t inverseIncrement;
+  uint8_t amplitude;
+
+  static int16_t multiplyAndShift(const int16_t value, const uint8_t factor) {
+    const int16_t high = int8_t(value >> 8) * factor;
+    const uint8_t low = (uint8_t(value) * factor) >> 8;
+    return high + low;
+  }
+
+public:
+  /**
+   * The number of CPU cycles required to run getNextSample():
+   * - phase increment (3 cycles);
+   * - distance from the closest discontinuity, including the phase's doubling
+   *   for square waves (6 cycles, plus 2 for square waves);
+   * - y, three multiplications and their sum (13 cycles);
+   * - weight (mov, com, cpse and clr, 4 cycles) and its square (3 cycles);
+   * - correction (multiplication by amplitude and halving, 5 cycles);
+   * - naive sample (3 cycles for square waves, 9 for sawtooth waves);
+   * - final sum, with the sign applied (8 cycles);
+   * - clearing the zero register after the multiplications (1 cycle).
+   */
+  static constexpr uint8_t GET_NEXT_SAMPLE_DURATION =
+    WAVEFORM == BandLimitedWaveform::SQUARE ? 48 : 52;
+
+  /**
+   * The number of CPU cycles required to load phase, phaseIncrement,
+   * inverseIncrement and amplitude from SRAM (9 bytes), and to store phase
+   * back (3 bytes), when they can't stay inside registers (see Mixer)
+   */
+  static constexpr uint8_t GET_STATE_ACCESS_DURATION() {
+    return 2 * (9 + 3);
+  }
+  /**
+   * The lowest frequency (in Hz, rounded up) whose reciprocal increment fits
+   * in 16 bits (see the class' description)
+   */
+  static constexpr uint32_t MIN_FULLY_CORRECTED_FREQUENCY =
+    (uint32_t(F_CPU) + 256ul * EDGES_PER_PERIOD * FRAME_PERIOD_IN_CYCLES - 1)
+    / (256ul * EDGES_PER_PERIOD * FRAME_PERIOD_IN_CYCLES);
+
+  static constexpr __uint24 GET_PHASE_INCREMENT(const uint32_t frequency) {
+    return WavetableGenerator<FRAME_PERIOD_IN_CYCLES>::GET_PHASE_INCREMENT(
+      frequency
+    );
+  }
+
+  /**
+   * Computes inverseIncrement, i.e. 2^32 divided by the distance covered by
+   * the (doubled, for square waves) phase during one sample, clamped to 16
+   * bits
+   */
+  static constexpr uint16_t GET_INVERSE_INCREMENT(
+    const __uint24 phaseIncrement
+  ) {
+    const uint32_t step = uint32_t(phaseIncrement) * EDGES_PER_PERIOD;
+    return
+      step && (uint64_t(1) << 32) / step < 0xffff
+      ? (uint64_t(1) << 32) / step
+      : 0xffff;
+  }
+
+  constexpr BandLimitedGenerator(uint32_t frequency, uint8_t amplitude) :
+    phase(0),
+    phaseIncrement(GET_PHASE_INCREMENT(frequency)),
+    inverseIncrement(GET_INVERSE_INCREMENT(GET_PHASE_INCREMENT(frequency))),
+    amplitude(amplitude)
+  {}
+
+  void setAmplitude(uint8_t value) {
+    amplitude = value;
+  }
+
+  int16_t getFirstSample() {
+    return 0;
+  }
+
+  int16_t getNextSample() {
+    phase += phaseIncrement;
+    const uint16_t position = phase >> 8;
+    // 0 during the first half of the period, 0xffff during the second one
+    const uint16_t highMask = int16_t(position) >> 15;
+    const uint16_t edgePosition =
+      WAVEFORM == BandLimitedWaveform::SQUARE ? position << 1 : position;
+    const uint16_t edgeMask = int16_t(edgePosition) >> 15;
+    const uint16_t distance = (edgePosition ^ edgeMask) - edgeMask;
+
+    // y = distance / step (with 8 fractional bits), and 1 - y
+    const uint8_t distanceHigh = distance >> 8;
+    const uint8_t distanceLow = distance;
+    const uint8_t inverseHigh = inverseIncrement >> 8;
+    const uint8_t inverseLow = inverseIncrement;
+    const uint16_t y =
+      distanceHigh * inverseHigh
+      + (uint16_t(distanceHigh * inverseLow) >> 8)
+      + (uint16_t(distanceLow * inverseHigh) >> 8);
+    uint8_t weight;
+#ifdef __AVR__
+    asm(
+      "mov %[weight], %A[y]\n\t"
+      "com %[weight]\n\t"
+      "cpse %B[y], __zero_reg__\n\t"
+      "clr %[weight]"
+      : [weight] "=&r" (weight)
+      : [y] "r" (y)
+    );
+#else
+    weight = y >> 8 ? 0 : ~uint8_t(y);
+#endif
+    const uint8_t squaredWeight = (weight * weight) >> 8;
+    const int16_t correction = uint16_t(amplitude * squaredWeight) >> 1;
+
+    if constexpr (WAVEFORM == BandLimitedWaveform::SQUARE) {
+      // Only the sign of the naive sample changes
+      const int16_t highSample = (amplitude << 7) - correction;
+      return (highSample ^ ~highMask) - ~highMask;
+    } else {
+      const int16_t naiveSample =
+        multiplyAndShift(int16_t(position ^ 0x8000), amplitude);
+      return naiveSample + ((correction ^ highMask) - highMask);
+    }
+  }
+};
+
+
+/**
+ * Two-operator FM (frequency modulation, actually phase modulation, like most
+ * digital FM synthesizers) voice: a sine modulator shifts the phase of a sine
+ * carrier, which produces a rich spectrum out of two oscillators and a handful
+ * of bytes of state.
+ *
+ * Only template parameter: FRAME_PERIOD_IN_CYCLES, same as
+ * SquareWaveGenerator.
+ *
+ * Both operators work like WavetableGenerator (24-bit DDS phases, no
+ * interpolation) and read SINE_WAVETABLE. The modulator's sample (between -127
+ * and 127) is multiplied by modulationIndex (between 0 and 255), doubled, and
+ * added to the carrier's phase as a fraction of 2^16 of a period; the peak
+ * phase deviation is thus modulationIndex * 254 / 65536 periods, i.e. about
+ * modulationIndex / 41 radians (from 0, a pure sine, up to about 6.2). When
+ * the modulator's frequency is an integer multiple of the carrier's one, the
+ * sidebands are harmonics of the carrier (e.g. 1:1 and 2:1 give brass and
+ * reed-like tones, and the index controls the brightness); other ratios give
+ * inharmonic, bell-like tones. The output ranges from -32385 to 32385, like
+ * WavetableGenerator's one.
+ *
+ * Some technical considerations.
+ *
+ * Like in WavetableGenerator, every multiplication has 8-bit operands, so the
+ * hardware multiplier does the job in 2 cycles (mulsu); the phase offset is
+ * added to the carrier's phase after the latter has been incremented, and
+ * only its table index (the sum's high byte) is used, so the carrier's own
+ * accumulator is never disturbed. There are no branches at all: the duration
+ * doesn't depend on the phases nor on the index, which can thus be changed at
+ * any time (e.g. by an envelope, see setModulationIndex()).
+ */
+template<
+  uint16_t FRAME_PERIOD_IN_CYCLES,
+  enable_if_t<FRAME_PERIOD_IN_CYCLES, int> = 0
+>
+class FMGenerator {
+private:
+  __uint24 carrierPhase;
+  __uint24 carrierPhaseIncrement;
+  __uint24 modulatorPhase;
+  __uint24 modulatorPhaseIncrement;
+  uint8_t modulationIndex;
+  uint8_t amplitude;
+
+public:
+  /**
+   * The number of CPU cycles required to run getNextSample():
+   * - modulator phase increment (3 cycles);
+   * - modulator table address computation and read (6 cycles);
+   * - multiplication by modulationIndex and doubling (5 cycles);
+   * - carrier phase increment (3 cycles);
+   * - phase offset sum (2 cycles);
+   * - carrier table address computation and read (6 cycles);
+   * - multiplication by amplitude and result copy (3 cycles);
+   * - clearing the zero register after the multiplications (1 cycle);
+   * - a few register copies, because mulsu only accepts some registers
+   *   (2 cycles).
+   */
+  static constexpr uint8_t GET_NEXT_SAMPLE_DURATION = 31;
+
+  /**
+   * The number of CPU cycles required to load the whole state from SRAM (14
+   * bytes), and to store both phases back (6 bytes), when it can't stay
+   * inside registers (see Mixer)
+   */
+  static constexpr uint8_t GET_STATE_ACCESS_DURATION() {
+    return 2 * (14 + 6);
+  }
+
+  static constexpr __uint24 GET_PHASE_INCREMENT(const uint32_t frequency) {
+    return WavetableGenerator<FRAME_PERIOD_IN_CYCLES>::GET_PHASE_INCREMENT(
+      frequency
+    );
+  }
+
+  constexpr FMGenerator(
+    uint32_t carrierFrequency,
+    uint32_t modulatorFrequency,
+    uint8_t modulationIndex,
+    uint8_t amplitude
+  ) :
+    carrierPhase(0),
+    carrierPhaseIncrement(GET_PHASE_INCREMENT(carrierFrequency)),
+    modulatorPhase(0),
+    modulatorPhaseIncrement(GET_PHASE_INCREMENT(modulatorFrequency)),
+    modulationIndex(modulationIndex),
+    amplitude(amplitude)
+  {}
+
+  void setModulationIndex(uint8_t index) {
+    modulationIndex = index;
+  }
+
+  void setAmplitude(uint8_t value) {
+    amplitude = value;
+  }
+
+  int16_t getFirstSample() {
+    return 0;
+  }
+
+  int16_t getNextSample() {
+    modulatorPhase += modulatorPhaseIncrement;
+    const int8_t modulator =
+      pgm_read_byte(SINE_WAVETABLE + uint8_t(modulatorPhase >> 16));
+    // The cast avoids overflowing a (16-bit) int when doubling
+    const uint16_t phaseOffset = uint16_t(modulator * modulationIndex) << 1;
+    carrierPhase += carrierPhaseIncrement;
+    const uint16_t position = uint16_t(carrierPhase >> 8) + phaseOffset;
+    const int8_t carrier = pgm_read_byte(SINE_WAVETABLE + (position >> 8));
+    return carrier * amplitude;
+  }
+};
+
+
+/**
+ * Sample player, which decodes a 4-bit DPCM sound stored in flash (see
+ * dpcm.hpp for the format, and extras/dpcm_encoder for the encoder).
+ *
+ * Only template parameter: FRAME_PERIOD_IN_CYCLES, same as
+ * SquareWaveGenerator.
+ *
+ * The sound can be played at any rate up to the driver's sample rate
+ * (F_CPU / FRAME_PERIOD_IN_CYCLES): playing it at its own sample rate
+ * reproduces the original pitch, while other rates change the pitch (and the
+ * speed) accordingly. Sounds should thus be encoded at the lowest sample rate
+ * which preserves their content, which also saves flash. Every sample is
+ * repeated until the next one is due (no interpolation).
+ *
+ * Some technical considerations.
+ *
+ * The position inside the sound is tracked with a 15-bit fractional
+ * accumulator (phase), which is incremented by step every frame; step is the
+ * ratio between the playback rate and the driver's sample rate, where 0x8000
+ * means 1. Every time the accumulator reaches 1 (bit 15 is set), a new sample
+ * is decoded; step can't exceed 1, so at most one sample is decoded per frame,
+ * and that's what keeps the duration constant: when no sample is decoded,
+ * the same number of cycles is spent in a forced delay, like in
+ * SquareWaveGenerator::getNextSample() (made of lpm instructions, which take
+ * 12 words rather than 36 nop instructions). The other two if-else statements
+ * (handling the loop and picking a nibble) are balanced as well.
+ *
+ * The loop is handled before decoding a sample, rather than after, so that
+ * the last sample of the sound is actually played.
+ *
+ * DECODE_DURATION and GET_NEXT_SAMPLE_DURATION add up these steps:
+ * - phase increment and test (4 cycles);
+ * - loop check, including the branch (7 cycles);
+ * - address computation and flash read (8 cycles);
+ * - nibble extraction, including the branch (5 cycles);
+ * - delta lookup (SRAM) and sum (12 cycles);
+ * - index increment and phase wrap-around (3 cycles);
+ * - jump over the forced delay (2 cycles).
+ */
+template<
+  uint16_t FRAME_PERIOD_IN_CYCLES,
+  enable_if_t<FRAME_PERIOD_IN_CYCLES, int> = 0
+>
+class DPCMSampleGenerator {
+private:
+  /**
+   * The forced delay used when no sample is due: the CPU cycles spent
+   * decoding a sample (37), minus the additional cycle taken by the branch
+   * which skips the decoding
+   */
+  static constexpr uint8_t DECODE_DURATION = 36;
+
+  const uint8_t* data;
+  uint16_t length;
+  uint16_t loopStart;
+  int16_t loopStartValue;
+  uint16_t index;
+  int16_t value;
+  uint16_t phase;
+  uint16_t step;
+
+public:
+  /**
+   * The number of CPU cycles required to run getNextSample()
+   */
+  static constexpr uint8_t GET_NEXT_SAMPLE_DURATION = DECODE_DURATION + 5;
+
+  /**
+   * Computes step for the given playback rate (in Hz), which is clamped to
+   * the driver's sample rate. It's meant to be evaluated at compile time
+   * (playbackRate being a constant): at run time, it would be a 64-bit
+   * division, worth thousands of cycles.
+   */
+  static constexpr uint16_t GET_STEP(const uint32_t playbackRate) {
+    return
+      uint64_t(playbackRate) * FRAME_PERIOD_IN_CYCLES
+        >= uint32_t(F_CPU)
+      ? 0x8000
+      : (
+          (uint64_t(playbackRate) * FRAME_PERIOD_IN_CYCLES << 15)
+          + uint32_t(F_CPU) / 2
+        )
+        / uint32_t(F_CPU);
+  }
+
+  /**
+   * Plays sample at the given rate (usually sample.sampleRate, for the
+   * original pitch)
+   */
+  constexpr DPCMSampleGenerator(
+    const DPCMSample& sample,
+    uint32_t playbackRate
+  ) :
+    data(sample.data),
+    length(sample.length),
+    loopStart(sample.loopStart),
+    loopStartValue(sample.loopStartValue),
+    index(0),
+    value(0),
+    phase(0),
+    step(GET_STEP(playbackRate))
+  {}
+
+  /**
+   * Changes the playback rate (see GET_STEP(), which must be computed in
+   * advance)
+   */
+  void setStep(uint16_t value) {
+    step = value;
+  }
+
+  /**
+   * Starts playing the sound from its beginning
+   */
+  void restart() {
+    index = 0;
+    value = 0;
+    phase = 0;
+  }
+
+  int16_t getFirstSample() {
+    return 0;
+  }
+
+  int16_t getNextSample() {
+    phase += step;
+    if (phase & 0x8000) {
+      phase &= 0x7fff;
+      if (index == length) {
+        index = loopStart;
+        value = loopStartValue;
+      } else {
+        delayInCyclesWithNOP<3>();
+      }
+      const uint8_t byte = pgm_read_byte(data + (index >> 1));
+      uint8_t nibble;
+      if (index & 1) {
+        delayInCyclesWithNOP<1>();
+        nibble = byte & 0x0f;
+      } else {
+        nibble = byte >> 4;
+      }
+      value += DPCM_DELTAS[nibble];
+      index++;
+    } else {
+      delayInCyclesWithLPM<DECODE_DURATION>();
+    }
+    return value;
+  }
+};
+
+
+/**
+ * 16-bit Galois linear feedback shift register, the noise source of
+ * NoiseGenerator and PercussionGenerator.
+ *
+ * Every clock() shifts the register right by one bit, and when the bit
+ * shifted out is set, the taps (x^16 + x^14 + x^13 + x^11 + 1) are toggled;
+ * with these taps the register goes through all of its 65535 non-zero
+ * states, so the sequence of output bits repeats about every 1.3 seconds at
+ * 50 kHz, which is perceived as white noise.
+ *
+ * Some technical considerations.
+ *
+ * The register is kept as two separate bytes, so the shift is just lsr on
+ * the high byte and ror on the low one (which also leaves the shifted out
+ * bit inside the carry), and the taps only touch the high byte. clock(),
+ * clockIf() and getSample() are written in inline assembly (on AVR targets),
+ * so that their duration doesn't depend on the compiler's choices, and none
+ * has a branch:
+ * - clock() turns the carry into a mask (sbc of a register with itself),
+ *   keeps the taps' bits of it (andi) and toggles them with eor, 5 cycles in
+ *   total, which is CLOCK_DURATION;
+ * - clockIf() clocks a copy of the register in the same way, and copies it
+ *   back with two mov instructions, each one skipped by sbrc when the
+ *   condition's bit 7 is clear, 11 cycles either way
+ *   (CONDITIONAL_CLOCK_DURATION);
+ * - getSample() loads 127, and replaces it with -128 when the lowest bit is
+ *   set (sbrc skipping a second ldi), 3 cycles either way.
+ * All three assume the register is kept inside registers (like the
+ * generators' state, see SquareWaveGenerator), since loading and storing it
+ * would add 8 cycles.
+ */
+class GaloisLFSR {
+private:
+  static constexpr uint8_t TAPS = 0xb4;
+
+  uint8_t low;
+  uint8_t high;
+
+public:
+  /**
+   * The number of CPU cycles required to run clock()
+   */
+  static constexpr uint8_t CLOCK_DURATION = 5;
+  /**
+   * The number of CPU cycles required to run clockIf()
+   */
+  static constexpr uint8_t CONDITIONAL_CLOCK_DURATION = 11;
+
+  /**
+   * seed must not be 0 (the register would never leave that state)
+   */
+  constexpr GaloisLFSR(uint16_t seed = 0xace1) :
+    low(seed),
+    high(seed >> 8)
+  {}
+
+  void clock() {
+#ifdef __AVR__
+    uint8_t mask;
+    asm(
+      "lsr %[high]\n\t"
+      "ror %[low]\n\t"
+      "sbc %[mask], %[mask]\n\t"
+      "andi %[mask], %[taps]\n\t"
+      "eor %[high], %[mask]"
+      : [low] "+r" (low), [high] "+r" (high), [mask] "=&d" (mask)
+      : [taps] "n" (TAPS)
+    );
+#else
+    const uint8_t mask = -(low & 1);
+    low = (low >> 1) | (high << 7);
+    high = (high >> 1) ^ (mask & TAPS);
+#endif
+  }
+
+  /**
+   * Clocks the register only if bit 7 of condition is set, in the same
+   * number of cycles either way
+   */
+  void clockIf(const uint8_t condition) {
+#ifdef __AVR__
+    uint8_t newLow;
+    uint8_t newHigh;
+    uint8_t mask;
+    asm(
+      "mov %[newLow], %[low]\n\t"
+      "mov %[newHigh], %[high]\n\t"
+      "lsr %[newHigh]\n\t"
+      "ror %[newLow]\n\t"
+      "sbc %[mask], %[mask]\n\t"
+      "andi %[mask], %[taps]\n\t"
+      "eor %[newHigh], %[mask]\n\t"
+      "sbrc %[condition], 7\n\t"
+      "mov %[low], %[newLow]\n\t"
+      "sbrc %[condition], 7\n\t"
+      "mov %[high], %[newHigh]"
+      : [low] "+r" (low),
+        [high] "+r" (high),
+        [newLow] "=&r" (newLow),
+        [newHigh] "=&r" (newHigh),
+        [mask] "=&d" (mask)
+      : [condition] "r" (condition), [taps] "n" (TAPS)
+    );
+#else
+    if (condition & 0x80) {
+      clock();
+    }
+#endif
+  }
+
+  /**
+   * Returns 127 or -128, depending on the register's lowest bit (the next
+   * one to be shifted out)
+   */
+  int8_t getSample() const {
+#ifdef __AVR__
+    int8_t sample;
+    asm(
+      "ldi %[sample], 0x7f\n\t"
+      "sbrc %[low], 0\n\t"
+      "ldi %[sample], 0x80"
+      : [sample] "=&d" (sample)
+      : [low] "r" (low)
+    );
+    return sample;
+#else
+    return int8_t(-(low & 1)) ^ 0x7f;
+#endif
+  }
+};
+
+
+/**
+ * White noise generator, based on GaloisLFSR.
+ *
+ * Only template parameter: FRAME_PERIOD_IN_CYCLES, same as
+ * SquareWaveGenerator.
+ *
+ * The register is clocked at a configurable rate, up to the driver's sample
+ * rate, and its output is held between two clocks: lower rates move the
+ * noise's energy towards lower frequencies (from a bright hiss to a dull
+ * rumble), like the noise channels of old sound chips. Each output sample
+ * (127 or -128) is multiplied by amplitude (between 0 and 255), so the output
+ * ranges from -32640 to 32385.
+ *
+ * Some technical considerations.
+ *
+ * The clock rate is tracked exactly like DPCMSampleGenerator's playback rate:
+ * a 15-bit fractional accumulator is incremented by step every frame, and the
+ * register is clocked every time it reaches 1 (bit 15 is set). There's no
+ * branch: GaloisLFSR::clockIf() takes the phase's high byte as its
+ * condition, and bit 15 is then cleared whether it was set or not.
+ *
+ * GET_NEXT_SAMPLE_DURATION adds up these steps:
+ * - phase increment (2 cycles);
+ * - conditional clock (11 cycles, GaloisLFSR::clockIf());
+ * - phase wrap-around (1 cycle);
+ * - output sample (3 cycles, GaloisLFSR::getSample());
+ * - multiplication by amplitude, result copy and clearing the zero register
+ *   (4 cycles).
+ */
+template<
+  uint16_t FRAME_PERIOD_IN_CYCLES,
+  enable_if_t<FRAME_PERIOD_IN_CYCLES, int> = 0
+>
+class NoiseGenerator {
+private:
+  GaloisLFSR lfsr;
+  uint16_t phase;
+  uint16_t step;
+  uint8_t amplitude;
+
+public:
+  /**
+   * The number of CPU cycles required to run getNextSample()
+   */
+  static constexpr uint8_t GET_NEXT_SAMPLE_DURATION =
+    GaloisLFSR::CONDITIONAL_CLOCK_DURATION + 10;
+
+  /**
+   * The number of CPU cycles required to load the register, phase, step and
+   * amplitude from SRAM (7 bytes), and to store the register and phase back
+   * (4 bytes), when they can't stay inside registers (see Mixer)
+   */
+  static constexpr uint8_t GET_STATE_ACCESS_DURATION() {
+    return 2 * (7 + 4);
+  }
+
+  /**
+   * Computes step for the given clock rate (in Hz), which is clamped to the
+   * driver's sample rate. Like DPCMSampleGenerator::GET_STEP(), it's meant
+   * to be evaluated at compile time.
+   */
+  static constexpr uint16_t GET_STEP(const uint32_t clockRate) {
+    return DPCMSampleGenerator<FRAME_PERIOD_IN_CYCLES>::GET_STEP(clockRate);
+  }
+
+  constexpr NoiseGenerator(uint32_t clockRate, uint8_t amplitude) :
+    lfsr(),
+    phase(0),
+    step(GET_STEP(clockRate)),
+    amplitude(amplitude)
+  {}
+
+  /**
+   * Changes the clock rate (see GET_STEP(), which must be computed in
+   * advance)
+   */
+  void setStep(uint16_t value) {
+    step = value;
+  }
+
+  void setAmplitude(uint8_t value) {
+    amplitude = value;
+  }
+
+  int16_t getFirstSample() {
+    return 0;
+  }
+
+  int16_t getNextSample() {
+    phase += step;
+    lfsr.clockIf(phase >> 8);
+    phase &= 0x7fff;
+    return lfsr.getSample() * amplitude;
+  }
+};
+
+
+/**
+ * The drum sounds provided by PercussionGenerator
+ */
+enum class DrumVoice : uint8_t {
+  /**
+   * Noise clocked at the full sample rate, meant for a short decay
+   */
+  HI_HAT,
+  /**
+   * Noise clocked at a third of the sample rate (SNARE_NOISE_RATIO), which
+   * has more energy in the midrange
+   */
+  SNARE,
+  /**
+   * Sine wave whose pitch falls from about KICK_START_FREQUENCY to
+   * KICK_END_FREQUENCY Hz along with the decay
+   */
+  KICK
+};
+
+
+/**
+ * Percussion voice: one of the sounds listed by DrumVoice, with a linear
+ * decay, which starts from full volume whenever trigger() is invoked and
+ * reaches silence in the given time.
+ *
+ * Template parameters:
+ * - FRAME_PERIOD_IN_CYCLES, same as SquareWaveGenerator;
+ * - VOICE, the drum sound.
+ *
+ * The output is the voice's own sample (between -128 and 127) multiplied by
+ * the current volume, i.e. the level's high byte multiplied by amplitude
+ * (between 0 and 255) and divided by 256, so it ranges from -32640 to 32385
+ * right after a trigger. Until the first trigger, the voice is silent.
+ *
+ * Some technical considerations.
+ *
+ * The decay is linear rather than exponential, since it only costs a 16-bit
+ * subtraction per sample: the level starts from 0xffff, and decayStep is
+ * subtracted from it every frame, which gives decays from 1 frame up to 65535
+ * frames (about 1.3 seconds at 50 kHz). The subtraction's borrow means the
+ * level reached 0; on AVR targets, it's turned into a mask (sbc of a register
+ * with itself, then com) which clears the level, so there's no branch. The
+ * noise voices clock their register with GaloisLFSR::clockIf(), like
+ * NoiseGenerator, so the whole method is branch-free. The kick's sweep is
+ * derived from the same level (its high byte, multiplied by sweep, is added to
+ * the sine's phase increment), so the pitch falls linearly as the sound fades
+ * out, with no additional state.
+ *
+ * GET_NEXT_SAMPLE_DURATION adds up these steps:
+ * - level decrement, including the mask (6 cycles);
+ * - volume multiplication (3 cycles);
+ * - for the noise voices, the same steps as NoiseGenerator, excluding the
+ *   final multiplication (17 cycles);
+ * - for the kick, sweep multiplication and phase increment (8 cycles), and
+ *   table address computation and read (6 cycles);
+ * - multiplication by the volume, result copy and clearing the zero register
+ *   (4 cycles).
+ */
+template<
+  uint16_t FRAME_PERIOD_IN_CYCLES,
+  DrumVoice VOICE,
+  enable_if_t<FRAME_PERIOD_IN_CYCLES, int> = 0
+>
+class PercussionGenerator {
+private:
+  static constexpr bool IS_NOISE = VOICE != DrumVoice::KICK;
+  static constexpr uint8_t SNARE_NOISE_RATIO = 3;
+  static constexpr uint32_t KICK_START_FREQUENCY = 200;
+  static constexpr uint32_t KICK_END_FREQUENCY = 50;
+
+  using Tone = WavetableGenerator<FRAME_PERIOD_IN_CYCLES>;
+  static constexpr __uint24 KICK_PHASE_INCREMENT =
+    Tone::GET_PHASE_INCREMENT(KICK_END_FREQUENCY);
+  /**
+   * The sweep's multiplier: the level's high byte (up to 255) times sweep,
+   * doubled, must add up to the difference between the start and end phase
+   * increments
+   */
+  static constexpr uint32_t KICK_SWEEP_FULL =
+    (
+      Tone::GET_PHASE_INCREMENT(KICK_START_FREQUENCY) - KICK_PHASE_INCREMENT
+      + 255
+    )
+    / (255 * 2);
+  static constexpr uint8_t KICK_SWEEP =
+    KICK_SWEEP_FULL > 255 ? 255 : KICK_SWEEP_FULL;
+
+  GaloisLFSR lfsr;
+  uint16_t phase;
+  __uint24 tonePhase;
+  uint16_t level;
+  uint16_t decayStep;
+  uint8_t amplitude;
+
+public:
+  /**
+   * The number of CPU cycles required to run getNextSample()
+   */
+  static constexpr uint8_t GET_NEXT_SAMPLE_DURATION = IS_NOISE ? 30 : 27;
+
+  /**
+   * The number of CPU cycles required to load the state getNextSample() reads
+   * from SRAM, and to store back the bytes it changes, when it can't stay
+   * inside registers (see Mixer): the register, phase, level, decayStep and
+   * amplitude (9 bytes, 6 stored) for the noise voices, tonePhase, level,
+   * decayStep and amplitude (8 bytes, 5 stored) for the kick
+   */
+  static constexpr uint8_t GET_STATE_ACCESS_DURATION() {
+    return IS_NOISE ? 2 * (9 + 6) : 2 * (8 + 5);
+  }
+
+  /**
+   * Computes decayStep for the given decay time (in ms); when milliseconds is
+   * a constant, so is the result.
+   */
+  static constexpr uint16_t GET_DECAY_STEP(const uint32_t milliseconds) {
+    const uint64_t frames =
+      uint64_t(F_CPU) * milliseconds / 1000 / FRAME_PERIOD_IN_CYCLES;
+    return frames <= 1 ? 0xffff : frames >= 0xffff ? 1 : 0xffff / frames;
+  }
+
+  constexpr PercussionGenerator(
+    uint32_t decayMilliseconds,
+    uint8_t amplitude
+  ) :
+    lfsr(),
+    phase(0),
+    tonePhase(0),
+    level(0),
+    decayStep(GET_DECAY_STEP(decayMilliseconds)),
+    amplitude(amplitude)
+  {}
+
+  /**
+   * Starts the sound from full volume (and, for the kick, from the start of
+   * the sine's period and the highest pitch)
+   */
+  void trigger() {
+    level = 0xffff;
+    tonePhase = 0;
+  }
+
+  /**
+   * Changes the decay time (see GET_DECAY_STEP(), which is best computed in
+   * advance, since it requires a division)
+   */
+  void setDecayStep(uint16_t value) {
+    decayStep = value;
+  }
+
+  void setAmplitude(uint8_t value) {
+    amplitude = value;
+  }
+
+  int16_t getFirstSample() {
+    return 0;
+  }
+
+  int16_t getNextSample() {
+#ifdef __AVR__
+    uint8_t mask;
+    asm(
+      "sub %A[level], %A[decayStep]\n\t"
+      "sbc %B[level], %B[decayStep]\n\t"
+      "sbc %[mask], %[mask]\n\t"
+      "com %[mask]\n\t"
+      "and %A[level], %[mask]\n\t"
+      "and %B[level], %[mask]"
+      : [level] "+r" (level), [mask] "=&r" (mask)
+      : [decayStep] "r" (decayStep)
+    );
+#else
+    const uint16_t decayed = level - decayStep;
+    level = decayed > level ? 0 : decayed;
+#endif
+    const uint8_t levelHigh = level >> 8;
+    const uint8_t volume = (uint16_t(levelHigh) * amplitude) >> 8;
+    int8_t sample;
+    if constexpr (IS_NOISE) {
+      phase +=
+        VOICE == DrumVoice::HI_HAT ? 0x8000 : 0x8000 / SNARE_NOISE_RATIO;
+      lfsr.clockIf(phase >> 8);
+      phase &= 0x7fff;
+      sample = lfsr.getSample();
+    } else {
+      tonePhase +=
+        KICK_PHASE_INCREMENT
+        + (__uint24(uint16_t(levelHigh) * KICK_SWEEP) << 1);
+      sample = pgm_read_byte(SINE_WAVETABLE + uint8_t(tonePhase >> 16));
+    }
+    return sample * volume;
+  }
 };
@@ -0,0 +1,113 @@
+#pragma once
+
+/*
+ * Single-cycle waveforms for WavetableGenerator, stored in flash.
+ *
+ * Each table contains WAVETABLE_SIZE samples, plus a copy of the first one at
+ * the end (the guard sample), which lets the interpolating generator read the
+ * sample following the last one without wrapping the index around. Samples
+ * range from -127 to 127 (-128 is never used, so that every waveform is
+ * symmetrical). Custom tables must follow the same layout.
+ *
+ * The tables were generated with a short Python script (rounding each value
+ * to the nearest integer):
+ *   sine:     127 * sin(2 * pi * i / 256)
+ *   triangle: 0 at i = 0, 127 at i = 64, -127 at i = 192
+ *   sawtooth: -127 + 254 * i / 255
+ */
+
+#include <stdint.h>
+#include <avr/pgmspace.h>
+
+
+/**
+ * The number of samples per waveform period (not including the guard sample)
+ */
+constexpr uint16_t WAVETABLE_SIZE = 256;
+
+
+/**
+ * Sine wave
+ */
+const int8_t SINE_WAVETABLE[WAVETABLE_SIZE + 1] PROGMEM = {
+     0,    3,    6,    9,   12,   16,   19,   22,   25,   28,   31,   34,
+    37,   40,   43,   46,   49,   51,   54,   57,   60,   63,   65,   68,
+    71,   73,   76,   78,   81,   83,   85,   88,   90,   92,   94,   96,
+    98,  100,  102,  104,  106,  107,  109,  111,  112,  113,  115,  116,
+   117,  118,  120,  121,  122,  122,  123,  124,  125,  125,  126,  126,
+   126,  127,  127,  127,  127,  127,  127,  127,  126,  126,  126,  125,
+   125,  124,  123,  122,  122,  121,  120,  118,  117,  116,  115,  113,
+   112,  111,  109,  107,  106,  104,  102,  100,   98,   96,   94,   92,
+    90,   88,   85,   83,   81,   78,   76,   73,   71,   68,   65,   63,
+    60,   57,   54,   51,   49,   46,   43,   40,   37,   34,   31,   28,
+    25,   22,   19,   16,   12,    9,    6,    3,    0,   -3,   -6,   -9,
+   -12,  -16,  -19,  -22,  -25,  -28,  -31,  -34,  -37,  -40,  -43,  -46,
+   -49,  -51,  -54,  -57,  -60,  -63,  -65,  -68,  -71,  -73,  -76,  -78,
+   -81,  -83,  -85,  -88,  -90,  -92,  -94,  -96,  -98, -100, -102, -104,
+  -106, -107, -109, -111, -112, -113, -115, -116, -117, -118, -120, -121,
+  -122, -122, -123, -124, -125, -125, -126, -126, -126, -127, -127, -127,
+  -127, -127, -127, -127, -126, -126, -126, -125, -125, -124, -123, -122,
+  -122, -121, -120, -118, -117, -116, -115, -113, -112, -111, -109, -107,
+  -106, -104, -102, -100,  -98,  -96,  -94,  -92,  -90,  -88,  -85,  -83,
+   -81,  -78,  -76,  -73,  -71,  -68,  -65,  -63,  -60,  -57,  -54,  -51,
+   -49,  -46,  -43,  -40,  -37,  -34,  -31,  -28,  -25,  -22,  -19,  -16,
+   -12,   -9,   -6,   -3,    0
+};
+
+
+/**
+ * Triangle wave
+ */
+const int8_t TRIANGLE_WAVETABLE[WAVETABLE_SIZE + 1] PROGMEM = {
+     0,    2,    4,    6,    8,   10,   12,   14,   16,   18,   20,   22,
+    24,   26,   28,   30,   32,   34,   36,   38,   40,   42,   44,   46,
+    48,   50,   52,   54,   56,   58,   60,   62,   64,   65,   67,   69,
+    71,   73,   75,   77,   79,   81,   83,   85,   87,   89,   91,   93,
+    95,   97,   99,  101,  103,  105,  107,  109,  111,  113,  115,  117,
+   119,  121,  123,  125,  127,  125,  123,  121,  119,  117,  115,  113,
+   111,  109,  107,  105,  103,  101,   99,   97,   95,   93,   91,   89,
+    87,   85,   83,   81,   79,   77,   75,   73,   71,   69,   67,   65,
+    64,   62,   60,   58,   56,   54,   52,   50,   48,   46,   44,   42,
+    40,   38,   36,   34,   32,   30,   28,   26,   24,   22,   20,   18,
+    16,   14,   12,   10,    8,    6,    4,    2,    0,   -2,   -4,   -6,
+    -8,  -10,  -12,  -14,  -16,  -18,  -20,  -22,  -24,  -26,  -28,  -30,
+   -32,  -34,  -36,  -38,  -40,  -42,  -44,  -46,  -48,  -50,  -52,  -54,
+   -56,  -58,  -60,  -62,  -64,  -65,  -67,  -69,  -71,  -73,  -75,  -77,
+   -79,  -81,  -83,  -85,  -87,  -89,  -91,  -93,  -95,  -97,  -99, -101,
+  -103, -105, -107, -109, -111, -113, -115, -117, -119, -121, -123, -125,
+  -127, -125, -123, -121, -119, -117, -115, -113, -111, -109, -107, -105,
+  -103, -101,  -99,  -97,  -95,  -93,  -91,  -89,  -87,  -85,  -83,  -81,
+   -79,  -77,  -75,  -73,  -71,  -69,  -67,  -65,  -64,  -62,  -60,  -58,
+   -56,  -54,  -52,  -50,  -48,  -46,  -44,  -42,  -40,  -38,  -36,  -34,
+   -32,  -30,  -28,  -26,  -24,  -22,  -20,  -18,  -16,  -14,  -12,  -10,
+    -8,   -6,   -4,   -2,    0
+};
+
+
+/**
+ * Rising sawtooth wave
+ */
+const int8_t SAWTOOTH_WAVETABLE[WAVETABLE_SIZE + 1] PROGMEM = {
+  -127, -126, -125, -124, -123, -122, -121, -120, -119, -118, -117, -116,
+  -115, -114, -113, -112, -111, -110, -109, -108, -107, -106, -105, -104,
+  -103, -102, -101, -100,  -99,  -98,  -97,  -96,  -95,  -94,  -93,  -92,
+   -91,  -90,  -89,  -88,  -87,  -86,  -85,  -84,  -83,  -82,  -81,  -80,
+   -79,  -78,  -77,  -76,  -75,  -74,  -73,  -72,  -71,  -70,  -69,  -68,
+   -67,  -66,  -65,  -64,  -63,  -62,  -61,  -60,  -59,  -58,  -57,  -56,
+   -55,  -54,  -53,  -52,  -51,  -50,  -49,  -48,  -47,  -46,  -45,  -44,
+   -43,  -42,  -41,  -40,  -39,  -38,  -37,  -36,  -35,  -34,  -33,  -32,
+   -31,  -30,  -29,  -28,  -27,  -26,  -25,  -24,  -23,  -22,  -21,  -20,
+   -19,  -18,  -17,  -16,  -15,  -14,  -13,  -12,  -11,  -10,   -9,   -8,
+    -7,   -6,   -5,   -4,   -3,   -2,   -1,    0,    0,    1,    2,    3,
+     4,    5,    6,    7,    8,    9,   10,   11,   12,   13,   14,   15,
+    16,   17,   18,   19,   20,   21,   22,   23,   24,   25,   26,   27,
+    28,   29,   30,   31,   32,   33,   34,   35,   36,   37,   38,   39,
+    40,   41,   42,   43,   44,   45,   46,   47,   48,   49,   50,   51,
+    52,   53,   54,   55,   56,   57,   58,   59,   60,   61,   62,   63,
+    64,   65,   66,   67,   68,   69,   70,   71,   72,   73,   74,   75,
+    76,   77,   78,   79,   80,   81,   82,   83,   84,   85,   86,   87,
+    88,   89,   90,   91,   92,   93,   94,   95,   96,   97,   98,   99,
+   100,  101,  102,  103,  104,  105,  106,  107,  108,  109,  110,  111,
+   112,  113,  114,  115,  116,  117,  118,  119,  120,  121,  122,  123,
+   124,  125,  126,  127, -127
+};